@@ -0,0 +1,216 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file bench_basic.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Lines per second and per call latency of the virtual read and send paths of comm::Ether against those of
+ *  comm::BasicComm, with a mutex and without, over TCP loopback. A peer thread floods the instance with lines for the
+ *  reads and drains it for the sends.
+ *  Usage: comm_bench_basic [calls per case]
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/basic.h>
+// SYS
+#include <poll.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+// STD
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+using namespace comm;
+
+
+/*=============================================================================================================================
+ * PEER : Thread playing the device, it floods or drains the instance until stopped
+ *===========================================================================================================================*/
+class Peer {
+public:
+    // Flood the instance with pattern, over and over
+    Peer ( int fd, const string& pattern ) : stopped_(false) {
+        ::fcntl ( fd, F_SETFL, ::fcntl ( fd, F_GETFL ) | O_NONBLOCK );
+        this->thread_ = std::thread ( [this, fd, pattern] {
+            size_t offset = 0;
+            while ( this->wait_ ( fd, POLLOUT ) ) {
+                ssize_t sent = ::write ( fd, pattern.data() + offset, pattern.size() - offset );
+                if ( sent > 0 ) offset = ( offset + sent ) % pattern.size();
+            }
+        } );
+    }
+    // Drain whatever the instance sends
+    explicit Peer ( int fd ) : stopped_(false) {
+        this->thread_ = std::thread ( [this, fd] {
+            std::vector<char> buffer ( 1 << 16 );
+            while ( this->wait_ ( fd, POLLIN ) ) if ( ::read ( fd, &buffer[0], buffer.size() ) < 0 ) break;
+        } );
+    }
+    ~Peer ( ) { this->stopped_ = true; this->thread_.join(); }
+
+private:
+    // Wait for the descriptor, false once stopped
+    bool wait_ ( int fd, short events ) {
+        struct pollfd ready = { fd, events, 0 };
+        while ( ! this->stopped_ ) if ( ::poll ( &ready, 1, 50 ) > 0 ) return true;
+        return false;
+    }
+    std::atomic<bool> stopped_;
+    std::thread thread_;
+};
+
+
+/*=============================================================================================================================
+ * TRANSPORT : TCP loopback, the accepted socket is the peer
+ *===========================================================================================================================*/
+// Listening socket on a free loopback port
+static int listen_loopback ( uint16_t& port ) {
+    int listener = ::socket ( AF_INET, SOCK_STREAM, 0 );
+    sockaddr_in address = sockaddr_in();
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    socklen_t length = sizeof ( address );
+    if ( ::bind ( listener, (struct sockaddr *) &address, length ) < 0 || ::listen ( listener, 1 ) < 0 ||
+         ::getsockname ( listener, (struct sockaddr *) &address, &length ) < 0 ) {
+        std::perror ( "listen" );
+        std::exit ( 1 );
+    }
+    port = ntohs ( address.sin_port );
+    return listener;
+}
+
+// Accept the connection of the instance, the listener is closed
+static int accept_peer ( int listener ) {
+    int peer = ::accept ( listener, NULL, NULL );
+    ::close ( listener );
+    return peer;
+}
+
+
+/*=============================================================================================================================
+ * CASES : Each case runs calls operations and prints a row
+ *===========================================================================================================================*/
+// Elapsed seconds since start
+static double elapsed ( const timespec& start ) {
+    timespec now;
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+// Lines of size bytes (eol included), enough of them to make a pattern of about 64 KiB
+static string lines_of ( size_t size ) {
+    string line;
+    for ( size_t i = 0; line.size() + 1 < size; ++i ) line += static_cast<char> ( 'a' + i % 26 );
+    line += '\n';
+    string pattern;
+    while ( pattern.size() < 65536 ) pattern += line;
+    return pattern;
+}
+
+// Run operation calls times, print calls per second and latency
+template <typename Operation>
+static void run ( const char *front, const char *op, size_t payload, size_t calls, Operation operation ) {
+    size_t bytes = 0;
+    timespec start;
+    clock_gettime ( CLOCK_MONOTONIC, &start );
+    for ( size_t i = 0; i < calls; ++i ) bytes += operation ( );
+    double seconds = elapsed ( start );
+    std::printf ( "%-22s %-9s %7zu %12.0f %10.1f %10.1f\n", front, op, payload, calls / seconds, bytes / seconds * 1e-6,
+                  seconds / calls * 1e9 );
+}
+
+static const Timeout timeout ( 1, 1, 0, 1 );
+
+// Cases of comm::Ether, through the virtual paths
+static void run_virtual ( size_t payload, size_t calls ) {
+    const char *front = "Ether";
+    {
+        uint16_t port;
+        int listener = listen_loopback ( port );
+        Ether comm ( "127.0.0.1", port, "\n", timeout );
+        int fd = accept_peer ( listener );
+        {
+            Peer peer ( fd, lines_of ( payload ) );
+            string line;
+            run ( front, "readline", payload, calls, [&] { line.clear(); return comm.readline ( line, payload * 2 ); } );
+            run ( front, "peekline", payload, calls, [&] {
+                View view = comm.peekline ( payload * 2 );
+                comm.release ( view );
+                return view.size; } );
+        }
+        ::close ( fd );
+    }
+    {
+        uint16_t port;
+        int listener = listen_loopback ( port );
+        Ether comm ( "127.0.0.1", port, "\n", timeout );
+        int fd = accept_peer ( listener );
+        {
+            Peer peer ( fd );
+            string data ( payload, 'x' );
+            run ( front, "send", payload, calls, [&] { return comm.send ( data ); } );
+        }
+        ::close ( fd );
+    }
+}
+
+// Cases of comm::BasicComm, with the locking of Locking
+template <class Locking>
+static void run_basic ( const char *front, size_t payload, size_t calls ) {
+    {
+        uint16_t port;
+        int listener = listen_loopback ( port );
+        BasicComm<Ether, Lines, Locking> comm ( Lines ( "\n" ), "127.0.0.1", port, "\n", timeout );
+        int fd = accept_peer ( listener );
+        {
+            Peer peer ( fd, lines_of ( payload ) );
+            string line;
+            run ( front, "readline", payload, calls, [&] { comm.readFrame ( line, payload * 2 ); return line.size(); } );
+            run ( front, "peekline", payload, calls, [&] {
+                View view = comm.peekFrame ( payload * 2 );
+                comm.release ( view );
+                return view.size; } );
+        }
+        ::close ( fd );
+    }
+    {
+        uint16_t port;
+        int listener = listen_loopback ( port );
+        BasicComm<Ether, Lines, Locking> comm ( Lines ( "\n" ), "127.0.0.1", port, "\n", timeout );
+        int fd = accept_peer ( listener );
+        {
+            Peer peer ( fd );
+            string data ( payload, 'x' );
+            run ( front, "send", payload, calls, [&] { return comm.send ( data ); } );
+        }
+        ::close ( fd );
+    }
+}
+
+int main ( int argc, char **argv ) {
+    size_t calls = argc > 1 ? std::strtoul ( argv[1], NULL, 10 ) : 1000000;
+    std::setvbuf ( stdout, NULL, _IOLBF, 0 );
+    std::printf ( "%-22s %-9s %7s %12s %10s %10s\n", "front", "call", "payload", "calls/s", "MB/s", "ns/call" );
+    static const size_t payloads[] = { 16, 64, 256 };
+    for ( size_t p = 0; p < 3; ++p ) {
+        run_virtual ( payloads[p], calls );
+        run_basic<Locked> ( "BasicComm<Locked>", payloads[p], calls );
+        run_basic<Unlocked> ( "BasicComm<Unlocked>", payloads[p], calls );
+    }
+    return 0;
+}
@@ -0,0 +1,361 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file bench_comm.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Throughput, per call latency and syscalls per call of read, readline, readlines and send, across payload sizes and
+ *  EOL lengths, over TCP loopback and a socketpair (Ether) and over a pseudo terminal (Serial). A peer thread plays the
+ *  device: it floods the instance with data for the reads and drains it for the sends. Syscalls are counted by wrapping
+ *  the libc calls made by comm, only those of the measuring thread. The latency mode times request and response round
+ *  trips over TCP loopback instead, for each profile of socket options.
+ *  Usage: comm_bench_comm [calls per case]
+ *         comm_bench_comm latency [round trips]
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/ether.h>
+#include <comm/serial.h>
+#include "../test/pty_loopback.h"
+// SYS
+#include <dlfcn.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+// STD
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+using namespace comm;
+
+
+/*=============================================================================================================================
+ * SYSCALL COUNTING : The libc calls made by comm are wrapped, the calls of the measuring thread are counted
+ *===========================================================================================================================*/
+static thread_local bool counting = false;
+static thread_local size_t syscalls = 0;
+
+// Next definition of a libc function, the one the wrapper forwards to
+template <typename Function>
+static Function next ( const char *name ) { return reinterpret_cast<Function> ( dlsym ( RTLD_NEXT, name ) ); }
+
+extern "C" {
+    ssize_t read ( int fd, void *data, size_t size ) {
+        static ssize_t (*call) ( int, void*, size_t ) = next<ssize_t (*) ( int, void*, size_t )> ( "read" );
+        if ( counting ) ++syscalls;
+        return call ( fd, data, size );
+    }
+    ssize_t write ( int fd, const void *data, size_t size ) {
+        static ssize_t (*call) ( int, const void*, size_t ) = next<ssize_t (*) ( int, const void*, size_t )> ( "write" );
+        if ( counting ) ++syscalls;
+        return call ( fd, data, size );
+    }
+    ssize_t recv ( int fd, void *data, size_t size, int flags ) {
+        static ssize_t (*call) ( int, void*, size_t, int ) = next<ssize_t (*) ( int, void*, size_t, int )> ( "recv" );
+        if ( counting ) ++syscalls;
+        return call ( fd, data, size, flags );
+    }
+    ssize_t send ( int fd, const void *data, size_t size, int flags ) {
+        static ssize_t (*call) ( int, const void*, size_t, int ) =
+                next<ssize_t (*) ( int, const void*, size_t, int )> ( "send" );
+        if ( counting ) ++syscalls;
+        return call ( fd, data, size, flags );
+    }
+    ssize_t sendmsg ( int fd, const struct msghdr *message, int flags ) {
+        static ssize_t (*call) ( int, const struct msghdr*, int ) =
+                next<ssize_t (*) ( int, const struct msghdr*, int )> ( "sendmsg" );
+        if ( counting ) ++syscalls;
+        return call ( fd, message, flags );
+    }
+    ssize_t writev ( int fd, const struct iovec *iov, int count ) {
+        static ssize_t (*call) ( int, const struct iovec*, int ) =
+                next<ssize_t (*) ( int, const struct iovec*, int )> ( "writev" );
+        if ( counting ) ++syscalls;
+        return call ( fd, iov, count );
+    }
+    int ppoll ( struct pollfd *fds, nfds_t count, const struct timespec *timeout, const sigset_t *mask ) {
+        static int (*call) ( struct pollfd*, nfds_t, const struct timespec*, const sigset_t* ) =
+                next<int (*) ( struct pollfd*, nfds_t, const struct timespec*, const sigset_t* )> ( "ppoll" );
+        if ( counting ) ++syscalls;
+        return call ( fds, count, timeout, mask );
+    }
+    int poll ( struct pollfd *fds, nfds_t count, int timeout ) {
+        static int (*call) ( struct pollfd*, nfds_t, int ) = next<int (*) ( struct pollfd*, nfds_t, int )> ( "poll" );
+        if ( counting ) ++syscalls;
+        return call ( fds, count, timeout );
+    }
+}
+
+
+/*=============================================================================================================================
+ * TRANSPORTS : The instance under test and the descriptor of the peer playing the device
+ *===========================================================================================================================*/
+// Ether adopting one end of a socketpair instead of connecting
+class PairEther : public Ether {
+public:
+    PairEther ( int fd, const string& eol ) : Ether ( "", 0, eol, Timeout ( 1, 1, 0, 1 ) ) {
+        ::close ( this->fd_ );
+        this->fd_ = fd;
+        this->is_connected_ = true;
+    }
+};
+
+struct Transport {
+    const char *name;
+    Comm *comm;
+    int peer;
+    test::PtyLoopback *device;  // owner of the peer descriptor, NULL for sockets
+};
+
+// Destroy the instance, then the peer
+static void close_transport ( Transport& transport ) {
+    delete transport.comm;
+    if ( transport.device ) delete transport.device;
+    else ::close ( transport.peer );
+}
+
+// Listening socket on a free loopback port
+static int listen_loopback ( uint16_t& port ) {
+    int listener = ::socket ( AF_INET, SOCK_STREAM, 0 );
+    sockaddr_in address = sockaddr_in();
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+    socklen_t length = sizeof ( address );
+    if ( ::bind ( listener, (struct sockaddr *) &address, length ) < 0 || ::listen ( listener, 1 ) < 0 ||
+         ::getsockname ( listener, (struct sockaddr *) &address, &length ) < 0 ) {
+        std::perror ( "listen" );
+        std::exit ( 1 );
+    }
+    port = ntohs ( address.sin_port );
+    return listener;
+}
+
+// TCP loopback, the accepted socket is the peer
+static Transport tcp_transport ( const string& eol ) {
+    uint16_t port;
+    int listener = listen_loopback ( port );
+    Transport transport = { "tcp", new Ether ( "127.0.0.1", port, eol, Timeout ( 1, 1, 0, 1 ) ), -1, NULL };
+    transport.peer = ::accept ( listener, NULL, NULL );
+    ::close ( listener );
+    return transport;
+}
+
+// Unix socketpair
+static Transport pair_transport ( const string& eol ) {
+    int fds[2];
+    if ( ::socketpair ( AF_UNIX, SOCK_STREAM, 0, fds ) < 0 ) { std::perror ( "socketpair" ); std::exit ( 1 ); }
+    Transport transport = { "socketpair", new PairEther ( fds[0], eol ), fds[1], NULL };
+    return transport;
+}
+
+// Pseudo terminal, Serial opens the slave side, the master is the peer (no pacing, as fast as the pty goes)
+static Transport pty_transport ( const string& eol ) {
+    test::PtyLoopback *device = new test::PtyLoopback();
+    Transport transport = { "pty", new Serial ( device->path(), 115200, eol, Timeout ( 1, 1, 0, 1 ) ), device->master(),
+                            device };
+    return transport;
+}
+
+
+/*=============================================================================================================================
+ * PEER : Thread playing the device, it floods or drains the instance until stopped
+ *===========================================================================================================================*/
+class Peer {
+public:
+    // Flood the instance with pattern, over and over
+    Peer ( int fd, const string& pattern ) : stopped_(false) {
+        // Never block in write, the instance stops reading at the end of a case
+        ::fcntl ( fd, F_SETFL, ::fcntl ( fd, F_GETFL ) | O_NONBLOCK );
+        this->thread_ = std::thread ( [this, fd, pattern] {
+            size_t offset = 0;
+            while ( this->wait_ ( fd, POLLOUT ) ) {
+                ssize_t sent = ::write ( fd, pattern.data() + offset, pattern.size() - offset );
+                if ( sent > 0 ) offset = ( offset + sent ) % pattern.size();
+            }
+        } );
+    }
+    // Drain whatever the instance sends
+    explicit Peer ( int fd ) : stopped_(false) {
+        this->thread_ = std::thread ( [this, fd] {
+            std::vector<char> buffer ( 1 << 16 );
+            while ( this->wait_ ( fd, POLLIN ) ) if ( ::read ( fd, &buffer[0], buffer.size() ) < 0 ) break;
+        } );
+    }
+    ~Peer ( ) { this->stopped_ = true; this->thread_.join(); }
+
+private:
+    // Wait for the descriptor, false once stopped
+    bool wait_ ( int fd, short events ) {
+        struct pollfd ready = { fd, events, 0 };
+        while ( ! this->stopped_ ) if ( ::poll ( &ready, 1, 50 ) > 0 ) return true;
+        return false;
+    }
+    std::atomic<bool> stopped_;
+    std::thread thread_;
+};
+
+
+/*=============================================================================================================================
+ * CASES : Each case runs calls operations and prints a row
+ *===========================================================================================================================*/
+// Elapsed seconds since start
+static double elapsed ( const timespec& start ) {
+    timespec now;
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+// Lines of size bytes (eol included), enough of them to make a pattern of about 64 KiB
+static string lines_of ( size_t size, const string& eol ) {
+    string line;
+    for ( size_t i = 0; line.size() + eol.size() < size; ++i ) line += static_cast<char> ( 'a' + i % 26 );
+    line += eol;
+    string pattern;
+    while ( pattern.size() < 65536 ) pattern += line;
+    return pattern;
+}
+
+// Escaped eol for the output
+static const char* eol_name ( const string& eol ) { return eol == "\n" ? "\\n" : eol == "\r\n" ? "\\r\\n" : "-"; }
+
+// Run operation calls times on the measuring thread, print throughput, latency and syscalls per call
+template <typename Operation>
+static void run ( const char *transport, const char *op, size_t payload, const string& eol, size_t calls,
+                  Operation operation ) {
+    size_t bytes = 0;
+    syscalls = 0;
+    timespec start;
+    clock_gettime ( CLOCK_MONOTONIC, &start );
+    counting = true;
+    for ( size_t i = 0; i < calls; ++i ) bytes += operation ( );
+    counting = false;
+    double seconds = elapsed ( start );
+    std::printf ( "%-10s %-9s %7zu %-5s %10.1f %10.0f %10.3f\n", transport, op, payload, eol_name ( eol ),
+                  bytes / seconds * 1e-6, seconds / calls * 1e9, static_cast<double> ( syscalls ) / calls );
+}
+
+// Every case of a transport, the instance is recreated for each eol
+static void run_transport ( Transport ( *make ) ( const string& ), size_t calls ) {
+    static const size_t payloads[] = { 16, 256, 4096 };
+    static const char *eols[] = { "\n", "\r\n" };
+    for ( size_t e = 0; e < 2; ++e ) {
+        string eol = eols[e];
+        for ( size_t p = 0; p < 3; ++p ) {
+            size_t payload = payloads[p];
+            // Reads, the peer floods the instance with lines of payload bytes
+            {
+                Transport transport = make ( eol );
+                Comm& comm = *transport.comm;
+                {
+                    Peer peer ( transport.peer, lines_of ( payload, eol ) );
+                    string data;
+                    if ( e == 0 )
+                        run ( transport.name, "read", payload, "", calls, [&] {
+                            data.clear(); return comm.read ( data, payload ); } );
+                    run ( transport.name, "readline", payload, eol, calls, [&] {
+                        data.clear(); return comm.readline ( data, payload * 2 ); } );
+                    run ( transport.name, "readlines", payload, eol, calls / 16 + 1, [&] {
+                        vector<string> lines = comm.readlines ( 16 * payload );
+                        size_t size = 0;
+                        for ( size_t i = 0; i < lines.size(); ++i ) size += lines[i].size();
+                        return size; } );
+                }
+                close_transport ( transport );
+            }
+            // Sends, the peer drains the instance
+            if ( e == 0 ) {
+                Transport transport = make ( eol );
+                Comm& comm = *transport.comm;
+                {
+                    Peer peer ( transport.peer );
+                    string data ( payload, 'x' );
+                    run ( transport.name, "send", payload, "", calls, [&] { return comm.send ( data ); } );
+                }
+                close_transport ( transport );
+            }
+        }
+    }
+}
+
+
+/*=============================================================================================================================
+ * LATENCY : Request and response round trips over TCP loopback, with the socket options of the instance
+ *===========================================================================================================================*/
+// Requests and responses go out in two writes each, a header and a body: the pattern that Nagle and the delayed ACKs
+// stall, unless the socket options say otherwise
+static const size_t HEADER = 8, BODY = 56;
+
+// Time trips round trips, print the percentiles of the round trip time in microseconds
+static void run_latency ( const char *profile, const SocketOptions& options, size_t trips ) {
+    uint16_t port;
+    int listener = listen_loopback ( port );
+    Ether comm ( "127.0.0.1", port, "\n", Timeout ( 1, 1, 0, 1 ), options );
+    int peer = ::accept ( listener, NULL, NULL );
+    ::close ( listener );
+    // The peer answers each request once it is complete, its own socket is left as it is
+    std::thread responder ( [peer] {
+        char buffer[HEADER + BODY];
+        while ( true ) {
+            size_t got = 0;
+            while ( got < sizeof ( buffer ) ) {
+                ssize_t now = ::read ( peer, buffer + got, sizeof ( buffer ) - got );
+                if ( now <= 0 ) return;
+                got += now;
+            }
+            if ( ::write ( peer, buffer, HEADER ) < 0 || ::write ( peer, buffer + HEADER, BODY ) < 0 ) return;
+        }
+    } );
+    string header ( HEADER, 'h' ), body ( BODY, 'b' ), response;
+    Histogram rtt;
+    for ( size_t i = 0; i < trips; ++i ) {
+        timespec start;
+        clock_gettime ( CLOCK_MONOTONIC, &start );
+        comm.send ( header );
+        comm.send ( body );
+        response.clear();
+        if ( comm.read ( response, HEADER + BODY ) < HEADER + BODY ) break;
+        rtt.record ( static_cast<uint64_t> ( elapsed ( start ) * 1e9 ) );
+    }
+    ::shutdown ( peer, SHUT_RDWR );
+    responder.join();
+    ::close ( peer );
+    Histogram::Snapshot snapshot = rtt.snapshot();
+    std::printf ( "%-20s %8llu %10.1f %10.1f %10.1f %10.1f\n", profile, (unsigned long long) snapshot.count,
+                  snapshot.percentile ( 0.5 ) * 1e-3, snapshot.percentile ( 0.99 ) * 1e-3, snapshot.max * 1e-3,
+                  snapshot.mean() * 1e-3 );
+}
+
+int main ( int argc, char **argv ) {
+    std::setvbuf ( stdout, NULL, _IOLBF, 0 );
+    if ( argc > 1 && string ( argv[1] ) == "latency" ) {
+        size_t trips = argc > 2 ? std::strtoul ( argv[2], NULL, 10 ) : 200;
+        std::printf ( "%-20s %8s %10s %10s %10s %10s\n", "options", "trips", "p50 us", "p99 us", "max us", "mean us" );
+        run_latency ( "default", SocketOptions(), trips );
+        run_latency ( "no_delay", SocketOptions ( true ), trips );
+        run_latency ( "quick_ack", SocketOptions ( false, true ), trips );
+        run_latency ( "no_delay+quick_ack", SocketOptions::lowLatency(), trips );
+        return 0;
+    }
+    size_t calls = argc > 1 ? std::strtoul ( argv[1], NULL, 10 ) : 20000;
+    std::printf ( "%-10s %-9s %7s %-5s %10s %10s %10s\n", "transport", "call", "payload", "eol", "MB/s", "ns/call",
+                  "sys/call" );
+    run_transport ( tcp_transport, calls );
+    run_transport ( pair_transport, calls );
+    run_transport ( pty_transport, calls );
+    return 0;
+}
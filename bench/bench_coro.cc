@@ -0,0 +1,142 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file bench_coro.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Request/response round trips per second of many loopback TCP devices, driven by one blocking thread per device
+ *  against coroutines on a small executor. The devices are echo sockets served by a single epoll thread.
+ *  Usage: comm_bench_coro [devices] [round trips per device] [executor threads]
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/ether.h>
+#include <comm/coro.h>
+// SYS
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+// STD
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+using namespace comm;
+
+// Elapsed seconds since start
+static double elapsed ( const timespec& start ) {
+    timespec now;
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+// Echo devices, the clients are the instances under test, the accepted sockets echo back whatever they receive
+struct Devices {
+    std::vector<Ether*> clients;
+    std::vector<int> peers;
+    std::atomic<bool> stopped;
+    std::thread echo;
+    Devices ( size_t count ) : stopped(false) {
+        int listener = ::socket ( AF_INET, SOCK_STREAM, 0 );
+        sockaddr_in address = sockaddr_in();
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+        socklen_t length = sizeof ( address );
+        if ( ::bind ( listener, (struct sockaddr *) &address, length ) < 0 || ::listen ( listener, 1024 ) < 0 ||
+             ::getsockname ( listener, (struct sockaddr *) &address, &length ) < 0 ) {
+            std::perror ( "listen" );
+            std::exit ( 1 );
+        }
+        for ( size_t i = 0; i < count; ++i ) {
+            this->clients.push_back ( new Ether ( "127.0.0.1", ntohs ( address.sin_port ), "\n", Timeout ( 5, 5, 0, 1 ) ) );
+            this->peers.push_back ( ::accept ( listener, NULL, NULL ) );
+        }
+        ::close ( listener );
+        this->echo = std::thread ( [this] {
+            int epoll_fd = ::epoll_create1 ( 0 );
+            for ( size_t i = 0; i < this->peers.size(); ++i ) {
+                struct epoll_event event;
+                event.events = EPOLLIN;
+                event.data.fd = this->peers[i];
+                ::epoll_ctl ( epoll_fd, EPOLL_CTL_ADD, this->peers[i], &event );
+            }
+            struct epoll_event events[256];
+            char buffer[4096];
+            while ( ! this->stopped ) {
+                int ready = ::epoll_wait ( epoll_fd, events, 256, 100 );
+                for ( int i = 0; i < ready; ++i ) {
+                    ssize_t size = ::recv ( events[i].data.fd, buffer, sizeof ( buffer ), 0 );
+                    if ( size > 0 ) ::send ( events[i].data.fd, buffer, size, 0 );
+                }
+            }
+            ::close ( epoll_fd );
+        } );
+    }
+    ~Devices ( ) {
+        this->stopped = true;
+        this->echo.join();
+        for ( size_t i = 0; i < this->clients.size(); ++i ) { delete this->clients[i]; ::close ( this->peers[i] ); }
+    }
+};
+
+static const string REQUEST = "$PQREQ,STATUS,0001*3A\n";
+
+// One blocking thread for each device
+static double run_threads ( Devices& devices, size_t trips ) {
+    timespec start;
+    clock_gettime ( CLOCK_MONOTONIC, &start );
+    std::vector<std::thread> threads;
+    for ( size_t i = 0; i < devices.clients.size(); ++i )
+        threads.push_back ( std::thread ( [&devices, i, trips] {
+            Comm& device = *devices.clients[i];
+            for ( size_t trip = 0; trip < trips; ++trip ) {
+                device.send ( REQUEST );
+                device.readline ( 256 );
+            }
+        } ) );
+    for ( size_t i = 0; i < threads.size(); ++i ) threads[i].join();
+    return elapsed ( start );
+}
+
+// One coroutine for each device, written as the blocking loop
+static coro::Task<> device_loop ( Comm& device, size_t trips ) {
+    for ( size_t trip = 0; trip < trips; ++trip ) {
+        co_await coro::send ( device, REQUEST );
+        co_await coro::readline ( device, 256 );
+    }
+}
+
+static double run_coroutines ( Devices& devices, size_t trips, size_t threads ) {
+    timespec start;
+    clock_gettime ( CLOCK_MONOTONIC, &start );
+    coro::Executor executor ( threads );
+    for ( size_t i = 0; i < devices.clients.size(); ++i ) executor.spawn ( device_loop ( *devices.clients[i], trips ) );
+    executor.wait();
+    return elapsed ( start );
+}
+
+int main ( int argc, char **argv ) {
+    size_t count = argc > 1 ? std::strtoul ( argv[1], NULL, 10 ) : 400;
+    size_t trips = argc > 2 ? std::strtoul ( argv[2], NULL, 10 ) : 100;
+    size_t threads = argc > 3 ? std::strtoul ( argv[3], NULL, 10 ) : 2;
+    Devices devices ( count );
+    std::printf ( "%-12s %10s %14s %10s\n", "driver", "threads", "round trips/s", "seconds" );
+    double seconds = run_threads ( devices, trips );
+    std::printf ( "%-12s %10zu %14.0f %10.3f\n", "blocking", count, count * trips / seconds, seconds );
+    seconds = run_coroutines ( devices, trips, threads );
+    // The executor threads, plus the service thread completing the operations
+    std::printf ( "%-12s %10zu %14.0f %10.3f\n", "coroutines", threads + 1, count * trips / seconds, seconds );
+    return 0;
+}
@@ -0,0 +1,84 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file bench_crc.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Throughput of the CRC models, slice-by-8 and the SSE4.2 instruction against the usual byte at a time table, over
+ *  frames the size of a serial or a network packet.
+ *  Usage: comm_bench_crc [megabytes]
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/crc.h>
+// STD
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+using namespace comm;
+
+// Elapsed seconds since start
+static double elapsed ( const timespec& start ) {
+    timespec now;
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+// Byte at a time reference of the reflected CRC-32, one lookup per byte in a single table
+static uint32_t crc32_bytewise ( const uint32_t *table, const uint8_t *data, size_t size ) {
+    uint32_t crc = 0xFFFFFFFF;
+    for ( size_t i = 0; i < size; ++i ) crc = ( crc >> 8 ) ^ table[( crc ^ data[i] ) & 0xFF];
+    return crc ^ 0xFFFFFFFF;
+}
+
+int main ( int argc, char **argv ) {
+    size_t megabytes = argc > 1 ? std::strtoul ( argv[1], NULL, 10 ) : 256;
+    std::vector<uint8_t> data ( 1 << 20 );
+    std::srand ( 42 );
+    for ( size_t i = 0; i < data.size(); ++i ) data[i] = static_cast<uint8_t> ( std::rand() );
+    uint32_t table[256];
+    for ( uint32_t i = 0; i < 256; ++i ) {
+        uint32_t crc = i;
+        for ( int bit = 0; bit < 8; ++bit ) crc = crc & 1 ? ( crc >> 1 ) ^ 0xEDB88320 : crc >> 1;
+        table[i] = crc;
+    }
+    const char *names[] = { "crc16-ccitt", "crc16-xmodem", "crc16-kermit", "crc16-modbus", "crc32", "crc32c" };
+    size_t frames[] = { 64, 1500, 65536 };
+    std::printf ( "%-14s %-10s %8s %12s\n", "model", "method", "frame", "MB/s" );
+    for ( size_t f = 0; f < sizeof ( frames ) / sizeof ( frames[0] ); ++f ) {
+        size_t frame = frames[f], rounds = ( megabytes << 20 ) / frame;
+        uint32_t sink = 0;
+        // Byte at a time reference
+        timespec start;
+        clock_gettime ( CLOCK_MONOTONIC, &start );
+        for ( size_t r = 0; r < rounds; ++r )
+            sink ^= crc32_bytewise ( table, &data[( r * frame ) % ( data.size() - frame )], frame );
+        std::printf ( "%-14s %-10s %8zu %12.1f\n", "crc32", "bytewise", frame,
+                      rounds * frame / elapsed ( start ) / 1048576.0 );
+        // Every model, in software and in hardware where there is an instruction for it
+        for ( int model = CRC16_CCITT_FALSE; model <= CRC32C; ++model ) {
+            for ( int hardware = 0; hardware < 2; ++hardware ) {
+                Crc crc ( static_cast<CrcModel> ( model ), hardware );
+                if ( hardware && ! crc.hardware() ) continue;
+                clock_gettime ( CLOCK_MONOTONIC, &start );
+                for ( size_t r = 0; r < rounds; ++r )
+                    sink ^= crc.compute ( &data[( r * frame ) % ( data.size() - frame )], frame );
+                std::printf ( "%-14s %-10s %8zu %12.1f\n", names[model], hardware ? "sse4.2" : "slice-by-8", frame,
+                              rounds * frame / elapsed ( start ) / 1048576.0 );
+            }
+        }
+        if ( sink == 0x5A5A5A5A ) std::printf ( "\n" );
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file bench_framer.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Encode and decode throughput of the COBS and SLIP framers against byte by byte reference codecs, on packets of
+ *  random bytes, decoded in chunks the size of a socket read.
+ *  Usage: comm_bench_framer [megabytes]
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/framer.h>
+// STD
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+using namespace comm;
+
+// Elapsed seconds since start
+static double elapsed ( const timespec& start ) {
+    timespec now;
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+// Reference COBS encoder, one byte at a time
+static void cobs_encode_bytewise ( const std::string& packet, std::string& frame ) {
+    size_t code_at = frame.size();
+    uint8_t code = 1;
+    frame.push_back ( 0 );
+    for ( size_t i = 0; i < packet.size(); ++i ) {
+        if ( code == 0xFF ) { frame[code_at] = code; code_at = frame.size(); code = 1; frame.push_back ( 0 ); }
+        if ( packet[i] == 0 ) { frame[code_at] = code; code_at = frame.size(); code = 1; frame.push_back ( 0 ); continue; }
+        frame.push_back ( packet[i] );
+        ++code;
+    }
+    frame[code_at] = code;
+    frame.push_back ( 0 );
+}
+
+// Reference COBS decoder, one byte at a time, return the number of packets
+static size_t cobs_decode_bytewise ( const std::string& stream, std::string& packet ) {
+    size_t packets = 0, left = 0;
+    uint8_t code = 0xFF;
+    for ( size_t i = 0; i < stream.size(); ++i ) {
+        uint8_t byte = stream[i];
+        if ( byte == 0 ) { ++packets; packet.clear(); left = 0; code = 0xFF; continue; }
+        if ( left > 0 ) { packet.push_back ( byte ); --left; continue; }
+        if ( code != 0xFF ) packet.push_back ( 0 );
+        code = byte;
+        left = code - 1;
+    }
+    return packets;
+}
+
+// Reference SLIP encoder, one byte at a time
+static void slip_encode_bytewise ( const std::string& packet, std::string& frame ) {
+    frame.push_back ( Slip::END );
+    for ( size_t i = 0; i < packet.size(); ++i ) {
+        uint8_t byte = packet[i];
+        if ( byte == Slip::END ) { frame.push_back ( Slip::ESC ); frame.push_back ( Slip::ESC_END ); }
+        else if ( byte == Slip::ESC ) { frame.push_back ( Slip::ESC ); frame.push_back ( Slip::ESC_ESC ); }
+        else frame.push_back ( byte );
+    }
+    frame.push_back ( Slip::END );
+}
+
+// Reference SLIP decoder, one byte at a time, return the number of packets
+static size_t slip_decode_bytewise ( const std::string& stream, std::string& packet ) {
+    size_t packets = 0;
+    bool escaped = false;
+    for ( size_t i = 0; i < stream.size(); ++i ) {
+        uint8_t byte = stream[i];
+        if ( escaped ) { packet.push_back ( byte == Slip::ESC_END ? Slip::END : Slip::ESC ); escaped = false; }
+        else if ( byte == Slip::ESC ) escaped = true;
+        else if ( byte == Slip::END ) { if ( ! packet.empty() ) ++packets; packet.clear(); }
+        else packet.push_back ( byte );
+    }
+    return packets;
+}
+
+// Framer decoder, fed in chunks of 64 KiB as the read-ahead buffer would be, return the number of packets
+static size_t decode_framer ( Framer& framer, const std::string& stream, std::string& packet ) {
+    const uint8_t *data = reinterpret_cast<const uint8_t*> ( stream.data() );
+    size_t packets = 0;
+    for ( size_t chunk = 0; chunk < stream.size(); chunk += 65536 ) {
+        size_t size = std::min<size_t> ( 65536, stream.size() - chunk ), used = 0;
+        while ( used < size ) {
+            bool complete;
+            used += framer.decode ( data + chunk + used, size - used, packet, 65536, complete );
+            if ( complete ) { ++packets; packet.clear(); }
+        }
+    }
+    return packets;
+}
+
+// Print a line of results
+static void print ( const char *codec, const char *method, double encode, double decode, size_t bytes, size_t packets ) {
+    std::printf ( "%-6s %-10s %12.1f %12.1f %10zu\n", codec, method, bytes / encode / 1048576.0,
+                  bytes / decode / 1048576.0, packets );
+}
+
+int main ( int argc, char **argv ) {
+    size_t megabytes = argc > 1 ? std::strtoul ( argv[1], NULL, 10 ) : 64;
+    // Packets of random bytes, 64 to 1500 bytes long
+    std::vector<std::string> packets;
+    size_t bytes = 0;
+    std::srand ( 42 );
+    while ( bytes < ( megabytes << 20 ) ) {
+        std::string packet ( 64 + std::rand() % 1437, '\0' );
+        for ( size_t i = 0; i < packet.size(); ++i ) packet[i] = static_cast<char> ( std::rand() );
+        bytes += packet.size();
+        packets.push_back ( packet );
+    }
+    std::printf ( "%-6s %-10s %12s %12s %10s\n", "codec", "method", "enc MB/s", "dec MB/s", "packets" );
+    Cobs cobs;
+    Slip slip;
+    Framer *framers[] = { &cobs, &slip };
+    void (*references[])( const std::string&, std::string& ) = { cobs_encode_bytewise, slip_encode_bytewise };
+    size_t (*decoders[])( const std::string&, std::string& ) = { cobs_decode_bytewise, slip_decode_bytewise };
+    const char *codecs[] = { "cobs", "slip" };
+    for ( size_t c = 0; c < 2; ++c ) {
+        std::string stream, packet;
+        stream.reserve ( bytes + bytes / 4 );
+        packet.reserve ( 65536 );
+        // Byte by byte reference
+        timespec start;
+        clock_gettime ( CLOCK_MONOTONIC, &start );
+        for ( size_t i = 0; i < packets.size(); ++i ) references[c] ( packets[i], stream );
+        double encode = elapsed ( start );
+        clock_gettime ( CLOCK_MONOTONIC, &start );
+        size_t decoded = decoders[c] ( stream, packet );
+        print ( codecs[c], "bytewise", encode, elapsed ( start ), bytes, decoded );
+        // Framer, run scans through the vectorized kernels
+        std::string framed;
+        framed.reserve ( stream.size() );
+        clock_gettime ( CLOCK_MONOTONIC, &start );
+        for ( size_t i = 0; i < packets.size(); ++i )
+            framers[c]->encode ( reinterpret_cast<const uint8_t*> ( packets[i].data() ), packets[i].size(), framed );
+        encode = elapsed ( start );
+        if ( framed != stream ) std::printf ( "%-6s framer output differs from the reference\n", codecs[c] );
+        clock_gettime ( CLOCK_MONOTONIC, &start );
+        decoded = decode_framer ( *framers[c], stream, packet );
+        print ( codecs[c], "framer", encode, elapsed ( start ), bytes, decoded );
+    }
+    return 0;
+}
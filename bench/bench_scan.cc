@@ -0,0 +1,101 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file bench_scan.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Lines per second of the delimiter search kernels against the former byte by byte EOL compare.
+ *  Usage: comm_bench_scan [megabytes]
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/scan.h>
+// STD
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+using namespace comm;
+
+// Elapsed seconds since start
+static double elapsed ( const timespec& start ) {
+    timespec now;
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+// Former readline approach : build a string out of the last eol_len bytes for every byte and compare it with the eol
+static size_t count_bytewise ( const std::vector<uint8_t>& data, const std::string& eol ) {
+    size_t lines = 0, start_of_line = 0;
+    for ( size_t read_so_far = 1; read_so_far <= data.size(); ++read_so_far ) {
+        if ( read_so_far - start_of_line < eol.size() ) continue;
+        if ( std::string ( reinterpret_cast<const char*>(&data[0] + read_so_far - eol.size()), eol.size() ) == eol ) {
+            ++lines;
+            start_of_line = read_so_far;
+        }
+    }
+    return lines;
+}
+
+// Chunk scan : search the whole buffer for the next eol with one of the kernels
+static size_t count_kernel ( const std::vector<uint8_t>& data, const std::string& eol, FindEol find ) {
+    const uint8_t *eol_ = reinterpret_cast<const uint8_t*>(eol.data());
+    size_t lines = 0, start_of_line = 0;
+    while ( start_of_line < data.size() ) {
+        size_t end_of_line = start_of_line + find ( &data[0] + start_of_line, data.size() - start_of_line, eol_, eol.size() );
+        if ( end_of_line == data.size() ) break;
+        ++lines;
+        start_of_line = end_of_line + eol.size();
+    }
+    return lines;
+}
+
+int main ( int argc, char **argv ) {
+    size_t megabytes = argc > 1 ? std::strtoul ( argv[1], NULL, 10 ) : 64;
+    const char *eols[] = { "\n", "\r\n", "\r\n\r\n" };
+    const char *kernels[] = { "scalar", "sse2", "avx2" };
+    std::printf ( "best kernel: %s\n", kernels[scan_kernel()] );
+    std::printf ( "%-8s %-10s %12s %12s %10s\n", "eol", "method", "Mlines/s", "MB/s", "lines" );
+    for ( size_t e = 0; e < sizeof ( eols ) / sizeof ( eols[0] ); ++e ) {
+        std::string eol ( eols[e] );
+        // Telemetry-like lines of printable characters, 16 to 256 bytes long
+        std::vector<uint8_t> data;
+        data.reserve ( megabytes << 20 );
+        std::srand ( 42 );
+        while ( data.size() + 256 + eol.size() < ( megabytes << 20 ) ) {
+            size_t length = 16 + std::rand() % 240;
+            for ( size_t i = 0; i < length; ++i ) data.push_back ( static_cast<uint8_t> ( ' ' + std::rand() % 94 ) );
+            data.insert ( data.end(), eol.begin(), eol.end() );
+        }
+        // Escape the eol for printing
+        std::string name;
+        for ( size_t i = 0; i < eol.size(); ++i ) name += eol[i] == '\r' ? "\\r" : "\\n";
+        // Byte by byte reference
+        timespec start;
+        clock_gettime ( CLOCK_MONOTONIC, &start );
+        size_t lines = count_bytewise ( data, eol );
+        double seconds = elapsed ( start );
+        std::printf ( "%-8s %-10s %12.2f %12.1f %10zu\n", name.c_str(), "bytewise",
+                      lines / seconds * 1e-6, data.size() / seconds / 1048576.0, lines );
+        // Every kernel supported by this CPU
+        for ( int kernel = SCALAR; kernel <= scan_kernel(); ++kernel ) {
+            clock_gettime ( CLOCK_MONOTONIC, &start );
+            lines = count_kernel ( data, eol, find_eol_kernel ( static_cast<ScanKernel> ( kernel ) ) );
+            seconds = elapsed ( start );
+            std::printf ( "%-8s %-10s %12.2f %12.1f %10zu\n", name.c_str(), kernels[kernel],
+                          lines / seconds * 1e-6, data.size() / seconds / 1048576.0, lines );
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,156 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file bench_serial.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Many Serial ports on pseudo terminal loopbacks, each one fed with NMEA sentences paced at the byte time of the
+ *  baudrate by a single pump thread, and read back with readline by one thread per port. Prints the byte rate reached
+ *  against the nominal one and the latency from the time the last byte of a line is due on the line to the return of
+ *  readline. No hardware needed, dozens of ports fit on a CI runner.
+ *  Usage: comm_bench_serial [ports] [baudrate] [seconds]
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/serial.h>
+#include "../test/pty_loopback.h"
+// STD
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace comm;
+using test::monotonic;
+
+// Sentence of the given number, the number stands in the UTC field
+static string sentence ( size_t number ) {
+    char line[128];
+    std::snprintf ( line, sizeof ( line ), "$GPGGA,%09zu,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\r\n",
+                    number );
+    return line;
+}
+
+// A port under test, the device queues sentences and records when their last byte is due
+struct Port {
+    test::PtyLoopback device;
+    Serial serial;
+    size_t capacity, queued;
+    std::unique_ptr<std::atomic<double>[]> due;
+    std::vector<double> latency;
+    size_t bytes;
+    double last;
+    std::atomic<size_t> received;
+    Port ( uint32_t baudrate, size_t capacity ) :
+            device(baudrate), serial(device.path(), baudrate, "\r\n", Timeout ( 0.1, 0.1, 0, 1 )), capacity(capacity),
+            queued(0), due(new std::atomic<double>[capacity]()), bytes(0), last(0), received(0) {
+        this->latency.reserve ( capacity );
+    }
+};
+
+// Percentile of sorted samples
+static double percentile ( const std::vector<double>& sorted, double p ) {
+    if ( sorted.empty() ) return 0;
+    return sorted[std::min ( sorted.size() - 1, static_cast<size_t> ( p * sorted.size() ) )];
+}
+
+int main ( int argc, char **argv ) {
+    size_t count = argc > 1 ? std::strtoul ( argv[1], NULL, 10 ) : 32;
+    uint32_t baudrate = argc > 2 ? std::strtoul ( argv[2], NULL, 10 ) : 115200;
+    double seconds = argc > 3 ? std::strtod ( argv[3], NULL ) : 3;
+    if ( count == 0 || baudrate == 0 || seconds <= 0 ) {
+        std::fprintf ( stderr, "usage: %s [ports] [baudrate] [seconds]\n", argv[0] );
+        return 1;
+    }
+    std::setvbuf ( stdout, NULL, _IOLBF, 0 );
+    size_t size = sentence ( 0 ).size();
+    double nominal = 1.0 / get_bytetime ( baudrate, Settings() );
+    size_t capacity = static_cast<size_t> ( seconds * nominal / size ) + 16;
+    // Ports, the pump starts writing as soon as the sentences are queued
+    std::vector<std::unique_ptr<Port> > ports;
+    std::vector<test::PtyLoopback*> devices;
+    for ( size_t i = 0; i < count; ++i ) {
+        ports.push_back ( std::unique_ptr<Port> ( new Port ( baudrate, capacity ) ) );
+        devices.push_back ( &ports.back()->device );
+    }
+    test::PtyPump pump ( devices );
+    double start = monotonic() + 0.05, end = start + seconds;
+    // Readers, one for each port as a driver would do
+    std::atomic<bool> stopped(false);
+    std::vector<std::thread> readers;
+    for ( size_t i = 0; i < count; ++i )
+        readers.push_back ( std::thread ( [&ports, &stopped, i] {
+            Port& port = *ports[i];
+            string line;
+            while ( ! stopped ) {
+                // A timeout may leave a partial line, even split inside the eol, the rest comes with the next call
+                if ( port.serial.readline ( line, 128 ) == 0 ) continue;
+                double now = monotonic();
+                for ( size_t eol = line.find ( "\r\n" ); eol != string::npos; eol = line.find ( "\r\n" ) ) {
+                    size_t number = std::strtoul ( line.c_str() + 7, NULL, 10 );
+                    size_t bytes = eol + 2;
+                    line.erase ( 0, bytes );
+                    if ( number >= port.capacity ) continue;
+                    // Stored right after queueing, an unpaced line may be read first
+                    double due;
+                    while ( ( due = port.due[number].load ( std::memory_order_acquire ) ) == 0 ) std::this_thread::yield();
+                    port.latency.push_back ( now - due );
+                    port.bytes += bytes;
+                    port.last = now;
+                    port.received.fetch_add ( 1, std::memory_order_relaxed );
+                }
+                if ( line.size() > 128 ) line.clear();
+            }
+        } ) );
+    // Feeder, keeps every line busy with about two sentences queued until the end
+    test::sleep_until ( start );
+    while ( monotonic() < end ) {
+        for ( size_t i = 0; i < count; ++i ) {
+            Port& port = *ports[i];
+            while ( port.queued < port.capacity && port.device.pending() < 2 * size ) {
+                port.due[port.queued].store ( port.device.queue ( sentence ( port.queued ) ), std::memory_order_release );
+                ++port.queued;
+            }
+        }
+        test::sleep_until ( monotonic() + 1e-3 );
+    }
+    // Let the queued sentences reach the readers, those still missing after a second count as lost
+    double drain = monotonic() + 1;
+    for ( size_t i = 0; i < count; ++i )
+        while ( ports[i]->received < ports[i]->queued && monotonic() < drain ) test::sleep_until ( monotonic() + 1e-3 );
+    stopped = true;
+    for ( size_t i = 0; i < readers.size(); ++i ) readers[i].join();
+    // Report
+    std::vector<double> latency;
+    size_t bytes = 0, lines = 0, queued = 0;
+    double elapsed = 0;
+    for ( size_t i = 0; i < count; ++i ) {
+        latency.insert ( latency.end(), ports[i]->latency.begin(), ports[i]->latency.end() );
+        bytes += ports[i]->bytes;
+        queued += ports[i]->queued;
+        elapsed += ports[i]->last > start ? ports[i]->last - start : 0;
+    }
+    lines = latency.size();
+    std::sort ( latency.begin(), latency.end() );
+    std::printf ( "%6s %8s %10s %10s %8s %8s %10s %10s %10s\n", "ports", "baud", "nominal", "B/s/port", "ratio", "lost",
+                  "p50 us", "p99 us", "max us" );
+    // Each port over its own span, from the start to its last line
+    double rate = elapsed > 0 ? bytes / elapsed : 0;
+    std::printf ( "%6zu %8u %10.0f %10.0f %8.3f %8zu %10.1f %10.1f %10.1f\n", count, baudrate, nominal, rate,
+                  rate / nominal, queued - lines, percentile ( latency, 0.5 ) * 1e6, percentile ( latency, 0.99 ) * 1e6,
+                  latency.empty() ? 0 : latency.back() * 1e6 );
+    return 0;
+}
@@ -0,0 +1,158 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file bench_uring.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Lines per second, CPU time per line and kernel entries of the io_uring engine against the epoll reactor, with many
+ *  loopback TCP connections flooded with lines by a feeder thread.
+ *  Usage: comm_bench_uring [connections] [lines per connection]
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/ether.h>
+#include <comm/reactor.h>
+#include <comm/uring.h>
+// SYS
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+// STD
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <time.h>
+
+using namespace comm;
+
+// Elapsed seconds since start
+static double elapsed ( const timespec& start ) {
+    timespec now;
+    clock_gettime ( CLOCK_MONOTONIC, &now );
+    return ( now.tv_sec - start.tv_sec ) + ( now.tv_nsec - start.tv_nsec ) * 1e-9;
+}
+
+// CPU seconds used by the calling thread
+static double cpu_time ( ) {
+    struct rusage usage;
+    getrusage ( RUSAGE_THREAD, &usage );
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + ( usage.ru_utime.tv_usec + usage.ru_stime.tv_usec ) * 1e-6;
+}
+
+// Loopback connections, the clients are driven by the engine, the accepted sockets are written by the feeder
+struct Connections {
+    std::vector<Ether*> clients;
+    std::vector<int> peers;
+    Connections ( size_t count ) {
+        int listener = ::socket ( AF_INET, SOCK_STREAM, 0 );
+        sockaddr_in address = sockaddr_in();
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+        socklen_t length = sizeof ( address );
+        if ( ::bind ( listener, (struct sockaddr *) &address, length ) < 0 || ::listen ( listener, 128 ) < 0 ||
+             ::getsockname ( listener, (struct sockaddr *) &address, &length ) < 0 ) {
+            std::perror ( "listen" );
+            std::exit ( 1 );
+        }
+        for ( size_t i = 0; i < count; ++i ) {
+            this->clients.push_back ( new Ether ( "127.0.0.1", ntohs ( address.sin_port ), "\n" ) );
+            this->peers.push_back ( ::accept ( listener, NULL, NULL ) );
+        }
+        ::close ( listener );
+    }
+    ~Connections ( ) {
+        for ( size_t i = 0; i < this->clients.size(); ++i ) { delete this->clients[i]; ::close ( this->peers[i] ); }
+    }
+};
+
+// Feeder : write the lines to every peer in turn, a batch of lines for each write
+static void feed ( const std::vector<int>& peers, size_t lines ) {
+    std::string batch;
+    for ( size_t i = 0; i < 32; ++i ) batch += "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\n";
+    std::vector<size_t> left ( peers.size(), lines );
+    size_t active = peers.size();
+    while ( active > 0 ) {
+        active = 0;
+        for ( size_t i = 0; i < peers.size(); ++i ) {
+            if ( left[i] == 0 ) continue;
+            size_t count = std::min<size_t> ( left[i], 32 );
+            size_t size = count * ( batch.size() / 32 ), sent = 0;
+            while ( sent < size ) {
+                ssize_t sent_now = ::send ( peers[i], batch.data() + sent, size - sent, 0 );
+                if ( sent_now > 0 ) sent += sent_now;
+            }
+            left[i] -= count;
+            if ( left[i] > 0 ) ++active;
+        }
+    }
+}
+
+// Result of a run
+struct Run { double seconds, cpu; size_t lines, enters; };
+
+// Read every line of every connection with the epoll reactor, readline is called until nothing is left
+static Run run_reactor ( size_t count, size_t lines ) {
+    Connections connections ( count );
+    Reactor reactor;
+    size_t received = 0, enters = 0;
+    std::string line;
+    for ( size_t i = 0; i < count; ++i )
+        reactor.add ( *connections.clients[i], Reactor::READ, [&] ( Comm& comm, uint32_t ) {
+            while ( comm.readline ( line, 256 ) > 0 ) { ++received; line.clear(); } } );
+    timespec start;
+    clock_gettime ( CLOCK_MONOTONIC, &start );
+    double cpu = cpu_time ( );
+    std::thread feeder ( feed, connections.peers, lines );
+    while ( received < count * lines ) { reactor.poll ( 1.0 ); ++enters; }
+    Run result = { elapsed ( start ), cpu_time ( ) - cpu, received, enters };
+    feeder.join();
+    return result;
+}
+
+// Read every line of every connection with the io_uring engine, lines are already buffered when the callback runs
+static Run run_uring ( size_t count, size_t lines, Uring& uring ) {
+    Connections connections ( count );
+    size_t received = 0;
+    std::string line;
+    for ( size_t i = 0; i < count; ++i )
+        uring.add ( *connections.clients[i], [&] ( Comm& comm, int ) {
+            while ( comm.readline ( line, 256 ) > 0 ) { ++received; line.clear(); } } );
+    size_t enters = uring.enters();
+    timespec start;
+    clock_gettime ( CLOCK_MONOTONIC, &start );
+    double cpu = cpu_time ( );
+    std::thread feeder ( feed, connections.peers, lines );
+    while ( received < count * lines ) uring.poll ( 1.0 );
+    Run result = { elapsed ( start ), cpu_time ( ) - cpu, received, uring.enters() - enters };
+    feeder.join();
+    for ( size_t i = 0; i < count; ++i ) uring.remove ( *connections.clients[i] );
+    return result;
+}
+
+// Print a result row
+static void print ( const char *name, const Run& result ) {
+    std::printf ( "%-10s %12.2f %12.3f %12.1f %10zu\n", name, result.lines / result.seconds * 1e-6,
+                  result.cpu / result.lines * 1e9, result.enters * 1000.0 / result.lines, result.lines );
+}
+
+int main ( int argc, char **argv ) {
+    size_t count = argc > 1 ? std::strtoul ( argv[1], NULL, 10 ) : 64;
+    size_t lines = argc > 2 ? std::strtoul ( argv[2], NULL, 10 ) : 20000;
+    std::printf ( "io_uring supported: %s\n", Uring::supported() ? "yes" : "no" );
+    std::printf ( "%-10s %12s %12s %12s %10s\n", "engine", "Mlines/s", "cpu ns/line", "enters/kline", "lines" );
+    print ( "epoll", run_reactor ( count, lines ) );
+    Uring uring;
+    print ( uring.isUring() ? ( uring.isMultishot() ? "uring-ms" : "uring" ) : "fallback", run_uring ( count, lines, uring ) );
+    return 0;
+}
@@ -0,0 +1,161 @@
+/*!
+ * \file comm/async.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the service thread that completes the asynchronous operations of comm::Comm.
+ */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+// COMM
+#include <comm/comm.h>
+// SYS
+#include <sys/epoll.h>
+// STD
+#include <map>
+#include <deque>
+#include <atomic>
+// BOOST
+#include <boost/thread/recursive_mutex.hpp>
+
+
+namespace comm {
+
+
+    using std::size_t;
+
+    /*!
+    * Class that completes the asynchronous operations started by comm::Comm::asyncRead, asyncReadline and asyncSend.
+    *
+    * A service thread waits with epoll on the instances with pending operations and attempts them when they are ready,
+    * with the read and send paths made non blocking for that single attempt: the blocking mode of the instance is left
+    * untouched. Reads and sends of the same instance are completed in the order they were started, each direction on
+    * its own. An instance stays registered after its operations complete, until it is cancelled or destroyed.
+    * Handlers are called from the service thread (or from comm::Comm::cancel), they should not block.
+    */
+    class AsyncService {
+    public:
+
+        /*!
+        * Creates a service and starts its thread
+        *
+        * \throw comm::IOException
+        */
+        AsyncService ( );
+        // Destructor, stops and joins the service thread, pending operations are left uncompleted
+        ~AsyncService ( );
+
+        // INSTANCE : Service shared by every comm::Comm, started on first use
+        static AsyncService& instance ( );
+
+        // READ : Queue a read of size bytes, the handler gets the data read when the deadline expires or the peer closes
+        void read ( Comm& comm, size_t size, const Comm::ReadHandler& handler, double deadline );
+        // READLINE : Queue a read of a line (until eol or size is reached)
+        void readline ( Comm& comm, size_t size, const Comm::ReadHandler& handler, double deadline );
+        // SEND : Queue a send, the handler gets the bytes sent when the deadline expires
+        void send ( Comm& comm, const string& data, const Comm::SendHandler& handler, double deadline );
+        // CANCEL : Complete the pending operations of an instance with a comm::ConnectionException, return their number
+        size_t cancel ( Comm& comm );
+        // PENDING : Number of pending operations of an instance
+        size_t pending ( Comm& comm );
+
+        /*=====================================================================================================================
+         * TRY : Complete an operation at once from the calling thread, without waiting, when no operation of the same
+         * direction is pending. Used by the awaitables of comm/coro.h to skip the suspension.
+         *===================================================================================================================*/
+        // TRY READ : Read size bytes if they are available, nothing is consumed otherwise
+        bool tryRead ( Comm& comm, size_t size, string& data );
+        // TRY READLINE : Read a complete line (until eol or size is reached) if available, nothing is consumed otherwise
+        bool tryReadline ( Comm& comm, size_t size, string& data );
+        // TRY SEND : Send as much as the instance accepts without waiting, return the number of sent char
+        size_t trySend ( Comm& comm, const string& data );
+
+    private:
+        // Disable copy constructors
+        AsyncService(const AsyncService&);
+        AsyncService& operator=(const AsyncService&);
+
+        // Enumeration defines the kind of an operation
+        typedef enum { READ, READLINE, SEND } Kind;
+
+        // Pending operation, data holds what was read so far or the data to send, sent the bytes sent so far
+        struct Operation {
+            Kind kind;
+            size_t size, sent;
+            string data;
+            bool has_deadline;
+            timespec deadline;
+            Comm::ReadHandler read_handler;
+            Comm::SendHandler send_handler;
+        };
+        // Pending operations of an instance, reads and sends are queued on their own
+        struct Pending {
+            std::deque<boost::shared_ptr<Operation> > reads, sends;
+            int fd;  // file descriptor registered with epoll, -1 if not registered yet
+            uint32_t events;  // events the file descriptor is watched for
+            Pending ( ) : fd(-1), events(0) { }
+        };
+
+        // Queue an operation and wake up the service thread
+        void post_ ( Comm& comm, const boost::shared_ptr<Operation>& operation, double deadline );
+        // Service thread : wait for readiness or for the next deadline
+        void run_ ( );
+        // Make progress on the operations of an instance, events are those reported by epoll (0 if none)
+        void progress_ ( Comm& comm, uint32_t events );
+        // Attempt an operation without waiting, return true if it completed
+        bool attempt_ ( Comm& comm, Operation& operation, bool ready );
+        // Complete the operations whose deadline expired, return the seconds to the next deadline (negative if none)
+        double expire_ ( );
+        // Watch an instance for the events of its pending operations, dropping the events no longer needed if shrink
+        void watch_ ( Comm& comm, bool shrink );
+        // Complete every pending operation of an instance with an error and deregister it, return their number
+        size_t fail_ ( Comm& comm, std::exception_ptr error );
+        // Call the handler of an operation, exceptions thrown by the handler are ignored
+        static void complete_ ( Operation& operation, std::exception_ptr error );
+
+        // epoll file descriptor / event file descriptor, used to wake up the service thread
+        int epoll_fd_, event_fd_;
+        // pending operations by instance / instances with operations posted since the last attempt
+        std::map<Comm*, Pending> pending_;
+        std::vector<Comm*> posted_;
+        // mutex, guards the pending operations, held while the service thread attempts them and calls the handlers
+        boost::recursive_mutex mtx_pending;
+        // polling, true while the service thread may be waiting, posts wake it up only then
+        std::atomic<bool> polling_;
+        // stopped, set by the destructor to make the service thread return
+        std::atomic<bool> stopped_;
+        // events, filled by epoll_wait
+        struct epoll_event events_[64];
+        // service thread
+        boost::thread thread_;
+    };
+
+} // namespace comm
+
+#endif  // ASYNC_H
@@ -0,0 +1,372 @@
+/*!
+ * \file comm/basic.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides a compile-time front end to the transports: the transport, the framing and the locking are template
+ * policies, so the read and send paths are resolved at compile time and inlined, without virtual calls. The transport
+ * classes stay what they are and still open, connect and configure the device.
+ */
+
+#ifndef COMM_BASIC_H
+#define COMM_BASIC_H
+
+// COMM
+#include <comm/ether.h>
+#include <comm/serial.h>
+#include <comm/udp.h>
+#include <comm/framer.h>
+// STD
+#include <string>
+#include <utility>
+#include <type_traits>
+#include <stdint.h>
+// BOOST
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/lock_guard.hpp>
+
+
+namespace comm {
+
+
+    using std::size_t;
+    using std::string;
+
+    /*=========================================================================================================================
+     * TRANSPORT : Non blocking calls of each transport, the descriptor is opened and connected by the transport class
+     *=======================================================================================================================*/
+    // Sockets, stream or connected datagram
+    struct SocketIo {
+        static ssize_t read ( int fd, uint8_t *data, size_t size ) { return ::recv ( fd, data, size, MSG_DONTWAIT ); }
+        static ssize_t send ( int fd, const uint8_t *data, size_t size ) { return ::send ( fd, data, size, MSG_DONTWAIT ); }
+    };
+    // Character devices, opened non blocking
+    struct FileIo {
+        static ssize_t read ( int fd, uint8_t *data, size_t size ) { return ::read ( fd, data, size ); }
+        static ssize_t send ( int fd, const uint8_t *data, size_t size ) { return ::write ( fd, data, size ); }
+    };
+    // Calls of each transport class
+    template <class Transport> struct TransportIo;
+    template <> struct TransportIo<Ether> { typedef SocketIo type; };
+    template <> struct TransportIo<Udp> { typedef SocketIo type; };
+    template <> struct TransportIo<Serial> { typedef FileIo type; };
+
+    /*=========================================================================================================================
+     * LOCKING : A mutex for each direction, or none for an instance used by a single thread
+     *=======================================================================================================================*/
+    struct Locked {
+        typedef boost::mutex Mutex;
+    };
+    struct Unlocked {
+        struct Mutex { void lock ( ) { } void unlock ( ) { } };
+    };
+
+    /*=========================================================================================================================
+     * FRAMING : Lines ended by an eol, or the packets of a framer called without virtual dispatch
+     *=======================================================================================================================*/
+    /*!
+    * Framing of lines ended by an end of line sequence, delimited in place.
+    *
+    * \param eol The end of line sequence, not empty
+    */
+    class Lines {
+    public:
+        static const bool in_place = true;
+
+        explicit Lines ( const string& eol="\n" ) : eol_(eol), scanned_(0) {
+            if ( eol.empty() ) throw new invalid_argument ( "Lines : the end of line sequence is empty" );
+        }
+
+        // DELIMIT (data,size,limit,skipped) -> size : Size of the next line, eol included, limit if there is no eol in
+        // the first limit bytes, 0 if the line is not complete yet. The bytes already scanned are not scanned again
+        size_t delimit ( const uint8_t *data, size_t size, size_t limit, size_t& skipped ) {
+            skipped = 0;
+            const uint8_t *eol = reinterpret_cast<const uint8_t*> ( this->eol_.data() );
+            size_t length = this->eol_.size(), available = std::min ( size, limit );
+            if ( available >= length && available > this->scanned_ ) {
+                size_t end = this->scanned_ + find_eol ( data + this->scanned_, available - this->scanned_, eol, length );
+                if ( end != available ) { this->scanned_ = 0; return end + length; }
+                // The tail may hold the first bytes of an eol, it is scanned again
+                this->scanned_ = available - length + 1;
+            }
+            if ( available < limit ) return 0;
+            this->scanned_ = 0;
+            return limit;
+        }
+        // ENCODE (data,count,frame) : Append to frame the buffers and the eol
+        void encode ( const View *data, size_t count, string& frame ) const {
+            for ( size_t i = 0; i < count; ++i ) frame.append ( reinterpret_cast<const char*> ( data[i].data ), data[i].size );
+            frame.append ( this->eol_ );
+        }
+        // DECODE : Not used, lines are delimited in place
+        size_t decode ( const uint8_t*, size_t, string&, size_t, bool& complete ) { complete = false; return 0; }
+        // RESET : Forget the bytes already scanned
+        void reset ( ) { this->scanned_ = 0; }
+        // EOL : The end of line sequence
+        const string& eol ( ) const { return this->eol_; }
+
+    private:
+        // eol, the end of line sequence / scanned, bytes of the pending line with no eol in them
+        string eol_;
+        size_t scanned_;
+    };
+
+    // True for the framers that delimit their frames in place
+    template <class F> struct FramerInPlace { static const bool value = false; };
+    template <> struct FramerInPlace<LengthPrefix> { static const bool value = true; };
+
+    /*!
+    * Framing of the packets of a framer, its functions are called by name, with no virtual dispatch.
+    *
+    * \param framer The framer, copied
+    */
+    template <class F>
+    class Framed {
+    public:
+        static const bool in_place = FramerInPlace<F>::value;
+
+        explicit Framed ( const F& framer=F() ) : framer_(framer) { }
+
+        size_t delimit ( const uint8_t *data, size_t size, size_t limit, size_t& skipped ) {
+            return this->framer_.F::delimit ( data, size, limit, skipped );
+        }
+        void encode ( const View *data, size_t count, string& frame ) const {
+            this->framer_.F::encode ( data, count, frame );
+        }
+        size_t decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete ) {
+            return this->framer_.F::decode ( data, size, packet, limit, complete );
+        }
+        void reset ( ) { this->framer_.F::reset(); }
+        // FRAMER : The framer, for its counters
+        F& framer ( ) { return this->framer_; }
+
+    private:
+        F framer_;
+    };
+
+    /*=========================================================================================================================
+     * BASIC COMM
+     *=======================================================================================================================*/
+    /*!
+    * Compile-time front end to a transport, with the read and send paths inlined for its framing and locking.
+    *
+    * The transport is built from the arguments that follow the framing and does what it does in comm::Comm: it opens,
+    * connects and configures the device, and its timeouts, blocking flags and counters apply. The reads and the sends
+    * go through this instance only, with its own read ahead buffer; calling the transport read functions in between
+    * loses the order of the data. Errors are thrown as in the throwing calls of comm::Comm, there is no latency
+    * profile.
+    *
+    * \param Transport comm::Ether, comm::Serial or comm::Udp
+    *
+    * \param Framing comm::Lines, or comm::Framed of a framer
+    *
+    * \param Locking comm::Locked, or comm::Unlocked for an instance used by a single thread
+    */
+    template <class Transport, class Framing=Lines, class Locking=Locked>
+    class BasicComm {
+    public:
+        typedef typename TransportIo<Transport>::type Io;
+        typedef typename Locking::Mutex Mutex;
+
+        template <typename... Args>
+        explicit BasicComm ( const Framing& framing, Args&&... args ) :
+                transport_(std::forward<Args> ( args )...), framing_(framing) { }
+
+        // TRANSPORT : The transport, to configure it
+        Transport& transport ( ) { return this->transport_; }
+        // FRAMING : The framing
+        Framing& framing ( ) { return this->framing_; }
+
+        // READ (data,size) -> size : Read up to size bytes, buffered bytes first
+        size_t read ( uint8_t *data, size_t size ) {
+            boost::lock_guard<Mutex> lock(this->mtx_read_);
+            // The pending frame loses its head
+            this->framing_.reset();
+            size_t bytes_read = this->rx_.take ( data, size );
+            if ( bytes_read < size ) {
+                this->fill_ ( size - bytes_read );
+                bytes_read += this->rx_.take ( data + bytes_read, size - bytes_read );
+            }
+            return bytes_read;
+        }
+        // PEEK FRAME (size) -> View : Next frame in the read buffer, at most size bytes, empty on timeout. The view is
+        // valid until it is released or the next read
+        View peekFrame ( size_t size ) {
+            static_assert ( Framing::in_place, "BasicComm::peekFrame : the framing does not delimit frames in place" );
+            boost::lock_guard<Mutex> lock(this->mtx_read_);
+            return View ( this->rx_.data(), this->delimit_ ( size ) );
+        }
+        // RELEASE (view) : Consume the buffer up to the end of a view
+        void release ( const View& view ) {
+            boost::lock_guard<Mutex> lock(this->mtx_read_);
+            if ( view.end() < this->rx_.data() || view.end() > this->rx_.data() + this->rx_.size() )
+                throw new invalid_argument ( "BasicComm::release : the view does not point into the read buffer" );
+            this->rx_.consume ( view.end() - this->rx_.data() );
+        }
+        // READ FRAME (packet,size) -> bool : Read the next packet, at most size bytes, false on timeout
+        bool readFrame ( string& packet, size_t size ) {
+            boost::lock_guard<Mutex> lock(this->mtx_read_);
+            return this->readFrame_ ( packet, size, std::integral_constant<bool, Framing::in_place>() );
+        }
+
+        // SEND (data,size) -> size : Send size bytes
+        size_t send ( const uint8_t *data, size_t size ) {
+            boost::lock_guard<Mutex> lock(this->mtx_send_);
+            return this->send_ ( data, size );
+        }
+        size_t send ( const string& data ) {
+            return this->send ( reinterpret_cast<const uint8_t*> ( data.data() ), data.size() );
+        }
+        // SEND FRAME (data,size) -> size : Send the frame of a packet, return the bytes of the frame sent
+        size_t sendFrame ( const uint8_t *data, size_t size ) {
+            boost::lock_guard<Mutex> lock(this->mtx_send_);
+            View packet ( data, size );
+            this->frame_.clear();
+            this->framing_.encode ( &packet, 1, this->frame_ );
+            return this->send_ ( reinterpret_cast<const uint8_t*> ( this->frame_.data() ), this->frame_.size() );
+        }
+        size_t sendFrame ( const string& packet ) {
+            return this->sendFrame ( reinterpret_cast<const uint8_t*> ( packet.data() ), packet.size() );
+        }
+
+    private:
+        // Size of the frame at the head of the buffer, reading the missing bytes, 0 on timeout
+        size_t delimit_ ( size_t size ) {
+            while ( true ) {
+                size_t skipped, length = this->framing_.delimit ( this->rx_.data(), this->rx_.size(), size, skipped );
+                this->rx_.consume ( skipped );
+                if ( length > 0 && length <= this->rx_.size() ) return length;
+                // Once the header is known exactly the missing bytes are read
+                if ( this->fill_ ( length > this->rx_.size() ? length - this->rx_.size() : 1 ) == 0 ) return 0;
+            }
+        }
+        // Frames delimited in place are copied out of the buffer
+        bool readFrame_ ( string& packet, size_t size, std::true_type ) {
+            size_t length = this->delimit_ ( size );
+            if ( length == 0 ) return false;
+            packet.assign ( reinterpret_cast<const char*> ( this->rx_.data() ), length );
+            this->rx_.consume ( length );
+            return true;
+        }
+        // The others are decoded as the bytes come in
+        bool readFrame_ ( string& packet, size_t size, std::false_type ) {
+            bool complete = false;
+            while ( true ) {
+                if ( ! this->rx_.empty() ) {
+                    this->rx_.consume ( this->framing_.decode ( this->rx_.data(), this->rx_.size(), this->packet_,
+                                                                size, complete ) );
+                    if ( complete ) {
+                        packet.swap ( this->packet_ );
+                        this->packet_.clear();
+                        return true;
+                    }
+                }
+                if ( this->fill_ ( 1 ) == 0 ) return false;
+            }
+        }
+        // Read at least least bytes into the buffer (or timeout), as many as there is room for
+        size_t fill_ ( size_t least ) {
+            Comm& comm = this->transport_;
+            if ( ! ( comm.is_open_ && comm.is_connected_ ) )
+                Error ( ERROR_NOT_CONNECTED, "BasicComm::read : not connected" ).raise();
+            this->rx_.prepare ( least );
+            uint8_t *data = this->rx_.tail();
+            size_t size = this->rx_.space();
+            // Pre-fill with the available bytes
+            ssize_t bytes_read_now = Io::read ( comm.fd_, data, size );
+            comm.countRead_ ( bytes_read_now );
+            size_t bytes_read = bytes_read_now > 0 ? bytes_read_now : 0;
+            // Prepare timeout value : now + read + byte*least
+            TimeCheck timeout ( comm.timeout_.read, comm.timeout_.byte, least );
+            while ( bytes_read < least ) {
+                if ( ! comm.read_blocking_ || timeout.expired() ) break;
+                int ready = wait_for ( comm.fd_, POLLIN, timeout );
+                if ( ready == 0 ) continue;
+                if ( ready < 0 ) {
+                    if ( errno == EINTR ) continue;
+                    this->rx_.commit ( bytes_read );
+                    Error ( ERROR_WAIT, "BasicComm::read : wait", errno ).raise();
+                }
+                bytes_read_now = Io::read ( comm.fd_, data + bytes_read, size - bytes_read );
+                comm.countRead_ ( bytes_read_now );
+                if ( bytes_read_now == -1 && ( errno == EINTR || errno == EAGAIN ) ) continue;
+                // At least 1 byte should always be read
+                if ( bytes_read_now < 1 ) {
+                    this->rx_.commit ( bytes_read );
+                    Error ( ERROR_DISCONNECTED,
+                            "BasicComm::read : device reports readiness to read but returned no data, disconnected?",
+                            errno ).raise();
+                }
+                bytes_read += bytes_read_now;
+            }
+            this->rx_.commit ( bytes_read );
+            return bytes_read;
+        }
+        // Send size bytes (or timeout)
+        size_t send_ ( const uint8_t *data, size_t size ) {
+            Comm& comm = this->transport_;
+            if ( ! ( comm.is_open_ && comm.is_connected_ ) )
+                Error ( ERROR_NOT_CONNECTED, "BasicComm::send : not connected" ).raise();
+            ssize_t bytes_sent_now = Io::send ( comm.fd_, data, size );
+            comm.countSend_ ( bytes_sent_now );
+            size_t bytes_sent = bytes_sent_now > 0 ? bytes_sent_now : 0;
+            // Prepare timeout value : now + send + byte*size
+            TimeCheck timeout ( comm.timeout_.send, comm.timeout_.byte, size );
+            while ( bytes_sent < size ) {
+                if ( ! comm.send_blocking_ || timeout.expired() ) break;
+                int ready = wait_for ( comm.fd_, POLLOUT, timeout );
+                if ( ready == 0 ) continue;
+                if ( ready < 0 ) {
+                    if ( errno == EINTR ) continue;
+                    Error ( ERROR_WAIT, "BasicComm::send : wait", errno ).raise();
+                }
+                bytes_sent_now = Io::send ( comm.fd_, data + bytes_sent, size - bytes_sent );
+                comm.countSend_ ( bytes_sent_now );
+                if ( bytes_sent_now == -1 && ( errno == EINTR || errno == EAGAIN ) ) continue;
+                // At least 1 byte should always be sent
+                if ( bytes_sent_now < 1 )
+                    Error ( ERROR_DISCONNECTED,
+                            "BasicComm::send : device reports readiness to receive but returned no data, disconnected?",
+                            errno ).raise();
+                bytes_sent += bytes_sent_now;
+            }
+            return bytes_sent;
+        }
+
+        // transport, opens and configures the device / framing, the framing policy
+        Transport transport_;
+        Framing framing_;
+        // mtx read / mtx send, one for each direction, no-ops for comm::Unlocked
+        Mutex mtx_read_, mtx_send_;
+        // rx, read ahead buffer / packet, the packet being decoded / frame, the frame being sent
+        RxBuffer rx_;
+        string packet_, frame_;
+    };
+
+} // namespace comm
+
+#endif  // COMM_BASIC_H
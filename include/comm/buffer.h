@@ -0,0 +1,249 @@
+/*!
+ * \file comm/buffer.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the read-ahead buffer used by comm::Comm to receive data in large chunks, the send ring drained by its
+ * writer thread and the frame queue filled by its reader thread.
+ */
+
+#ifndef COMM_BUFFER_H
+#define COMM_BUFFER_H
+
+// STD
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+
+
+namespace comm {
+
+
+    using std::vector;
+    using std::size_t;
+    using std::string;
+
+    /*!
+    * Non owning view on a contiguous sequence of bytes, like a line or a frame in the read-ahead buffer.
+    *
+    * A view returned by comm::Comm stays valid until the data is released, or until the next read call.
+    */
+    struct View {
+
+        const uint8_t *data;
+        size_t size;
+
+        View ( ) : data(NULL), size(0) { }
+        View ( const uint8_t *data, size_t size ) : data(data), size(size) { }
+
+        const uint8_t* begin ( ) const { return this->data; }
+        const uint8_t* end ( ) const { return this->data + this->size; }
+        bool empty ( ) const { return this->size == 0; }
+        const uint8_t& operator[] ( size_t index ) const { return this->data[index]; }
+        // STR : Copy the viewed bytes into a string
+        string str ( ) const { return string ( reinterpret_cast<const char*>(this->data), this->size ); }
+    };
+
+    /*!
+    * Read-ahead receive buffer, owned by each comm::Comm instance.
+    *
+    * The transport appends data at the tail in chunks as large as the free space allows, the read methods consume
+    * data from the head. Unread bytes are always kept contiguous (the head is moved back to the start of the storage
+    * when more room is needed), so a line or a frame can be scanned and copied out in a single pass.
+    */
+    class RxBuffer {
+    public:
+        /*!
+        * Creates an empty buffer
+        *
+        * \param capacity Initial capacity in bytes, the buffer grows only when a single read requires more room
+        */
+        explicit RxBuffer ( size_t capacity=4096 );
+
+        // DATA : Pointer to the first unread byte
+        const uint8_t* data ( ) const { return &this->storage_[0] + this->head_; }
+        // SIZE : Number of unread bytes
+        size_t size ( ) const { return this->tail_ - this->head_; }
+        // EMPTY : True if there are no unread bytes
+        bool empty ( ) const { return this->tail_ == this->head_; }
+        // CAPACITY : Total size of the storage
+        size_t capacity ( ) const { return this->storage_.size(); }
+
+        // TAIL : Pointer to the first writable byte, call prepare first to make room
+        uint8_t* tail ( ) { return &this->storage_[0] + this->tail_; }
+        // SPACE : Number of writable bytes after the tail
+        size_t space ( ) const { return this->storage_.size() - this->tail_; }
+        // PREPARE : Make room for at least size bytes after the tail, moving unread data to the front if needed
+        void prepare ( size_t size );
+        // COMMIT : Mark size bytes after the tail as written
+        void commit ( size_t size ) { this->tail_ += size; }
+
+        // CONSUME : Discard size bytes from the head
+        void consume ( size_t size );
+        // TAKE : Copy up to size bytes from the head into data and consume them, return the number of bytes copied
+        size_t take ( uint8_t *data, size_t size );
+
+        // RESERVE : Grow the storage to at least capacity bytes, unread data is preserved
+        void reserve ( size_t capacity );
+        // CLEAR : Discard every unread byte
+        void clear ( ) { this->head_ = this->tail_ = 0; }
+
+    private:
+        // storage, the underlying memory, it never shrinks
+        vector<uint8_t> storage_;
+        // head / tail, offset of the first unread byte and of the first writable byte
+        size_t head_, tail_;
+    };
+
+    /*!
+    * Lock-free single producer, single consumer byte ring, drained by the writer thread of comm::Comm.
+    *
+    * The producer copies whole frames in, the consumer peeks at the queued bytes (one region, or two when they wrap
+    * around the end of the storage) and consumes what it sent. Positions only grow, the capacity is a power of two.
+    */
+    class TxRing {
+    public:
+        /*!
+        * Creates an empty ring
+        *
+        * \param capacity Capacity in bytes, rounded up to a power of two, the storage is allocated once
+        */
+        explicit TxRing ( size_t capacity=65536 );
+
+        // SIZE : Number of queued bytes
+        size_t size ( ) const {
+            // The head first: the tail read after it is never behind it
+            size_t head = this->head_.load ( std::memory_order_acquire );
+            return this->tail_.load ( std::memory_order_acquire ) - head; }
+        // EMPTY : True if there are no queued bytes
+        bool empty ( ) const { return this->size() == 0; }
+        // CAPACITY : Total size of the storage
+        size_t capacity ( ) const { return this->storage_.size(); }
+
+        // PUSH : Producer, copy count buffers in as a whole, return false and copy nothing if they do not fit
+        bool push ( const View *data, size_t count );
+        // PEEK : Consumer, point regions at the queued bytes in order, return the number of regions (0, 1 or 2)
+        size_t peek ( View *regions ) const;
+        // CONSUME : Consumer, release size bytes from the head
+        void consume ( size_t size );
+
+    private:
+        // Disable copy constructors
+        TxRing(const TxRing&);
+        TxRing& operator=(const TxRing&);
+
+        // storage, the underlying memory / mask, capacity - 1 to turn a position into an offset
+        vector<uint8_t> storage_;
+        size_t mask_;
+        // head, consumer position, written by the consumer only
+        std::atomic<size_t> head_;
+        // padding, keeps the producer position on its own cache line
+        char padding_[64];
+        // tail, producer position, written by the producer only
+        std::atomic<size_t> tail_;
+    };
+
+    /*!
+    * Frame received by the reader thread of comm::Comm, a line (or a chunk of a line longer than the maximum frame
+    * size) or a packet decoded by the framer, with the CLOCK_MONOTONIC time of the read that completed it.
+    */
+    struct Frame {
+        string data;
+        timespec stamp;
+    };
+
+    /*!
+    * Lock-free single producer, single consumer queue of preallocated slots, filled by the reader thread of comm::Comm.
+    *
+    * Elements are written and read in place: the producer fills the free slot and pushes it, the consumer reads the
+    * oldest one and pops it. Slots are reused, so elements that own memory (like strings) keep it across uses.
+    */
+    template <typename T>
+    class SpscQueue {
+    public:
+        /*!
+        * Creates an empty queue
+        *
+        * \param capacity Number of slots, rounded up to a power of two, they are allocated once
+        */
+        explicit SpscQueue ( size_t capacity=1024 ) : head_(0), tail_(0) {
+            size_t size = 1;
+            while ( size < capacity ) size <<= 1;
+            this->slots_.resize ( size );
+            this->mask_ = size - 1;
+        }
+
+        // SIZE : Number of queued elements
+        size_t size ( ) const {
+            // The head first: the tail read after it is never behind it
+            size_t head = this->head_.load ( std::memory_order_acquire );
+            return this->tail_.load ( std::memory_order_acquire ) - head; }
+        // EMPTY : True if there are no queued elements
+        bool empty ( ) const { return this->size() == 0; }
+        // CAPACITY : Number of slots
+        size_t capacity ( ) const { return this->slots_.size(); }
+
+        // SLOT : Producer, the free slot to fill in place, null if the queue is full
+        T* slot ( ) {
+            size_t tail = this->tail_.load ( std::memory_order_relaxed );
+            if ( tail - this->head_.load ( std::memory_order_acquire ) == this->capacity() ) return NULL;
+            return &this->slots_[tail & this->mask_];
+        }
+        // PUSH : Producer, publish the slot filled in place
+        void push ( ) { this->tail_.store ( this->tail_.load ( std::memory_order_relaxed ) + 1, std::memory_order_release ); }
+        // FRONT : Consumer, the oldest element, null if the queue is empty
+        T* front ( ) {
+            size_t head = this->head_.load ( std::memory_order_relaxed );
+            if ( this->tail_.load ( std::memory_order_acquire ) == head ) return NULL;
+            return &this->slots_[head & this->mask_];
+        }
+        // POP : Consumer, hand the oldest slot back to the producer
+        void pop ( ) { this->head_.store ( this->head_.load ( std::memory_order_relaxed ) + 1, std::memory_order_release ); }
+
+    private:
+        // Disable copy constructors
+        SpscQueue(const SpscQueue&);
+        SpscQueue& operator=(const SpscQueue&);
+
+        // slots, the preallocated elements / mask, capacity - 1 to turn a position into an index
+        vector<T> slots_;
+        size_t mask_;
+        // head, consumer position, written by the consumer only
+        std::atomic<size_t> head_;
+        // padding, keeps the producer position on its own cache line
+        char padding_[64];
+        // tail, producer position, written by the producer only
+        std::atomic<size_t> tail_;
+    };
+
+} // namespace comm
+
+#endif  // COMM_BUFFER_H
@@ -35,6 +35,20 @@
 
 // COMM
 #include <comm/utils.h>
+#include <comm/buffer.h>
+#include <comm/scan.h>
+#include <comm/histogram.h>
+#include <comm/stats.h>
+#include <comm/result.h>
+#include <comm/framer.h>
+// STD
+#include <new>
+#include <future>
+#include <atomic>
+#include <exception>
+// BOOST
+#include <boost/function.hpp>
+#include <boost/shared_array.hpp>
 
 
 namespace comm {
@@ -50,7 +64,21 @@ namespace comm {
     * Class that provides a portable communication interface.
     */
     class Comm {
+        // The io_uring engine fills the read buffer on its own
+        friend class Uring;
+        // The async service attempts the pending operations with the non blocking read and send paths
+        friend class AsyncService;
+        // The stats registry reads the counters and the labels of every instance
+        friend class StatsRegistry;
+        // The compile-time front end drives the descriptor of its transport with its own read and send paths
+        template <class Transport, class Framing, class Locking> friend class BasicComm;
     public:
+
+        // Read handler, called with the data read and a null exception pointer, or with the exception thrown
+        typedef boost::function<void ( const string& data, std::exception_ptr error )> ReadHandler;
+        // Send handler, called with the number of bytes sent and a null exception pointer, or with the exception thrown
+        typedef boost::function<void ( size_t sent, std::exception_ptr error )> SendHandler;
+
         /*!
         * Creates a Comm object and opens the port if a port is specified,
         * otherwise it remains closed until comm::Comm::open is called.
@@ -72,8 +100,8 @@ namespace comm {
         */
         Comm ( const string &address="", const string& eol="\n", Timeout timeout=Timeout(), Settings settings=Settings() );
 
-        /*! Destructor */
-        ~Comm ();
+        /*! Destructor, pending asynchronous operations are cancelled */
+        virtual ~Comm ();
 
         /*!
         * Opens the comm port as long as the port is set and the port isn't
@@ -104,16 +132,34 @@ namespace comm {
         bool isOpen () const;
         bool isConnected () const;
 
-        /*! Block until there is comm data to read or read_constant
-        * number of milliseconds have elapsed. The return value is true when
-        * the function exits with the port in a readable state, false otherwise
-        * (due to timeout or select interruption). */
+        /*! Sets the blocking mode of the comm port, blocking by default.
+        *
+        * In non blocking mode read and send calls make a single attempt and return at once with whatever was
+        * transferred, readline and readlines return only complete lines and keep a partial line buffered. This is
+        * the mode used by comm::Reactor, which calls them when the port is ready.
+        */
+        void setBlocking ( bool blocking );
+        bool isBlocking () const;
+
+        /*! Gets the file descriptor of the comm port, -1 if the port is closed. */
+        int getFileDescriptor () const;
+
+        /*! Block until there is comm data to read or the connection timeout
+        * has elapsed. The return value is true when the function exits with
+        * the port in a readable state, false otherwise (due to timeout or
+        * interruption). */
         bool waitRead ();
         bool waitSend ();
 
+        /*! Gets the number of bytes already received and buffered, that can be read without waiting. */
+        size_t available ();
+
         /*=====================================================================================================================
          * READ, READLINE and READLINES : Public methods to read a fixed number of characters, a line or an array of lines
          *=====================================================================================================================
+         * The overloads taking std::nothrow never throw on a failure of the resource, they return it in the result with
+         * what was read before it, the others are built on them and throw it. Arguments are still checked by throwing.
+         *---------------------------------------------------------------------------------------------------------------------
          * READ : Read a fixed size of char and parse them into a char array, char vector or string, returns size or string
          *-------------------------------------------------------------------------------------------------------------------*/
         // READ (char*,size) -> size : Threadsafely read a fixed size of char in a char array
@@ -124,6 +170,12 @@ namespace comm {
         size_t read (string &buffer, size_t size);
         // READ (size) -> string : Threadsafely read a fixed size of char in a string
         string read (size_t size);
+        // READ (char*,size,nothrow) -> Result<size> : Read a fixed size of char in a char array, without throwing
+        Result<size_t> read (uint8_t *buffer, size_t size, const std::nothrow_t&);
+        // READ (vector<char>,size,nothrow) -> Result<size> : Read a fixed size of char in a char vector, without throwing
+        Result<size_t> read (vector<uint8_t> &buffer, size_t size, const std::nothrow_t&);
+        // READ (string,size,nothrow) -> Result<size> : Read a fixed size of char in a string, without throwing
+        Result<size_t> read (string &buffer, size_t size, const std::nothrow_t&);
         /*---------------------------------------------------------------------------------------------------------------------
          * READLINE : Read a fixed size of char and parse them into a char array, char vector or string, returns size or string
          *-------------------------------------------------------------------------------------------------------------------*/
@@ -131,16 +183,78 @@ namespace comm {
         size_t readline (string& buffer, size_t size);
         // READLINE (size) -> string : Read a line (until eol or size is reached) into a string, return the string
         string readline ( size_t size );
+        // READLINE (string,size,nothrow) -> Result<size> : Read a line (until eol or size is reached) into string, without
+        // throwing
+        Result<size_t> readline (string& buffer, size_t size, const std::nothrow_t&);
         /*---------------------------------------------------------------------------------------------------------------------
          * READLINES : Read multiple lines at once, emplace them in a vector of strings
          *-------------------------------------------------------------------------------------------------------------------*/
         // READLINES (size) -> vector<string> : Read a vector of strings (to eol) until a fixed size is reached, return the string
         vector<string> readlines ( size_t size );
+        // READLINES (size,nothrow) -> Result<vector<string>> : Read a vector of strings (to eol), without throwing
+        Result<vector<string> > readlines ( size_t size, const std::nothrow_t& );
+        /*---------------------------------------------------------------------------------------------------------------------
+         * PEEK, PEEKLINE and PEEKLINES : Zero-copy reads, return views on the read-ahead buffer without consuming the data.
+         * The views stay valid until release or advance are called, or until the next read call. Peeking again without
+         * releasing returns the same data.
+         *-------------------------------------------------------------------------------------------------------------------*/
+        // PEEK (size) -> View : Buffer a fixed size of char, return a view on it
+        View peek ( size_t size );
+        // PEEKLINE (size) -> View : Buffer a line (until eol or size is reached), return a view on it
+        View peekline ( size_t size );
+        // PEEKLINES (vector<View>,size) -> size : Buffer up to size bytes, replace lines with a view per line, return the size
+        size_t peeklines ( vector<View>& lines, size_t size );
+        // RELEASE (View) : Consume the buffered data up to the end of the view, invalidating every view
+        void release ( const View& view );
+        // ADVANCE (size) : Consume size bytes of buffered data, invalidating every view
+        void advance ( size_t size );
+        /*---------------------------------------------------------------------------------------------------------------------
+         * READFRAME : Read a packet framed by the framer set with setFramer (COBS, SLIP, see comm::Framer) instead of a
+         * line. A frame split across reads is decoded as it arrives, in non blocking mode a partial frame is kept.
+         * Malformed frames and frames longer than size are dropped, the framer counts them. Frames that are carried as
+         * they are (comm::LengthPrefix) are delimited in place: the rest of a frame is read at once when its header
+         * tells its size, readFrame copies it straight out of the read-ahead buffer, peekFrame does not copy it at all.
+         *-------------------------------------------------------------------------------------------------------------------*/
+        // READFRAME (string,size) -> bool : Read the next packet (up to size bytes) into string, replacing its content,
+        // false if no complete frame came in before the timeout
+        bool readFrame ( string& packet, size_t size );
+        // READFRAME (string,size,nothrow) -> Result<bool> : Read the next packet into string, without throwing
+        Result<bool> readFrame ( string& packet, size_t size, const std::nothrow_t& );
+        // PEEKFRAME (size) -> View : Buffer the next frame (up to size bytes), return a view on it, empty on timeout. The
+        // view is released as those of peek, throw std::invalid_argument if the framer does not delimit frames in place
+        View peekFrame ( size_t size );
+        /*---------------------------------------------------------------------------------------------------------------------
+         * READER : Opt-in background reader, a reader thread keeps reading, splits the stream on eol (or decodes it with
+         * the framer, if set) and queues the frames with their CLOCK_MONOTONIC receive time, frames that find the queue
+         * full are dropped. While it runs the frames
+         * should be taken with popFrame (from one thread at a time), read calls would compete for the same data. The
+         * thread follows the instance when it reconnects and returns when the resource closes or fails, the queued
+         * frames can still be popped.
+         *-------------------------------------------------------------------------------------------------------------------*/
+        // START READER (frames,size) : Start the reader thread with a queue of frames, lines longer than size are split,
+        // framed packets longer than size are dropped
+        void startReader ( size_t frames=1024, size_t size=4096 );
+        // STOP READER : Stop the reader thread, the queued frames can still be popped
+        void stopReader ( );
+        // HAS READER : True while the reader thread runs
+        bool hasReader ( ) const;
+        // POP FRAME (frame) -> bool : Take the oldest queued frame, false if there is none, the frame's storage is recycled
+        bool popFrame ( Frame& frame );
+        // POP FRAME (frame,timeout) -> bool : Take the oldest queued frame, waiting up to timeout seconds (negative for as
+        // long as the reader thread runs)
+        bool popFrame ( Frame& frame, double timeout );
+        // GET FRAME DEPTH : Number of queued frames
+        size_t getFrameDepth ( ) const;
+        // GET FRAME DROPS : Number of frames dropped because the queue was full
+        size_t getFrameDrops ( ) const;
 
 
         /*=====================================================================================================================
          * SEND : Public methods to send a frame in string, char array or char vector form
          *=====================================================================================================================
+         * The overloads taking std::nothrow never throw on a failure of the resource, they return it in the result with
+         * what was sent before it, the others are built on them and throw it.
+         *---------------------------------------------------------------------------------------------------------------------
          * SEND : Send a string, char* or vector<char>. return the sent size
          *-------------------------------------------------------------------------------------------------------------------*/
         // SEND (string) -> size : Send a string, returns the number of sent char
@@ -149,6 +263,100 @@ namespace comm {
         size_t send (const std::vector<uint8_t> &data);
         // SEND (char*,size) -> size : Send a char array, returns the number of sent char
         size_t send (const uint8_t *data, size_t size);
+        // SEND (string,nothrow) -> Result<size> : Send a string, without throwing
+        Result<size_t> send (const string& data, const std::nothrow_t&);
+        // SEND (vector<char>,nothrow) -> Result<size> : Send a char vector, without throwing
+        Result<size_t> send (const std::vector<uint8_t> &data, const std::nothrow_t&);
+        // SEND (char*,size,nothrow) -> Result<size> : Send a char array, without throwing
+        Result<size_t> send (const uint8_t *data, size_t size, const std::nothrow_t&);
+        /*---------------------------------------------------------------------------------------------------------------------
+         * SENDV : Send a frame made of several buffers (e.g. header, payload and trailer) with a single vectored write
+         *-------------------------------------------------------------------------------------------------------------------*/
+        // SENDV (vector<View>) -> size : Send a list of buffers in order, returns the number of sent char
+        size_t sendv (const vector<View> &data);
+        // SENDV (View*,count) -> size : Send an array of buffers in order, returns the number of sent char
+        size_t sendv (const View *data, size_t count);
+        // SENDV (vector<View>,nothrow) -> Result<size> : Send a list of buffers in order, without throwing
+        Result<size_t> sendv (const vector<View> &data, const std::nothrow_t&);
+        // SENDV (View*,count,nothrow) -> Result<size> : Send an array of buffers in order, without throwing
+        Result<size_t> sendv (const View *data, size_t count, const std::nothrow_t&);
+        /*---------------------------------------------------------------------------------------------------------------------
+         * SENDFRAME : Encode a packet with the framer set with setFramer and send the frame, as send does
+         *-------------------------------------------------------------------------------------------------------------------*/
+        // SENDFRAME (string) -> size : Send a packet, returns the number of sent char of the frame
+        size_t sendFrame ( const string& packet );
+        // SENDFRAME (char*,size) -> size : Send a packet, returns the number of sent char of the frame
+        size_t sendFrame ( const uint8_t *data, size_t size );
+        // SENDFRAME (vector<View>) -> size : Send a packet made of a list of buffers, returns the number of sent char
+        size_t sendFrame ( const vector<View>& packet );
+        // SENDFRAME (string,nothrow) -> Result<size> : Send a packet, without throwing
+        Result<size_t> sendFrame ( const string& packet, const std::nothrow_t& );
+        // SENDFRAME (char*,size,nothrow) -> Result<size> : Send a packet, without throwing
+        Result<size_t> sendFrame ( const uint8_t *data, size_t size, const std::nothrow_t& );
+        // SENDFRAME (View*,count,nothrow) -> Result<size> : Send a packet made of an array of buffers, without throwing
+        Result<size_t> sendFrame ( const View *data, size_t count, const std::nothrow_t& );
+        /*---------------------------------------------------------------------------------------------------------------------
+         * WRITER : Opt-in background writer, while it runs send and sendv copy the frame into a lock-free ring and return
+         * at once with its size, a writer thread drains the ring to the resource. A frame that does not fit is dropped as
+         * a whole and send returns 0. Asynchronous sends bypass the ring.
+         *-------------------------------------------------------------------------------------------------------------------*/
+        // START WRITER (capacity) : Start the writer thread with a ring of capacity bytes (rounded up to a power of two)
+        void startWriter ( size_t capacity=65536 );
+        // STOP WRITER (drain) : Stop the writer thread, sending the queued data first (until a send times out) if drain
+        void stopWriter ( bool drain=true );
+        // HAS WRITER : True while send calls are queued to the writer thread
+        bool hasWriter ( ) const;
+        // GET QUEUE DEPTH : Number of queued bytes not sent yet
+        size_t getQueueDepth ( ) const;
+        // GET QUEUE DROPS : Number of frames dropped because the ring was full
+        size_t getQueueDrops ( ) const;
+        // GET QUEUE DISCARDED : Number of queued bytes discarded because a send failed or the writer stopped
+        size_t getQueueDiscarded ( ) const;
+
+        /*=====================================================================================================================
+         * LATENCY : Opt-in latency histograms of read, readline, readlines, send and sendv, recorded without locks
+         *=====================================================================================================================
+         * Each call records the wait for its mutex, the waits for the resource to be ready, the time spent in the read and
+         * send syscalls and the whole call, in nanoseconds. readFrame is recorded as readline, sendFrame as send. Calls
+         * queued to the writer thread, the reader thread and the asynchronous operations are not timed.
+         *-------------------------------------------------------------------------------------------------------------------*/
+        // SET LATENCY TRACKING (enable) : Start or stop recording, the histograms are allocated on the first start
+        void setLatencyTracking ( bool enable );
+        // IS LATENCY TRACKING : True while the calls are timed
+        bool isLatencyTracking ( ) const;
+        // GET LATENCY (reset) -> Latency : Snapshot of the histograms, cleared as they are copied if reset
+        Latency getLatency ( bool reset=false );
+        // RESET LATENCY : Clear the histograms
+        void resetLatency ( );
+
+        /*=====================================================================================================================
+         * STATS : I/O counters updated by the read and send paths, always on, see comm::StatsRegistry for all instances
+         *===================================================================================================================*/
+        // STATS -> Stats : Snapshot of the counters, consistent within each direction
+        Stats stats ( ) const;
+
+        /*=====================================================================================================================
+         * ASYNC : Start a read or a send and return at once, the operation is completed later by comm::AsyncService
+         *=====================================================================================================================
+         * The deadline is in seconds from now, negative to wait as long as needed: when it expires the operation completes
+         * with the data transferred so far, as the blocking calls do on timeout. A read also completes early if the peer
+         * closes. Errors are reported through the exception pointer (or the future), they are never thrown by the call.
+         * The blocking mode is left untouched, blocking calls made meanwhile by other threads compete for the same data.
+         *-------------------------------------------------------------------------------------------------------------------*/
+        // ASYNC READ (size,handler,deadline) : Read a fixed size of char, then call the handler
+        void asyncRead ( size_t size, const ReadHandler& handler, double deadline=-1 );
+        // ASYNC READ (size,deadline) -> future<string> : Read a fixed size of char into the future
+        std::future<string> asyncRead ( size_t size, double deadline=-1 );
+        // ASYNC READLINE (size,handler,deadline) : Read a line (until eol or size is reached), then call the handler
+        void asyncReadline ( size_t size, const ReadHandler& handler, double deadline=-1 );
+        // ASYNC READLINE (size,deadline) -> future<string> : Read a line (until eol or size is reached) into the future
+        std::future<string> asyncReadline ( size_t size, double deadline=-1 );
+        // ASYNC SEND (string,handler,deadline) : Send a string (copied by the call), then call the handler
+        void asyncSend ( const string& data, const SendHandler& handler, double deadline=-1 );
+        // ASYNC SEND (string,deadline) -> future<size_t> : Send a string (copied by the call), the future gets the sent size
+        std::future<size_t> asyncSend ( const string& data, double deadline=-1 );
+        // CANCEL : Complete the pending operations with a comm::ConnectionException, return their number
+        size_t cancel ( );
 
         /*=====================================================================================================================
          * GETTERS AND SETTERS : Public methods to set and get Comm parameters
@@ -173,6 +381,12 @@ namespace comm {
         // GET EOL : Get end of the line char for payloads (frames) to be read
         const string& getEOL ( ) const;
         //---------------------------------------------------------------------------------------------------------------------
+        // SET FRAMER : Set the codec of readFrame, sendFrame and the reader thread, null to split lines on eol again. The
+        // frame being decoded is dropped, the framer decodes this stream only and should not be shared
+        void setFramer ( const boost::shared_ptr<Framer>& framer );
+        // GET FRAMER
+        boost::shared_ptr<Framer> getFramer ( ) const;
+        //---------------------------------------------------------------------------------------------------------------------
         // SET TIMEOUT : Set timeout for read and send operations and connection (passing a timeout struct)
         void setTimeout (const Timeout& timeout);
         // SET TIMEOUT : Set timeout for read and send operations and connection (specified read, send and connection timeouts)
@@ -185,19 +399,32 @@ namespace comm {
         void setSettings ( ByteSize bytesize=EIGHT,Parity parity=NOPAR,StopBits stopbits=ONE,FlowControl flowcontrol=NOFLOW );
         // GET SETTINGS
         const Settings& getSettings ( ) const;
+        //---------------------------------------------------------------------------------------------------------------------
+        // SET BUFFER SIZE : Set the capacity of the read-ahead buffer, buffered data is preserved
+        void setBufferSize ( size_t size );
+        // GET BUFFER SIZE : Get the capacity of the read-ahead buffer
+        size_t getBufferSize ( ) const;
 
     protected:
         // Disable copy constructors
         Comm(const Comm&);
         Comm& operator=(const Comm&);
 
+        // SHUTDOWN : Cancel the asynchronous operations and stop the threads that call the virtual functions, to be
+        // called first by the destructor of each transport: by the time ~Comm runs the calls would reach the stubs of
+        // the base class
+        void shutdown_ ( );
+
         /*=====================================================================================================================
          * VIRTUAL : Virtual private methods to be extended
          *===================================================================================================================*/
-        // Read common function ( VIRTUAL )
-        virtual size_t read_ (uint8_t *data, size_t size);
+        // Read common function ( VIRTUAL ) : read at least least bytes (or until timeout), up to size bytes. The read and
+        // send functions do not throw, a failure is recorded with readError_ / sendError_ and ends the call
+        virtual size_t read_ (uint8_t *data, size_t size, size_t least);
         // Send common function ( VIRTUAL )
         virtual size_t send_ (const uint8_t *data, size_t size);
+        // Send vectored common function ( VIRTUAL ) : send count buffers, iov is modified to track partial writes
+        virtual size_t sendv_ (struct iovec *iov, size_t count);
         // Open file descriptor
         virtual void open_ ( );
         // Close connection and file descriptor ( COMMON )
@@ -206,15 +433,82 @@ namespace comm {
         virtual void connect_ ( );
         // Set Options ( SERIAL )
         virtual void setOptions_ ( );
-        // Wait read/send
-        int waitRead_ ( );
-        int waitSend_ ( );
+        // Wait read/send until the deadline of the call : 1 if ready, 0 on timeout or interruption, -1 on a failure,
+        // recorded. The deadline is taken as of its last check
+        int waitRead_ ( const TimeCheck& deadline );
+        int waitSend_ ( const TimeCheck& deadline );
 
         // FLUSH : For the ether socket this does nothing ( SERIAL )
         virtual void flush_ ( );
         virtual void flushInput_ ( );
         virtual void flushOutput_ ( );
 
+        /*=====================================================================================================================
+         * BUFFER : Read-ahead buffer helpers, to be called with mtx_read locked
+         *===================================================================================================================*/
+        // Fill the read-ahead buffer with at least least bytes (or until timeout), return the number of bytes read
+        size_t fill_ ( size_t least );
+        // Read a fixed size of char, serving buffered data first, return the number of bytes read
+        size_t take_ ( uint8_t *data, size_t size );
+        // Append data received by an external engine (comm::Uring) to the read-ahead buffer
+        void feed_ ( const uint8_t *data, size_t size );
+        // Find the length of the next line in the buffer (eol included), reading more data if needed, up to size bytes
+        size_t scanLine_ ( size_t size );
+        // Buffer up to size bytes, stop when a read times out, return the number of bytes buffered, up to size
+        size_t fillUpTo_ ( size_t size );
+        // Buffer up to size bytes, replace lines with a view per line (the last one may lack the eol), return the size
+        size_t splitLines_ ( vector<View>& lines, size_t size );
+        // Decode the buffer into the packet, reading more data if needed, return true once a frame is complete
+        bool scanFrame_ ( size_t size );
+        // Find the length of the next frame at the head of the buffer, reading the rest of it if needed, 0 if it did not
+        // come in, string::npos if the framer does not delimit frames in place
+        size_t delimitFrame_ ( size_t size );
+
+        /*=====================================================================================================================
+         * STATS : Counters helpers, the read ones to be called with mtx_read locked, the send ones with mtx_send locked
+         *===================================================================================================================*/
+        // Count a read syscall (read, recv) by its result: the bytes received, or the failure and its errno
+        void countRead_ ( ssize_t result );
+        // Count a send syscall (write, send, sendmsg) by its result: the bytes sent, or the failure and its errno
+        void countSend_ ( ssize_t result );
+
+        /*=====================================================================================================================
+         * ERRORS : Failures of the read and send paths, recorded instead of thrown and taken by the public call that made
+         * them, the read ones to be called with mtx_read locked, the send ones with mtx_send locked
+         *===================================================================================================================*/
+        // Record and count a failure of the read path, return transferred, the bytes read before it
+        size_t readError_ ( ErrorCode code, const char* where, int number=0, size_t transferred=0 ) {
+            this->read_error_ = Error ( code, where, number );
+            this->read_counters_.add ( Counters::ERRORS );
+            return transferred;
+        }
+        // Record and count a failure of the send path, return transferred, the bytes sent before it
+        size_t sendError_ ( ErrorCode code, const char* where, int number=0, size_t transferred=0 ) {
+            this->send_error_ = Error ( code, where, number );
+            this->send_counters_.add ( Counters::ERRORS );
+            return transferred;
+        }
+        // Take the recorded failure of the read path, clearing it
+        Error takeReadError_ ( ) { Error error = this->read_error_; this->read_error_ = Error(); return error; }
+        // Take the recorded failure of the send path, clearing it
+        Error takeSendError_ ( ) { Error error = this->send_error_; this->send_error_ = Error(); return error; }
+
+        /*=====================================================================================================================
+         * WRITER : Background writer helpers
+         *===================================================================================================================*/
+        // Queue a frame to the writer thread, return false if there is no writer, queued gets the size or 0 if dropped
+        bool queue_ ( const View *data, size_t count, size_t& queued );
+        // Writer thread : drain the ring to the resource until stopped
+        void drain_ ( );
+
+        /*=====================================================================================================================
+         * READER : Background reader helpers
+         *===================================================================================================================*/
+        // Reader thread : read and queue the frames until stopped, or until the resource closes or fails
+        void receive_ ( size_t size );
+        // Queue the complete frames of the read-ahead buffer (and those longer than size), return their number
+        size_t splitFrames_ ( size_t size, const timespec& stamp );
+
         /*---------------------------------------------------------------------------------------------------------------------
          * Protected instance variables
          *-------------------------------------------------------------------------------------------------------------------*/
@@ -225,21 +519,88 @@ namespace comm {
         // end of line, this character indicates the last characters of a sequence
         string eol_;
         size_t eol_len_;  // end of line length, the length of the end of line sequence of characters
+        // framer, codec of the framed packets, null to split lines on eol, set with both mutexes locked / packet, the
+        // packet being decoded, guarded by mtx_read
+        boost::shared_ptr<Framer> framer_;
+        string packet_;
         // is open / is connected, indicates wether or not the resource is open and or connected
         bool is_open_ = false;
         bool is_connected_ = false;
+        // is blocking, false if read and send calls should never wait for the resource to be ready
+        bool is_blocking_ = true;
+        // read / send blocking, the mode followed by the read and send paths, guarded by mtx_read and mtx_send: they are
+        // set with is_blocking_, comm::AsyncService clears one of them for the duration of a single attempt
+        bool read_blocking_ = true, send_blocking_ = true;
+        // is driven, true if the read buffer is filled by an external engine (comm::Uring) instead of read_
+        bool is_driven_ = false;
+        // is async, true once an asynchronous operation was started, the destructor cancels the pending ones
+        std::atomic<bool> is_async_{false};
         // timeout, contains informations about the timeout for reading and sending operation, for single byte and connection
         Timeout timeout_;
         // settings, used by serial communication, describe the low level protocol: bytesize, stopbits, parity, flowcontrol
         Settings settings_;
         // file descriptor, a pointer that describe the virtual file used to interact with the resource
-        int fd_;
+        int fd_ = -1;
         // termios, used by serial communication, contains the options used by the file descriptor to connect
         struct termios termios_;
         // socket addres, used by ether communication, contains the options used by the file descriptor to connect
         struct sockaddr_in sockaddr_in_;
         // mutex, read and send mutex to allow multithreading operations
         boost::mutex mtx_read, mtx_send;
+        // receive buffer, read-ahead data filled by read_ in large chunks and carried over between read calls
+        RxBuffer rx_;
+        // lines, views staged by readlines, kept between calls (guarded by mtx_read) so that they do not allocate
+        vector<View> lines_;
+        // send ring, drained by the writer thread, null if there is none, set and read with boost::atomic_store / load
+        // outside mtx_queue / writer thread
+        boost::shared_ptr<TxRing> tx_;
+        boost::thread writer_;
+        // has writer, checked by send before taking mtx_queue / writer idle, the writer thread waits for data / writer
+        // stop, set to make the writer thread return / writer drain, send the queued data before returning
+        std::atomic<bool> has_writer_{false}, writer_idle_{false}, writer_stop_{false}, writer_drain_{false};
+        // queue drops / queue discarded, frames dropped because the ring was full, bytes discarded by the writer
+        std::atomic<size_t> queue_drops_{0}, queue_discarded_{0};
+        // mutex, serializes the producers of the ring and guards the writer start and stop / mutex and condition, the
+        // writer thread sleeps on them when the ring is empty
+        boost::mutex mtx_queue, mtx_writer;
+        boost::condition_variable cnd_writer;
+        // frame queue, filled by the reader thread, kept after it stops, set and read with boost::atomic_store / load /
+        // reader thread / reader event, wakes it up to stop or to wait on a new descriptor, written under mtx_read /
+        // reader stop, the wake up is a stop
+        boost::shared_ptr<SpscQueue<Frame> > frames_;
+        boost::thread reader_;
+        int reader_event_ = -1;
+        std::atomic<bool> reader_stop_{false};
+        // has reader, the reader thread runs / frames waiting, consumers waiting for a frame
+        std::atomic<bool> has_reader_{false};
+        std::atomic<int> frames_waiting_{0};
+        // frame drops, frames dropped because the queue was full
+        std::atomic<size_t> frame_drops_{0};
+        // mutex, guards the reader start and stop / mutex and condition, consumers wait on them for a frame
+        boost::mutex mtx_reader, mtx_frames;
+        boost::condition_variable cnd_frames;
+        // timing, the public calls record their latency / latency, CALLS x PHASES histograms, allocated on the first
+        // start and kept until destruction, so that a call that saw timing set can always record
+        std::atomic<bool> timing_{false};
+        boost::shared_array<Histogram> latency_;
+        // read / send waited and io, nanoseconds spent in waitRead_ / waitSend_ and in read_ / send_ by the current call,
+        // guarded by mtx_read and mtx_send
+        uint64_t read_waited_ = 0, read_io_ = 0, send_waited_ = 0, send_io_ = 0;
+        // mutex, guards the allocation of the histograms
+        boost::mutex mtx_latency;
+        // read / send counters, written by the read path (with mtx_read locked) and by the send path (with mtx_send
+        // locked), reconnects are counted by open with both locked / was connected, a connection was established once
+        Counters read_counters_, send_counters_;
+        bool was_connected_ = false;
+        // read / send error, failure recorded by the read path (guarded by mtx_read) and by the send path (guarded by
+        // mtx_send), ERROR_NONE if none
+        Error read_error_, send_error_;
+        // mutex, guards the address and port read by the stats registry against the setters
+        boost::mutex mtx_stats;
+
+    private:
+        // Lock guard of a timed public call, records the phases of the call on release
+        class Timed;
     };
 
 } // namespace comm
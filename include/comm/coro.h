@@ -0,0 +1,379 @@
+/*!
+ * \file comm/coro.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides C++20 coroutine tasks, awaitable comm::Comm operations and an executor to run them on a few threads.
+ * The header is usable only by C++20 translation units, the library itself does not depend on it.
+ */
+
+#ifndef CORO_H
+#define CORO_H
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+// COMM
+#include <comm/comm.h>
+#include <comm/async.h>
+// STD
+#include <coroutine>
+#include <optional>
+#include <deque>
+#include <atomic>
+// BOOST
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+
+namespace comm {
+namespace coro {
+
+
+    using std::size_t;
+    using std::string;
+
+    class Executor;
+
+    /*!
+    * Coroutine returning a value of type T, started when awaited (or when spawned on a comm::coro::Executor).
+    * Awaiting a task resumes the caller when the task returns, exceptions are rethrown to the caller.
+    */
+    template <typename T = void>
+    class Task;
+
+    namespace detail {
+
+        // State shared by every task promise
+        struct PromiseBase {
+            // executor the coroutine runs on, inherited by the awaited tasks, null to resume where completions occur
+            Executor* executor = nullptr;
+            // coroutine awaiting this one, resumed when it returns
+            std::coroutine_handle<> continuation;
+            // detached, the coroutine was spawned and destroys itself when it returns
+            bool detached = false;
+            std::exception_ptr error;
+
+            std::suspend_always initial_suspend ( ) noexcept { return {}; }
+            void unhandled_exception ( ) noexcept { this->error = std::current_exception(); }
+
+            // Final awaiter, transfer to the caller or release a detached coroutine
+            struct FinalAwaiter {
+                bool await_ready ( ) noexcept { return false; }
+                template <typename Promise>
+                std::coroutine_handle<> await_suspend ( std::coroutine_handle<Promise> handle ) noexcept;
+                void await_resume ( ) noexcept { }
+            };
+            FinalAwaiter final_suspend ( ) noexcept { return {}; }
+        };
+
+        // Promise of a task returning a value
+        template <typename T>
+        struct Promise : PromiseBase {
+            std::optional<T> value;
+            Task<T> get_return_object ( );
+            template <typename U>
+            void return_value ( U&& value ) { this->value.emplace ( std::forward<U> ( value ) ); }
+            T result ( ) { if ( this->error ) std::rethrow_exception ( this->error ); return std::move ( *this->value ); }
+        };
+
+        // Promise of a task returning nothing
+        template <>
+        struct Promise<void> : PromiseBase {
+            Task<void> get_return_object ( );
+            void return_void ( ) { }
+            void result ( ) { if ( this->error ) std::rethrow_exception ( this->error ); }
+        };
+
+        // Executor of the awaiting coroutine, if its promise has one
+        template <typename Promise>
+        Executor* executor_of ( std::coroutine_handle<Promise> handle ) {
+            if constexpr ( requires { handle.promise().executor; } ) return handle.promise().executor;
+            else return nullptr;
+        }
+
+        // Resume a coroutine on its executor, or at once
+        void resume ( Executor* executor, std::coroutine_handle<> handle );
+
+    } // namespace detail
+
+    template <typename T>
+    class Task {
+    public:
+        typedef detail::Promise<T> promise_type;
+
+        explicit Task ( std::coroutine_handle<promise_type> handle ) : handle_(handle) { }
+        Task ( Task&& other ) noexcept : handle_(std::exchange ( other.handle_, nullptr )) { }
+        Task& operator= ( Task&& other ) noexcept {
+            if ( this != &other ) { if ( this->handle_ ) this->handle_.destroy(); this->handle_ = std::exchange ( other.handle_, nullptr ); }
+            return *this;
+        }
+        ~Task ( ) { if ( this->handle_ ) this->handle_.destroy(); }
+
+        // AWAIT : Start the task on the executor of the caller, resume the caller when it returns
+        bool await_ready ( ) const noexcept { return ! this->handle_ || this->handle_.done(); }
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend ( std::coroutine_handle<Promise> caller ) noexcept {
+            this->handle_.promise().executor = detail::executor_of ( caller );
+            this->handle_.promise().continuation = caller;
+            return this->handle_;
+        }
+        T await_resume ( ) { return this->handle_.promise().result(); }
+
+    private:
+        friend class Executor;
+        // Disable copy constructors
+        Task(const Task&);
+        Task& operator=(const Task&);
+
+        std::coroutine_handle<promise_type> handle_;
+    };
+
+    /*!
+    * Class that resumes coroutines on a fixed set of threads.
+    *
+    * Coroutines awaiting a comm::Comm operation are suspended without blocking any thread: the operation is completed
+    * by comm::AsyncService, then the coroutine is queued here and resumed by the first free thread. An operation that
+    * can complete at once (buffered line, free socket buffer) does so without suspending the coroutine.
+    */
+    class Executor {
+    public:
+        /*!
+        * Creates an executor and starts its threads
+        *
+        * \param threads Number of threads resuming the coroutines
+        */
+        explicit Executor ( size_t threads=1 ) : stopped_(false), active_(0) {
+            for ( size_t i = 0; i < std::max<size_t> ( threads, 1 ); ++i )
+                this->threads_.create_thread ( [this] { this->run_ ( ); } );
+        }
+        // Destructor, waits for the spawned coroutines to return, then stops and joins the threads
+        ~Executor ( ) {
+            this->wait ( );
+            {
+                boost::lock_guard<boost::mutex> lock(this->mtx_queue);
+                this->stopped_ = true;
+            }
+            this->cnd_queue.notify_all();
+            this->threads_.join_all();
+        }
+
+        // SPAWN : Start a coroutine on the executor, it runs detached and releases itself when it returns
+        void spawn ( Task<void> task ) {
+            std::coroutine_handle<Task<void>::promise_type> handle = std::exchange ( task.handle_, nullptr );
+            handle.promise().executor = this;
+            handle.promise().detached = true;
+            ++this->active_;
+            this->post ( handle );
+        }
+        // POST : Queue a suspended coroutine to be resumed by one of the threads
+        void post ( std::coroutine_handle<> handle ) {
+            {
+                boost::lock_guard<boost::mutex> lock(this->mtx_queue);
+                this->queue_.push_back ( handle );
+            }
+            this->cnd_queue.notify_one();
+        }
+        // ACTIVE : Number of spawned coroutines that did not return yet
+        size_t active ( ) const { return this->active_; }
+        // WAIT : Block until every spawned coroutine returned
+        void wait ( ) {
+            boost::unique_lock<boost::mutex> lock(this->mtx_queue);
+            while ( this->active_ > 0 ) this->cnd_done.wait ( lock );
+        }
+
+    private:
+        friend struct detail::PromiseBase;
+        // Disable copy constructors
+        Executor(const Executor&);
+        Executor& operator=(const Executor&);
+
+        // Thread : resume the queued coroutines until stopped
+        void run_ ( ) {
+            while ( true ) {
+                std::coroutine_handle<> handle;
+                {
+                    boost::unique_lock<boost::mutex> lock(this->mtx_queue);
+                    while ( ! this->stopped_ && this->queue_.empty() ) this->cnd_queue.wait ( lock );
+                    if ( this->queue_.empty() ) return;
+                    handle = this->queue_.front();
+                    this->queue_.pop_front();
+                }
+                handle.resume();
+            }
+        }
+        // A spawned coroutine returned
+        void done_ ( ) {
+            boost::lock_guard<boost::mutex> lock(this->mtx_queue);
+            if ( --this->active_ == 0 ) this->cnd_done.notify_all();
+        }
+
+        // queue, coroutines ready to be resumed
+        std::deque<std::coroutine_handle<> > queue_;
+        boost::mutex mtx_queue;
+        boost::condition_variable cnd_queue, cnd_done;
+        bool stopped_;
+        // active, spawned coroutines that did not return yet
+        std::atomic<size_t> active_;
+        boost::thread_group threads_;
+    };
+
+    namespace detail {
+
+        template <typename Promise>
+        std::coroutine_handle<> PromiseBase::FinalAwaiter::await_suspend ( std::coroutine_handle<Promise> handle ) noexcept {
+            PromiseBase& promise = handle.promise();
+            if ( promise.continuation ) return promise.continuation;
+            // A spawned coroutine has nobody to return to, its exception (if any) is dropped with it
+            if ( promise.detached ) {
+                Executor* executor = promise.executor;
+                handle.destroy();
+                if ( executor ) executor->done_();
+            }
+            return std::noop_coroutine();
+        }
+
+        template <typename T>
+        Task<T> Promise<T>::get_return_object ( ) {
+            return Task<T> ( std::coroutine_handle<Promise<T> >::from_promise ( *this ) ); }
+        inline Task<void> Promise<void>::get_return_object ( ) {
+            return Task<void> ( std::coroutine_handle<Promise<void> >::from_promise ( *this ) ); }
+
+        inline void resume ( Executor* executor, std::coroutine_handle<> handle ) {
+            if ( executor ) executor->post ( handle ); else handle.resume();
+        }
+
+        // Awaitable operation, completed at once if it can be, otherwise started when the coroutine suspends and resumed
+        // by the completion handler
+        template <typename T>
+        class Operation {
+        public:
+            T await_resume ( ) {
+                if ( this->error_ ) std::rethrow_exception ( this->error_ );
+                return std::move ( this->result_ );
+            }
+        protected:
+            // Attempt the operation from the calling thread, errors complete it as well
+            template <typename Attempt>
+            bool ready_ ( Attempt attempt ) noexcept {
+                try { return attempt ( ); }
+                catch ( ... ) { this->error_ = std::current_exception(); return true; }
+            }
+            // The handler may run on another thread before start returns, nothing may touch the operation after it
+            template <typename Promise, typename Start>
+            void suspend_ ( std::coroutine_handle<Promise> handle, Start start ) {
+                Executor* executor = executor_of ( handle );
+                start ( [this, executor, handle] ( T result, std::exception_ptr error ) {
+                    this->result_ = std::move ( result );
+                    this->error_ = error;
+                    resume ( executor, handle );
+                } );
+            }
+            T result_{};
+            std::exception_ptr error_;
+        };
+
+    } // namespace detail
+
+    /*=========================================================================================================================
+     * AWAITABLES : co_await a comm::Comm operation, the arguments are those of the asynchronous methods
+     *=======================================================================================================================*/
+    // READ (comm,size,deadline) -> string : Read a fixed size of char
+    class Read : public detail::Operation<string> {
+    public:
+        Read ( Comm& comm, size_t size, double deadline ) : comm_(comm), size_(size), deadline_(deadline) { }
+        bool await_ready ( ) noexcept {
+            return this->ready_ ( [this] { return AsyncService::instance().tryRead ( this->comm_, this->size_, this->result_ ); } );
+        }
+        template <typename Promise>
+        void await_suspend ( std::coroutine_handle<Promise> handle ) {
+            this->suspend_ ( handle, [this] ( auto handler ) {
+                this->comm_.asyncRead ( this->size_, [handler] ( const string& data, std::exception_ptr error ) mutable {
+                    handler ( data, error ); }, this->deadline_ ); } );
+        }
+    private:
+        Comm& comm_;
+        size_t size_;
+        double deadline_;
+    };
+    inline Read read ( Comm& comm, size_t size, double deadline=-1 ) { return Read ( comm, size, deadline ); }
+
+    // READLINE (comm,size,deadline) -> string : Read a line (until eol or size is reached)
+    class Readline : public detail::Operation<string> {
+    public:
+        Readline ( Comm& comm, size_t size, double deadline ) : comm_(comm), size_(size), deadline_(deadline) { }
+        bool await_ready ( ) noexcept {
+            return this->ready_ ( [this] {
+                return AsyncService::instance().tryReadline ( this->comm_, this->size_, this->result_ ); } );
+        }
+        template <typename Promise>
+        void await_suspend ( std::coroutine_handle<Promise> handle ) {
+            this->suspend_ ( handle, [this] ( auto handler ) {
+                this->comm_.asyncReadline ( this->size_, [handler] ( const string& data, std::exception_ptr error ) mutable {
+                    handler ( data, error ); }, this->deadline_ ); } );
+        }
+    private:
+        Comm& comm_;
+        size_t size_;
+        double deadline_;
+    };
+    inline Readline readline ( Comm& comm, size_t size, double deadline=-1 ) { return Readline ( comm, size, deadline ); }
+
+    // SEND (comm,data,deadline) -> size : Send a string, return the number of sent char
+    class Send : public detail::Operation<size_t> {
+    public:
+        Send ( Comm& comm, const string& data, double deadline ) :
+                comm_(comm), data_(data), deadline_(deadline), sent_(0) { }
+        bool await_ready ( ) noexcept {
+            return this->ready_ ( [this] {
+                this->sent_ = AsyncService::instance().trySend ( this->comm_, this->data_ );
+                this->result_ = this->sent_;
+                return this->sent_ == this->data_.size(); } );
+        }
+        // The part sent at once is not sent again, it is added to the sent size
+        template <typename Promise>
+        void await_suspend ( std::coroutine_handle<Promise> handle ) {
+            this->suspend_ ( handle, [this] ( auto handler ) {
+                size_t sent_before = this->sent_;
+                this->comm_.asyncSend ( this->data_.substr ( sent_before ),
+                        [handler, sent_before] ( size_t sent, std::exception_ptr error ) mutable {
+                    handler ( sent_before + sent, error ); }, this->deadline_ ); } );
+        }
+    private:
+        Comm& comm_;
+        string data_;
+        double deadline_;
+        size_t sent_;
+    };
+    inline Send send ( Comm& comm, const string& data, double deadline=-1 ) { return Send ( comm, data, deadline ); }
+
+} // namespace coro
+} // namespace comm
+
+#endif  // __cpp_impl_coroutine
+
+#endif  // CORO_H
@@ -0,0 +1,157 @@
+/*!
+ * \file comm/crc.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the CRC-16 and CRC-32 checksums of the serial and network protocols, with slice-by-8 tables generated
+ * at compile time and the SSE4.2 instruction for CRC-32C, and a framer that appends and checks them as frames stream.
+ */
+
+#ifndef COMM_CRC_H
+#define COMM_CRC_H
+
+// COMM
+#include <comm/framer.h>
+// STD
+#include <vector>
+#include <stdint.h>
+// BOOST
+#include <boost/shared_ptr.hpp>
+
+
+namespace comm {
+
+
+    using std::size_t;
+
+    // Enumeration defines the CRC models, as cataloged by their check value over "123456789":
+    //   CRC16_CCITT_FALSE  poly 0x1021, init 0xFFFF                           check 0x29B1
+    //   CRC16_XMODEM       poly 0x1021, init 0x0000                           check 0x31C3
+    //   CRC16_KERMIT       poly 0x1021, init 0x0000, reflected                check 0x2189
+    //   CRC16_MODBUS       poly 0x8005, init 0xFFFF, reflected                check 0x4B37
+    //   CRC32              poly 0x04C11DB7, init and xorout 0xFFFFFFFF, reflected (Ethernet, zlib)  check 0xCBF43926
+    //   CRC32C             poly 0x1EDC6F41, init and xorout 0xFFFFFFFF, reflected (Castagnoli)      check 0xE3069283
+    typedef enum { CRC16_CCITT_FALSE, CRC16_XMODEM, CRC16_KERMIT, CRC16_MODBUS, CRC32, CRC32C } CrcModel;
+
+    /*!
+    * Cyclic redundancy check of a model, computed in one call or streamed chunk by chunk through a state.
+    *
+    * Models are computed eight bytes at a time with slice-by-8 tables, CRC-32C with the SSE4.2 crc32 instruction when
+    * the CPU has it. On the wire the checksum follows the bit order of its model: reflected models are sent least
+    * significant byte first, the others most significant byte first.
+    *
+    * \param model The CRC model, \see comm::CrcModel
+    *
+    * \param hardware Use the CRC instruction of the CPU when the model and the CPU allow it
+    */
+    class Crc {
+    public:
+        explicit Crc ( CrcModel model=CRC32, bool hardware=true );
+
+        // SIZE : Bytes of the checksum, 2 or 4
+        size_t size ( ) const { return this->width_ / 8; }
+        // HARDWARE : True if the checksum is computed by the CRC instruction of the CPU
+        bool hardware ( ) const;
+        // BEGIN -> state : State of a checksum over no data
+        uint32_t begin ( ) const { return this->init_; }
+        // UPDATE (state,data,size) -> state : Add data to the checksum
+        uint32_t update ( uint32_t state, const uint8_t *data, size_t size ) const {
+            return this->update_ ( this->table_, state, data, size );
+        }
+        // FINISH (state) -> crc : Checksum out of its state
+        uint32_t finish ( uint32_t state ) const;
+        // COMPUTE (data,size) -> crc : Checksum of data
+        uint32_t compute ( const uint8_t *data, size_t size ) const {
+            return this->finish ( this->update ( this->begin(), data, size ) );
+        }
+        // STORE (crc,data) : Write the checksum in size bytes, in its order on the wire
+        void store ( uint32_t crc, uint8_t *data ) const;
+        // LOAD (data) -> crc : Read a checksum written in its order on the wire
+        uint32_t load ( const uint8_t *data ) const;
+
+        // Update function, table is the slice-by-8 table of the model
+        typedef uint32_t (*Update) ( const uint32_t (*table)[256], uint32_t state, const uint8_t *data, size_t size );
+
+    private:
+        // width, bits of the checksum / reflected, the bits of each byte are taken least significant first
+        unsigned width_;
+        bool reflected_;
+        // init / xorout, the state at the start, as kept by the update function, and the mask of the result
+        uint32_t init_, xorout_;
+        // table, slice-by-8 table of the model / update, the function that goes through it
+        const uint32_t (*table_)[256];
+        Update update_;
+    };
+
+    /*!
+    * Framer that protects the packets of another framer with a checksum at their end.
+    *
+    * The checksum is computed while the framer encodes or decodes the packet, as its bytes come in: there is no pass
+    * over the packet after it is complete. Packets with a wrong checksum are dropped and counted. The checksum covers
+    * the packet as the other framer delivers it; with a framer that carries the packet as it is (comm::LengthPrefix)
+    * the packet is the whole frame, so the checksum stays at its end and encode fills the room the packet leaves for
+    * it, otherwise it is appended by encode and removed by decode.
+    *
+    * \param framer The framer of the packets, owned by this one from now on
+    *
+    * \param model The CRC model of the checksum
+    */
+    class Checksum : public Framer {
+    public:
+        Checksum ( const boost::shared_ptr<Framer>& framer, CrcModel model=CRC32 );
+
+        // ENCODE (data,count,frame) : Append to frame the frame of a packet made of count buffers, with its checksum
+        void encode ( const View *data, size_t count, string& frame ) const;
+        using Framer::encode;
+        // DECODE (data,size,packet,limit,complete) -> size : Decode data up to the end of the next packet with a good
+        // checksum, checked as it comes in
+        size_t decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete );
+        // DELIMIT (data,size,limit,skipped) -> size : Size of the next frame with a good checksum in place, checked as it
+        // comes in
+        size_t delimit ( const uint8_t *data, size_t size, size_t limit, size_t& skipped );
+        // IN PLACE : As the framer of the packets
+        bool inPlace ( ) const { return this->framer_->inPlace(); }
+        // RESET : Forget the packet being decoded
+        void reset ( );
+        // DROPPED : Packets dropped by the framer, plus those with a wrong checksum
+        size_t dropped ( ) const { return this->dropped_ + this->framer_->dropped(); }
+        // CRC : The checksum
+        const Crc& crc ( ) const { return this->crc_; }
+
+    private:
+        // framer, the framer of the packets / crc, the checksum
+        boost::shared_ptr<Framer> framer_;
+        Crc crc_;
+        // state, checksum of the bytes checked so far / checked, end of the bytes checked so far, in the packet for
+        // decode, from the start of the frame for delimit
+        uint32_t state_;
+        size_t checked_;
+    };
+
+} // namespace comm
+
+#endif  // COMM_CRC_H
@@ -46,6 +46,41 @@ namespace comm {
     using std::size_t;
     using std::string;
 
+    /*!
+     * Contains the tuning of a TCP socket, applied as it connects. The defaults leave the kernel settings as they are
+     *
+     * \param no_delay Send small segments at once instead of holding them while an ACK is pending (TCP_NODELAY)
+     *
+     * \param quick_ack Acknowledge at once instead of delaying the ACK (TCP_QUICKACK). The kernel goes back to delayed
+     * ACKs by itself, so it is set again after every read that gets data, one more syscall per read
+     *
+     * \param busy_poll Microseconds a read busy polls the device queue before sleeping, 0 for the system default
+     * (SO_BUSY_POLL). Raising it needs CAP_NET_ADMIN
+     *
+     * \param receive_buffer Bytes of the receive buffer, 0 for the kernel autotuning (SO_RCVBUF). The kernel doubles it
+     * for its bookkeeping, it is set before connecting so that the window scale follows it
+     *
+     * \param send_buffer Bytes of the send buffer, 0 for the kernel autotuning (SO_SNDBUF)
+     *
+     * \param priority Priority of the packets sent, -1 for the default (SO_PRIORITY). Above 6 it needs CAP_NET_ADMIN
+     *
+     * \param user_timeout Milliseconds the data sent may stay unacknowledged before the connection is dropped, 0 for
+     * the default (TCP_USER_TIMEOUT)
+     */
+    struct SocketOptions {
+
+        bool no_delay, quick_ack;
+        int busy_poll, receive_buffer, send_buffer, priority;
+        unsigned user_timeout;
+
+        explicit SocketOptions ( bool no_delay=false, bool quick_ack=false, int busy_poll=0, int receive_buffer=0,
+                                 int send_buffer=0, int priority=-1, unsigned user_timeout=0 ) :
+                no_delay(no_delay), quick_ack(quick_ack), busy_poll(busy_poll), receive_buffer(receive_buffer),
+                send_buffer(send_buffer), priority(priority), user_timeout(user_timeout) { }
+        // Small requests and responses: no Nagle delays and no delayed ACKs
+        static SocketOptions lowLatency ( ) { return SocketOptions ( true, true ); }
+    };
+
     /*!
     * Class that provides a portable network socket.
     */
@@ -65,26 +100,45 @@ namespace comm {
         * \param timeout A comm::Timeout struct that defines the timeout
         * conditions for the ether connection. \see comm::Timeout
         *
+        * \param options A comm::SocketOptions struct that defines the tuning of the socket. \see comm::SocketOptions
+        *
         * \throw comm::ConnectionNotOpenedException
         * \throw comm::IOException
         * \throw std::invalid_argument
         */
-        Ether ( const string& address=string(), uint16_t port=0, const string& eol="\r", Timeout timeout=Timeout() );
+        Ether ( const string& address=string(), uint16_t port=0, const string& eol="\r", Timeout timeout=Timeout(),
+                SocketOptions options=SocketOptions() );
         // Destructor
-        ~Ether ( ) = default;
+        ~Ether ( ) { this->shutdown_ ( ); }
+
+        // SET SOCKET OPTIONS : Set the tuning of the socket, applied at once to an open socket. The buffer sizes set on
+        // a connected socket do not change its window scale
+        void setSocketOptions ( const SocketOptions& options );
+        // GET SOCKET OPTIONS : The tuning asked for
+        const SocketOptions& getSocketOptions ( ) const { return this->options_; }
+        // GET APPLIED SOCKET OPTIONS : The tuning of the socket as read back from the kernel when it was last applied,
+        // the options that need privileges the process lacks keep the values of the kernel
+        const SocketOptions& getAppliedSocketOptions ( ) const { return this->applied_; }
 
     private:
 
         // Read common function
-        size_t read_ (uint8_t *data, size_t size);
+        size_t read_ (uint8_t *data, size_t size, size_t least);
         // Send common function
         size_t send_ (const uint8_t *data, size_t size);
+        // Send vectored common function
+        size_t sendv_ (struct iovec *iov, size_t count);
         // Open the file descriptor
         void open_ ();
         // Establish a connection to the server
         void connect_ ();
         // Set socket
         void setOptions_();
+        // Apply the socket options and read them back
+        void applySocketOptions_ ( );
+
+        // options, the tuning asked for / applied, as read back from the kernel
+        SocketOptions options_, applied_;
 
     };
 
@@ -0,0 +1,227 @@
+/*!
+ * \file comm/framer.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the framing codecs comm::Comm can frame packets with instead of splitting lines on the eol: COBS and
+ * SLIP, with streaming decoders and byte-stuffing scans run by the vectorized kernels of comm/scan.h, and a length
+ * prefix that frames can be delimited by in place, for zero-copy reads.
+ */
+
+#ifndef COMM_FRAMER_H
+#define COMM_FRAMER_H
+
+// COMM
+#include <comm/buffer.h>
+// STD
+#include <string>
+#include <stdexcept>
+#include <stdint.h>
+
+
+namespace comm {
+
+
+    using std::invalid_argument;
+    using std::size_t;
+    using std::string;
+
+    /*!
+    * Framing codec, turns a packet into a frame on the wire and frames back into packets.
+    *
+    * Encoding is stateless, decoding streams: a frame may come split across any number of chunks, the framer keeps the
+    * state of the frame being decoded between calls, so a framer decodes a single stream. The decoded bytes are appended
+    * to the packet as they arrive, the caller passes the same packet untouched until the frame is complete. Frames that
+    * are malformed or longer than the limit are dropped, their bytes removed from the packet, and counted.
+    */
+    class Framer {
+    public:
+        virtual ~Framer ( ) { }
+
+        // ENCODE (data,count,frame) : Append to frame the frame of a packet made of count buffers, in order
+        virtual void encode ( const View *data, size_t count, string& frame ) const = 0;
+        // ENCODE (data,size,frame) : Append to frame the frame of a packet
+        void encode ( const uint8_t *data, size_t size, string& frame ) const {
+            View packet ( data, size );
+            this->encode ( &packet, 1, frame );
+        }
+        // DECODE (data,size,packet,limit,complete) -> size : Decode data up to the end of the next frame, appending the
+        // packet bytes, complete is set if a frame ended, return the number of bytes of data consumed
+        virtual size_t decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete ) = 0;
+        // DELIMIT (data,size,limit,skipped) -> size : Zero-copy decode, for framers that carry the packet as it is:
+        // skipped gets the bytes to discard from data first (dropped frames, longer than limit or malformed), the size
+        // of the frame that starts after them is returned once its header is complete (0 before), also when the frame
+        // is not all in data yet. Framers that transform the packet return string::npos. Delimiting and decoding should
+        // not be mixed within a frame
+        virtual size_t delimit ( const uint8_t *, size_t, size_t, size_t& skipped ) {
+            skipped = 0;
+            return string::npos;
+        }
+        // RESET : Forget the frame being decoded
+        virtual void reset ( ) { this->started_ = this->dropping_ = false; }
+        // IN PLACE : True if the frame carries the packet as it is, so that delimit can find it in place
+        virtual bool inPlace ( ) const { return false; }
+        // DROPPED : Number of frames dropped by decode, malformed or longer than the limit
+        virtual size_t dropped ( ) const { return this->dropped_; }
+
+    protected:
+        Framer ( ) : started_(false), dropping_(false), base_(0), dropped_(0) { }
+
+        // Start a frame, its packet bytes are appended after the current end of packet
+        void begin_ ( const string& packet ) { this->started_ = true; this->base_ = packet.size(); }
+        // Append decoded bytes to the packet, drop the frame instead if it grows past limit
+        void append_ ( string& packet, const uint8_t *data, size_t size, size_t limit ) {
+            if ( this->dropping_ ) return;
+            if ( packet.size() - this->base_ + size > limit ) { this->drop_ ( packet ); return; }
+            packet.append ( reinterpret_cast<const char*> ( data ), size );
+        }
+        // Drop the frame, its bytes are removed from the packet and the rest of it is skipped
+        void drop_ ( string& packet ) {
+            if ( this->dropping_ ) return;
+            packet.resize ( this->base_ );
+            this->dropping_ = true;
+            ++this->dropped_;
+        }
+        // End the frame, return true if it holds a packet
+        bool end_ ( ) {
+            bool complete = this->started_ && ! this->dropping_;
+            this->started_ = this->dropping_ = false;
+            return complete;
+        }
+
+        // started, a frame is being decoded / dropping, the frame is skipped up to its end
+        bool started_, dropping_;
+        // base, size of the packet when the frame started
+        size_t base_;
+        // dropped, frames dropped so far
+        size_t dropped_;
+    };
+
+    /*!
+    * Consistent Overhead Byte Stuffing: the packet is split in blocks at its zero bytes, each block is led by a code
+    * byte (its length plus one, 0xFF for a block of 254 bytes with no zero after it), and the frame ends with a zero.
+    * The overhead is one byte every 254 plus the code and the delimiter. An empty frame (a lone zero) is skipped.
+    */
+    class Cobs : public Framer {
+    public:
+        Cobs ( ) : code_(0), left_(0) { }
+
+        // ENCODE (data,count,frame) : Append to frame the frame of a packet made of count buffers, in order
+        void encode ( const View *data, size_t count, string& frame ) const;
+        using Framer::encode;
+        // DECODE (data,size,packet,limit,complete) -> size : Decode data up to the end of the next frame
+        size_t decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete );
+        // RESET : Forget the frame being decoded
+        void reset ( ) { Framer::reset(); this->code_ = 0; this->left_ = 0; }
+
+    private:
+        // code, the code byte of the current block / left, bytes of the current block still to come
+        uint8_t code_;
+        size_t left_;
+    };
+
+    /*!
+    * Serial Line Internet Protocol framing (RFC 1055): the frame ends with END (0xC0), END and ESC (0xDB) bytes of the
+    * packet are sent as ESC ESC_END (0xDC) and ESC ESC_ESC (0xDD). Empty frames are skipped, so an END may also lead
+    * each frame to flush the line noise received before it.
+    */
+    class Slip : public Framer {
+    public:
+        // Special bytes
+        static const uint8_t END = 0xC0, ESC = 0xDB, ESC_END = 0xDC, ESC_ESC = 0xDD;
+
+        // Creates the framer, leading_end sends an END before each frame too
+        explicit Slip ( bool leading_end=true ) : leading_end_(leading_end), escaped_(false) { }
+
+        // ENCODE (data,count,frame) : Append to frame the frame of a packet made of count buffers, in order
+        void encode ( const View *data, size_t count, string& frame ) const;
+        using Framer::encode;
+        // DECODE (data,size,packet,limit,complete) -> size : Decode data up to the end of the next frame
+        size_t decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete );
+        // RESET : Forget the frame being decoded
+        void reset ( ) { Framer::reset(); this->escaped_ = false; }
+
+    private:
+        // leading end, an END is sent before each frame / escaped, the last byte decoded was an ESC
+        bool leading_end_, escaped_;
+    };
+
+    /*!
+    * Length prefix: the frame starts with a header holding its length in a fixed width field, so that the frame is
+    * carried as it is and can be delimited in place in the receive buffer.
+    *
+    * The packet is the whole frame, header included: decode delivers it as it came, encode fills the length field of a
+    * packet that leaves room for its header. The field holds the number of bytes after it, plus adjustment.
+    *
+    * \param width Width of the length field, 1, 2 or 4 bytes
+    *
+    * \param big_endian Byte order of the length field, network order by default
+    *
+    * \param offset Header bytes before the length field (e.g. a message type)
+    *
+    * \param adjustment Added to the length field to get the bytes after it, e.g. minus the header size if the field
+    *                   holds the size of the whole frame, or the size of a trailer it does not count
+    *
+    * \throw std::invalid_argument
+    */
+    class LengthPrefix : public Framer {
+    public:
+        explicit LengthPrefix ( size_t width=2, bool big_endian=true, size_t offset=0, long adjustment=0 );
+
+        // ENCODE (data,count,frame) : Append to frame the packet made of count buffers, in order, with its length field
+        // set, throw std::invalid_argument if the packet is shorter than the header or too long for the field
+        void encode ( const View *data, size_t count, string& frame ) const;
+        using Framer::encode;
+        // DECODE (data,size,packet,limit,complete) -> size : Copy data up to the end of the next frame
+        size_t decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete );
+        // DELIMIT (data,size,limit,skipped) -> size : Size of the next frame in place, 0 if its header is not complete
+        size_t delimit ( const uint8_t *data, size_t size, size_t limit, size_t& skipped );
+        // IN PLACE : The frame is the packet as it is
+        bool inPlace ( ) const { return true; }
+        // RESET : Forget the frame being decoded or skipped
+        void reset ( ) { Framer::reset(); this->sized_ = false; this->left_ = this->skip_ = 0; }
+        // HEADER SIZE : Bytes up to the end of the length field
+        size_t headerSize ( ) const { return this->offset_ + this->width_; }
+
+    private:
+        // Size of the whole frame out of its header, 0 if the length field is shorter than the adjustment takes away
+        size_t frameSize_ ( const uint8_t *header ) const;
+
+        // width, big endian, offset, adjustment, the layout of the header
+        size_t width_;
+        bool big_endian_;
+        size_t offset_;
+        long adjustment_;
+        // sized, the header of the frame being decoded is complete / left, bytes of it still to come / skip, bytes of a
+        // dropped frame still to skip by delimit
+        bool sized_;
+        size_t left_, skip_;
+    };
+
+} // namespace comm
+
+#endif  // COMM_FRAMER_H
@@ -0,0 +1,131 @@
+/*!
+ * \file comm/histogram.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the lock-free latency histograms recorded by comm::Comm for its public read and send calls.
+ */
+
+#ifndef COMM_HISTOGRAM_H
+#define COMM_HISTOGRAM_H
+
+// STD
+#include <vector>
+#include <atomic>
+#include <stdint.h>
+
+
+namespace comm {
+
+
+    using std::vector;
+    using std::size_t;
+
+    /*!
+    * Lock-free histogram of durations in nanoseconds, with HDR-style log-linear buckets.
+    *
+    * Values below 2^SUB_BITS have a bucket each, above that every power of two is split in 2^SUB_BITS buckets, so a
+    * value is known within 1/2^SUB_BITS of itself (about 3%) up to 2^(MAX_EXPONENT+1) nanoseconds (about 36 minutes),
+    * larger values land in the last bucket. Recording is a few relaxed atomic additions, any thread may record while
+    * another one takes a snapshot: a value recorded meanwhile is counted either in the snapshot or after it.
+    */
+    class Histogram {
+    public:
+        // Bits of sub-bucket precision / largest power of two with its own buckets
+        static const unsigned SUB_BITS = 5, MAX_EXPONENT = 40;
+        // Number of buckets
+        static const size_t BUCKETS = ( MAX_EXPONENT - SUB_BITS + 2 ) << SUB_BITS;
+
+        /*!
+        * Copy of the buckets of a histogram, to compute percentiles without racing with the recording threads
+        */
+        struct Snapshot {
+            uint64_t count, sum, max;
+            vector<uint64_t> buckets;
+            Snapshot ( ) : count(0), sum(0), max(0) { }
+            // PERCENTILE (q) -> value : Smallest value not below a fraction q of the recorded ones (0 if none)
+            uint64_t percentile ( double q ) const;
+            // MEAN : Average of the recorded values (0 if none)
+            double mean ( ) const { return this->count > 0 ? static_cast<double> ( this->sum ) / this->count : 0; }
+        };
+
+        // Creates an empty histogram
+        Histogram ( );
+
+        // RECORD : Count a value, lock-free
+        void record ( uint64_t value ) {
+            this->buckets_[index ( value )].fetch_add ( 1, std::memory_order_relaxed );
+            this->sum_.fetch_add ( value, std::memory_order_relaxed );
+            uint64_t max = this->max_.load ( std::memory_order_relaxed );
+            while ( value > max )
+                if ( this->max_.compare_exchange_weak ( max, value, std::memory_order_relaxed ) ) break;
+        }
+        // SNAPSHOT (reset) -> Snapshot : Copy the counts, clearing them as they are copied if reset
+        Snapshot snapshot ( bool reset=false );
+        // RESET : Clear the counts
+        void reset ( );
+
+        // INDEX : Bucket of a value
+        static size_t index ( uint64_t value ) {
+            if ( value < ( 1u << SUB_BITS ) ) return value;
+            unsigned exponent = 63 - __builtin_clzll ( value );
+            if ( exponent > MAX_EXPONENT ) return BUCKETS - 1;
+            // Each power of two gets its own 2^SUB_BITS buckets, the leading bit is implied
+            size_t sub_bucket = ( value >> ( exponent - SUB_BITS ) ) - ( 1u << SUB_BITS );
+            return ( ( exponent - SUB_BITS + 1 ) << SUB_BITS ) + sub_bucket;
+        }
+        // HIGHEST : Largest value counted in a bucket
+        static uint64_t highest ( size_t index );
+
+    private:
+        // Disable copy constructors
+        Histogram(const Histogram&);
+        Histogram& operator=(const Histogram&);
+
+        // buckets, count of the values of each bucket / sum and max of the values
+        std::atomic<uint64_t> buckets_[BUCKETS];
+        std::atomic<uint64_t> sum_, max_;
+    };
+
+    // Enumeration defines the public calls of comm::Comm that are timed, send includes sendv
+    typedef enum { CALL_READ, CALL_READLINE, CALL_READLINES, CALL_SEND, CALLS } Call;
+    // Enumeration defines the phases of a call: the wait for the mutex, the waits for readiness, the time in the read
+    // and send syscalls, and the whole call
+    typedef enum { PHASE_LOCK, PHASE_WAIT, PHASE_IO, PHASE_TOTAL, PHASES } Phase;
+
+    /*!
+    * Latency snapshot of a comm::Comm, a histogram for each phase of each timed call, in nanoseconds
+    */
+    struct Latency {
+        Histogram::Snapshot phases[CALLS][PHASES];
+        // GET (call,phase) -> Snapshot : Histogram of a phase of a call
+        const Histogram::Snapshot& get ( Call call, Phase phase ) const { return this->phases[call][phase]; }
+    };
+
+} // namespace comm
+
+#endif  // COMM_HISTOGRAM_H
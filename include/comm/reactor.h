@@ -0,0 +1,131 @@
+/*!
+ * \file comm/reactor.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides an epoll reactor that drives many comm::Comm instances from a single thread.
+ */
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+// COMM
+#include <comm/comm.h>
+// SYS
+#include <sys/epoll.h>
+// STD
+#include <map>
+#include <atomic>
+// BOOST
+#include <boost/function.hpp>
+
+
+namespace comm {
+
+
+    using std::size_t;
+
+    /*!
+    * Class that waits on the file descriptors of many comm::Comm instances at once and dispatches their readiness.
+    *
+    * Registered instances are switched to non blocking mode, so read, readline and send called from a callback
+    * never wait: readline returns a line only when a complete one is available. Epoll is level triggered, callbacks
+    * should read until nothing is left (readline returns 0), since data already buffered by comm::Comm does not
+    * trigger a new event. Once the peer closes, Reactor::DISCONNECT keeps being reported until the instance is removed.
+    */
+    class Reactor {
+    public:
+
+        // Enumeration defines the events a comm::Comm can be watched for
+        typedef enum { READ = EPOLLIN, SEND = EPOLLOUT, ERROR = EPOLLERR | EPOLLHUP, DISCONNECT = EPOLLRDHUP } Event;
+
+        // Callback, called with the ready comm::Comm and the events that occurred
+        typedef boost::function<void ( Comm& comm, uint32_t events )> Callback;
+
+        /*!
+        * Creates a Reactor with no registered instance
+        *
+        * \throw comm::IOException
+        */
+        Reactor ( );
+        // Destructor, registered instances are left in non blocking mode
+        ~Reactor ( );
+
+        /*!
+        * Registers an open comm::Comm and switches it to non blocking mode.
+        *
+        * \param comm The instance to watch, it must outlive its registration and keep the same file descriptor
+        * (deregister it before closing or reopening it)
+        *
+        * \param events A mask of Reactor::READ and Reactor::SEND, errors and the peer closing (Reactor::DISCONNECT) are
+        * always reported
+        *
+        * \param callback Called from Reactor::poll when any of the events occurs
+        *
+        * \throw comm::IOException
+        */
+        void add ( Comm& comm, uint32_t events, const Callback& callback );
+        // MODIFY : Change the events a registered comm::Comm is watched for
+        void modify ( Comm& comm, uint32_t events );
+        // REMOVE : Deregister a comm::Comm and switch it back to blocking mode
+        void remove ( Comm& comm );
+        // SIZE : Number of registered instances
+        size_t size ( );
+
+        // POLL : Wait for events up to timeout seconds (negative to wait forever), dispatch them, return their number
+        size_t poll ( double timeout=-1 );
+        // RUN : Poll and dispatch until stop is called
+        void run ( );
+        // STOP : Make run return and wake up a pending poll, can be called from any thread
+        void stop ( );
+
+    private:
+        // Disable copy constructors
+        Reactor(const Reactor&);
+        Reactor& operator=(const Reactor&);
+
+        // Registered instance
+        struct Entry {
+            Comm* comm;
+            Callback callback;
+        };
+
+        // epoll file descriptor / event file descriptor, used to wake up a pending poll
+        int epoll_fd_, event_fd_;
+        // stopped, set by stop to make run return
+        std::atomic<bool> stopped_;
+        // entries, registered instances by file descriptor
+        std::map<int, boost::shared_ptr<Entry> > entries_;
+        // mutex, guards the entries
+        boost::mutex mtx_entries;
+        // events, filled by epoll_wait
+        struct epoll_event events_[64];
+    };
+
+} // namespace comm
+
+#endif  // REACTOR_H
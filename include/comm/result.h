@@ -0,0 +1,110 @@
+/*!
+ * \file comm/result.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the error record and the result type returned by the non throwing read and send calls of comm::Comm.
+ */
+
+#ifndef COMM_RESULT_H
+#define COMM_RESULT_H
+
+// STD
+#include <string>
+#include <utility>
+
+
+namespace comm {
+
+
+    using std::string;
+
+    // Enumeration defines the failures of the read and send paths: the resource is not open or connected, it reported
+    // readiness but transferred nothing (the peer closed or hung up), a read or send syscall failed, a wait for
+    // readiness failed. A timeout is not a failure, the call returns what was transferred before it
+    typedef enum { ERROR_NONE = 0, ERROR_NOT_CONNECTED, ERROR_DISCONNECTED, ERROR_SYSCALL, ERROR_WAIT } ErrorCode;
+
+    /*!
+    * Failure of a read or send call, a plain record: recording it allocates nothing and formats nothing.
+    *
+    * \param code What failed, ERROR_NONE if nothing did
+    *
+    * \param number The errno of the failed syscall, 0 if none
+    *
+    * \param where Static description of the failure, as found in the message of the matching exception
+    */
+    struct Error {
+
+        ErrorCode code;
+        int number;
+        const char* where;
+
+        Error ( ) : code(ERROR_NONE), number(0), where("") { }
+        Error ( ErrorCode code, const char* where, int number=0 ) : code(code), number(number), where(where) { }
+        // True if something failed
+        explicit operator bool ( ) const { return this->code != ERROR_NONE; }
+
+        // MESSAGE -> string : Description of the failure, the what of the matching exception
+        string message ( ) const;
+        // RAISE : Throw the exception of the throwing calls, nothing if nothing failed: a comm::ConnectionException if not
+        // connected, a comm::IOException if a wait failed, a comm::InterfaceException otherwise
+        void raise ( ) const;
+    };
+
+    /*!
+    * Result of a non throwing call, the value and the error if the call failed.
+    *
+    * Unlike an expected type the value is always there: a read or send that fails halfway still reports what it
+    * transferred before the failure.
+    */
+    template <typename T>
+    class Result {
+    public:
+        Result ( const T& value=T(), const Error& error=Error() ) : value_(value), error_(error) { }
+        Result ( T&& value, const Error& error ) : value_(std::move ( value )), error_(error) { }
+
+        // OK : True if the call did not fail
+        bool ok ( ) const { return ! this->error_; }
+        explicit operator bool ( ) const { return this->ok(); }
+        // VALUE : What the call transferred, also when it failed
+        const T& value ( ) const { return this->value_; }
+        T& value ( ) { return this->value_; }
+        const T& operator* ( ) const { return this->value_; }
+        T& operator* ( ) { return this->value_; }
+        // ERROR : The failure, ERROR_NONE if the call did not fail
+        const Error& error ( ) const { return this->error_; }
+        // VALUE OR THROW : The value, or the exception of the throwing calls if the call failed
+        T& valueOrThrow ( ) { this->error_.raise(); return this->value_; }
+
+    private:
+        T value_;
+        Error error_;
+    };
+
+} // namespace comm
+
+#endif  // COMM_RESULT_H
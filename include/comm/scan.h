@@ -0,0 +1,91 @@
+/*!
+ * \file comm/scan.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the delimiter search kernels used to split buffered data into lines, and the byte search kernels used
+ * by the framers to find their special bytes.
+ */
+
+#ifndef COMM_SCAN_H
+#define COMM_SCAN_H
+
+// STD
+#include <cstddef>
+#include <stdint.h>
+
+
+namespace comm {
+
+
+    using std::size_t;
+
+    // Enumeration defines the available delimiter search kernels, from the slowest to the fastest
+    typedef enum { SCALAR = 0, SSE2 = 1, AVX2 = 2 } ScanKernel;
+
+    // Delimiter search function, return the offset of the first occurrence of eol in data, or size if not found
+    typedef size_t (*FindEol) ( const uint8_t *data, size_t size, const uint8_t *eol, size_t eol_len );
+
+    // Best kernel supported by the running CPU, detected once at runtime
+    ScanKernel scan_kernel ( );
+
+    // Implementation of a specific kernel, falls back to the best supported one if the CPU lacks it
+    FindEol find_eol_kernel ( ScanKernel kernel );
+
+    /*!
+     * Find the first occurrence of a one or multi-byte delimiter in a chunk of data, using the best kernel available.
+     *
+     * \param data Pointer to the data to scan
+     * \param size Number of bytes to scan
+     * \param eol Pointer to the delimiter
+     * \param eol_len Length of the delimiter, an empty delimiter is never found
+     *
+     * \return The offset of the first byte of the delimiter, or size if the delimiter is not found
+     */
+    size_t find_eol ( const uint8_t *data, size_t size, const uint8_t *eol, size_t eol_len );
+
+    // Byte search function, return the offset of the first byte equal to first or second in data, or size if none
+    typedef size_t (*FindAny) ( const uint8_t *data, size_t size, uint8_t first, uint8_t second );
+
+    // Implementation of a specific kernel, falls back to the best supported one if the CPU lacks it
+    FindAny find_any_kernel ( ScanKernel kernel );
+
+    /*!
+     * Find the first byte equal to either of two values in a chunk of data, using the best kernel available.
+     *
+     * \param data Pointer to the data to scan
+     * \param size Number of bytes to scan
+     * \param first First value searched for
+     * \param second Second value searched for, the same as first to search a single value
+     *
+     * \return The offset of the first matching byte, or size if no byte matches
+     */
+    size_t find_any ( const uint8_t *data, size_t size, uint8_t first, uint8_t second );
+
+} // namespace comm
+
+#endif  // COMM_SCAN_H
@@ -46,6 +46,20 @@ namespace comm {
     using std::size_t;
     using std::string;
 
+    /*!
+    * Round trip times measured by comm::Serial::selfTest, with the latency settings they were measured with
+    */
+    struct RoundTrip {
+        // probes, sent / answered, answered in full within the read timeout
+        size_t probes, answered;
+        // low latency, the driver flag as read back from the driver / frame size, the VMIN in use
+        bool low_latency;
+        uint8_t frame_size;
+        // rtt, round trip times of the answered probes in nanoseconds, from the send call to the end of the reply
+        Histogram::Snapshot rtt;
+        RoundTrip ( ) : probes(0), answered(0), low_latency(false), frame_size(0) { }
+    };
+
     /*!
     * Class that provides a portable serial port interface.
     */
@@ -60,7 +74,8 @@ namespace comm {
         *                which would be something like 'COM1' on Windows and '/dev/ttyS0'
         *                on Linux.
         *
-        * \param baudrate An unsigned 32-bit integer that represents the baudrate
+        * \param baudrate An unsigned 32-bit integer that represents the baudrate, rates with no Bxxxx constant
+        *                 (250000, 3600000, 12000000...) are set through termios2 where the driver takes them
         *
         * \param eol End of line character or sequence of characters
         * 
@@ -76,14 +91,37 @@ namespace comm {
         Serial ( const string &address="", uint32_t baudrate=9600, const string& eol="\n",
                  Timeout timeout=Timeout(), Settings settings=Settings() );
         // Destructor
-        ~Serial ( ) = default;
+        ~Serial ( ) { this->shutdown_ ( ); }
+
+        // GET ACTUAL BAUDRATE : Baudrate applied by the driver, which may round the one asked for, as of the last
+        // connection. \see comm::Comm::getBaudrate
+        uint32_t getActualBaudrate ( ) const { return this->actual_baudrate_; }
+        // IS LOW LATENCY : True if the driver hands over every received byte at once, as read back from the driver, false
+        // where the driver has no such setting. \see comm::Settings
+        bool isLowLatency ( ) const { return this->low_latency_; }
+
+        /*!
+        * Measure the round trip time of the port as configured: send a probe, read the reply, count times. The device
+        * must answer each probe with reply bytes, an echo or a loopback plug answers with the probe itself.
+        *
+        * \param probe The bytes sent, not empty
+        *
+        * \param reply Size of the reply, 0 for the size of the probe
+        *
+        * \param count Number of probes, each one waits for the reply or for the read timeout
+        *
+        * \return The round trip times, \see comm::RoundTrip
+        */
+        RoundTrip selfTest ( const string& probe, size_t reply=0, size_t count=100 );
 
     private:
 
         // Read common function
-        size_t read_ (uint8_t *data, size_t size);
+        size_t read_ (uint8_t *data, size_t size, size_t least);
         // Send common function
         size_t send_ (const uint8_t *data, size_t size);
+        // Send vectored common function
+        size_t sendv_ (struct iovec *iov, size_t count);
         // Open the file descriptor
         void open_ ( );
         // Ensure connection with the device
@@ -95,6 +133,10 @@ namespace comm {
         void flushInput_ ( );
         void flushOutput_ ( );
 
+        // low latency, the driver flag as of the last setOptions_ / actual baudrate, the rate applied by the driver
+        bool low_latency_ = false;
+        uint32_t actual_baudrate_ = 0;
+
     };
 
 } // namespace comm
@@ -0,0 +1,162 @@
+/*!
+ * \file comm/stats.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides the I/O counters of comm::Comm, read through a sequence lock, and the registry that exposes the
+ * counters of every live instance in the Prometheus text format.
+ */
+
+#ifndef COMM_STATS_H
+#define COMM_STATS_H
+
+// STD
+#include <map>
+#include <string>
+#include <atomic>
+#include <stdint.h>
+// BOOST
+#include <boost/thread/mutex.hpp>
+
+
+namespace comm {
+
+
+    using std::size_t;
+    using std::string;
+
+    class Comm;
+
+    /*!
+    * Snapshot of the I/O counters of a comm::Comm, counted since it was created
+    */
+    struct Stats {
+        // bytes in / out, received and sent by the read and send syscalls
+        uint64_t bytes_in, bytes_out;
+        // syscalls, reads, sends and waits for readiness issued / eagain and eintr, those that failed and were retried
+        uint64_t syscalls, eagain, eintr;
+        // wait timeouts, waits for readiness that timed out
+        uint64_t wait_timeouts;
+        // partial reads / sends, read_ and send_ calls that returned less than asked (timeout, non blocking or closed)
+        uint64_t partial_reads, partial_sends;
+        // reconnects, connections established after the first one / errors, failures of the read and send paths, thrown
+        // or returned
+        uint64_t reconnects, errors;
+        Stats ( ) : bytes_in(0), bytes_out(0), syscalls(0), eagain(0), eintr(0), wait_timeouts(0), partial_reads(0),
+                    partial_sends(0), reconnects(0), errors(0) { }
+    };
+
+    /*!
+    * Counters written by a single thread at a time and read by any thread through a sequence lock.
+    *
+    * comm::Comm keeps a set for the read path and one for the send path, written with mtx_read and mtx_send locked:
+    * the writer bumps the sequence around each update with relaxed atomics, a reader copies the counters and retries
+    * if the sequence was odd or changed meanwhile, so a snapshot never shows half an update.
+    */
+    class Counters {
+    public:
+        // Enumeration defines the counters, in the order of the fields of comm::Stats
+        typedef enum { BYTES_IN, BYTES_OUT, SYSCALLS, EAGAINS, EINTRS, WAIT_TIMEOUTS, PARTIAL_READS, PARTIAL_SENDS,
+                       RECONNECTS, ERRORS, COUNT } Counter;
+
+        // Creates the counters, all zero
+        Counters ( ) : sequence_(0) { for ( size_t i = 0; i < COUNT; ++i ) this->values_[i] = 0; }
+
+        // ADD (counter,delta) : Writer, add to a counter
+        void add ( Counter counter, uint64_t delta=1 ) {
+            uint64_t sequence = this->begin_ ( );
+            this->add_ ( counter, delta );
+            this->sequence_.store ( sequence + 2, std::memory_order_release );
+        }
+        // ADD (counter,delta,other,other_delta) : Writer, add to two counters as a single update
+        void add ( Counter counter, uint64_t delta, Counter other, uint64_t other_delta ) {
+            uint64_t sequence = this->begin_ ( );
+            this->add_ ( counter, delta );
+            this->add_ ( other, other_delta );
+            this->sequence_.store ( sequence + 2, std::memory_order_release );
+        }
+        // LOAD (values) : Reader, add a consistent copy of the counters to values (COUNT elements)
+        void load ( uint64_t *values ) const;
+
+    private:
+        // Disable copy constructors
+        Counters(const Counters&);
+        Counters& operator=(const Counters&);
+
+        // Make the sequence odd for the update, return its previous value
+        uint64_t begin_ ( ) {
+            uint64_t sequence = this->sequence_.load ( std::memory_order_relaxed );
+            this->sequence_.store ( sequence + 1, std::memory_order_relaxed );
+            std::atomic_thread_fence ( std::memory_order_release );
+            return sequence;
+        }
+        // Single writer, a plain load and store is enough
+        void add_ ( Counter counter, uint64_t delta ) {
+            this->values_[counter].store ( this->values_[counter].load ( std::memory_order_relaxed ) + delta,
+                                           std::memory_order_relaxed );
+        }
+
+        // sequence, odd while an update is in progress / values, the counters
+        std::atomic<uint64_t> sequence_;
+        std::atomic<uint64_t> values_[COUNT];
+    };
+
+    /*!
+    * Process-wide registry of the live comm::Comm instances, they add themselves when created and remove themselves
+    * when destroyed. It dumps their counters in the Prometheus text exposition format, to be served by a scrape
+    * endpoint of the application.
+    */
+    class StatsRegistry {
+    public:
+        // INSTANCE : The registry, never destroyed so that instances outliving static destruction can still leave it
+        static StatsRegistry& instance ( );
+
+        // ADD : Register an instance, it gets the next id
+        void add ( Comm& comm );
+        // REMOVE : Deregister an instance
+        void remove ( Comm& comm );
+        // SIZE : Number of live instances
+        size_t size ( );
+        // PROMETHEUS -> string : Counters of every live instance, labelled with their id, address and port
+        string prometheus ( );
+
+    private:
+        StatsRegistry ( ) : next_id_(0) { }
+        // Disable copy constructors
+        StatsRegistry(const StatsRegistry&);
+        StatsRegistry& operator=(const StatsRegistry&);
+
+        // instances, with their id / next id
+        std::map<Comm*, uint64_t> instances_;
+        uint64_t next_id_;
+        // mutex, guards the instances, held while dumping so that none is destroyed meanwhile
+        boost::mutex mtx_instances;
+    };
+
+} // namespace comm
+
+#endif  // COMM_STATS_H
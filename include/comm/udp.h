@@ -0,0 +1,163 @@
+/*!
+ * \file comm/udp.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides an interface for exchanging UDP datagrams, one by one or in batches.
+ */
+
+#ifndef UDP_H
+#define UDP_H
+
+// COMM
+#include <comm/comm.h>
+
+
+namespace comm {
+
+
+    using std::invalid_argument;
+    using std::numeric_limits;
+    using std::vector;
+    using std::size_t;
+    using std::string;
+
+    /*!
+    * Preallocated set of datagrams, filled by comm::Udp::readBatch with a single recvmmsg call.
+    * Receiving into an existing batch allocates nothing.
+    */
+    class DatagramBatch {
+    public:
+        /*!
+        * Creates a batch able to hold count datagrams of up to mtu bytes each
+        *
+        * \param count Maximum number of datagrams received by a single call
+        *
+        * \param mtu Maximum size of a datagram, longer datagrams are truncated
+        */
+        explicit DatagramBatch ( size_t count=64, size_t mtu=2048 );
+
+        // SIZE : Number of datagrams received by the last call
+        size_t size ( ) const { return this->size_; }
+        // CAPACITY : Maximum number of datagrams received by a single call
+        size_t capacity ( ) const { return this->headers_.size(); }
+        // MTU : Maximum size of a datagram
+        size_t mtu ( ) const { return this->mtu_; }
+        // DATAGRAM : View on the payload of the i-th datagram received
+        View operator[] ( size_t index ) const {
+            return View ( &this->storage_[index * this->mtu_], this->headers_[index].msg_len ); }
+        // TRUNCATED : True if the i-th datagram was longer than the mtu
+        bool truncated ( size_t index ) const { return this->headers_[index].msg_hdr.msg_flags & MSG_TRUNC; }
+        // SOURCE : Address of the sender of the i-th datagram
+        const sockaddr_in& source ( size_t index ) const { return this->sources_[index]; }
+
+    private:
+        friend class Udp;
+        // Reset the headers before a new receive call
+        void reset_ ( );
+
+        // storage, count slots of mtu bytes each
+        vector<uint8_t> storage_;
+        // recvmmsg headers, one iovec and one source address for each slot
+        vector<struct mmsghdr> headers_;
+        vector<struct iovec> iov_;
+        vector<sockaddr_in> sources_;
+        // mtu, size of each slot / size, number of datagrams received
+        size_t mtu_, size_;
+    };
+
+    /*!
+    * Class that provides a portable UDP socket, datagram boundaries are preserved by the batch methods. The read
+    * methods take each datagram whole: the read-ahead buffer grows to hold it, a read straight into a buffer too small
+    * for it fails with EMSGSIZE and leaves it queued.
+    */
+    class Udp : public Comm {
+    public:
+
+        /*!
+        * Creates a Udp object and opens the socket if a remote address and port, or a local port, are specified,
+        * otherwise it remains closed until comm::Udp::open is called.
+        *
+        * \param address A std::string containing the IPv4 address of the remote peer, datagrams are sent to it and
+        *                only its datagrams are received
+        *
+        * \param port An unsigned 16-bit integer that represents the remote port
+        *
+        * \param local_port An unsigned 16-bit integer that represents the local port to bind, 0 to let the system pick
+        *
+        * \param eol A char containing the end of line character for packets payloads (frames)
+        *
+        * \param timeout A comm::Timeout struct that defines the timeout
+        * conditions for the socket. \see comm::Timeout
+        *
+        * \throw comm::ConnectionNotOpenedException
+        * \throw comm::IOException
+        * \throw std::invalid_argument
+        */
+        Udp ( const string& address=string(), uint16_t port=0, uint16_t local_port=0,
+              const string& eol="\r", Timeout timeout=Timeout() );
+        // Destructor
+        ~Udp ( ) { this->shutdown_ ( ); }
+
+        /*=====================================================================================================================
+         * BATCH : Receive or send many datagrams with a single syscall
+         *===================================================================================================================*/
+        // READ BATCH (batch) -> count : Wait for datagrams (or timeout) and receive as many as the batch holds
+        size_t readBatch ( DatagramBatch& batch );
+        // SEND BATCH (vector<View>) -> count : Send each view as a datagram, return the number of datagrams sent
+        size_t sendBatch ( const vector<View>& datagrams );
+        // SEND BATCH (View*,count) -> count : Send each view as a datagram, return the number of datagrams sent
+        size_t sendBatch ( const View* datagrams, size_t count );
+
+        // GET LOCAL PORT : Port the socket is bound to, 0 if not bound yet
+        uint16_t getLocalPort ( ) const;
+
+    private:
+
+        // Read common function, each datagram is appended to the data
+        size_t read_ (uint8_t *data, size_t size, size_t least);
+        // Send common function, data is sent as a single datagram
+        size_t send_ (const uint8_t *data, size_t size);
+        // Send vectored common function, the buffers are sent as a single datagram
+        size_t sendv_ (struct iovec *iov, size_t count);
+        // Open the file descriptor
+        void open_ ();
+        // Bind the local port and set the remote peer
+        void connect_ ();
+        // Set socket
+        void setOptions_();
+
+        // local port, the port to bind to receive datagrams
+        uint16_t local_port_;
+        // sendmmsg headers, reused by every sendBatch call
+        vector<struct mmsghdr> send_headers_;
+        vector<struct iovec> send_iov_;
+    };
+
+} // namespace comm
+
+#endif  // UDP_H
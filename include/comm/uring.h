@@ -0,0 +1,205 @@
+/*!
+ * \file comm/uring.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides an io_uring I/O engine that drives the reads and writes of many comm::Comm instances.
+ */
+
+#ifndef URING_H
+#define URING_H
+
+// COMM
+#include <comm/comm.h>
+#include <comm/reactor.h>
+// STD
+#include <map>
+#include <deque>
+#include <atomic>
+// BOOST
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+
+
+namespace comm {
+
+
+    using std::size_t;
+
+    /*!
+    * Class that submits the reads and writes of many comm::Comm instances to an io_uring and dispatches their
+    * completions from a single thread.
+    *
+    * Received data is appended to the read buffer of the instance, then the read callback is called: readline,
+    * readlines and peekline return the buffered lines without any syscall. Sockets are received with a multishot
+    * recv into a group of provided buffers, other file descriptors (serial ports) with a read into a registered
+    * buffer; sends are copied into registered buffers and written in order. When the kernel lacks multishot recv or
+    * buffer registration the plain operations are used.
+    *
+    * When io_uring is not available at all (old kernel, seccomp filter, built without <linux/io_uring.h>) the engine
+    * falls back to a comm::Reactor and the existing read_ and send_ path, with the same interface and callbacks.
+    *
+    * Except for stop, the methods are not thread safe and should be called from the thread running poll.
+    */
+    class Uring {
+    public:
+
+        // Read callback, called with the instance and the bytes received (0 if the peer closed, -errno on error)
+        typedef boost::function<void ( Comm& comm, int result )> ReadCallback;
+        // Send callback, called with the instance and the bytes sent by a single send call (-errno on error)
+        typedef boost::function<void ( Comm& comm, int result )> SendCallback;
+
+        /*!
+        * Creates the engine, falling back to epoll if io_uring is not available
+        *
+        * \param entries Size of the submission queue
+        *
+        * \param buffer_size Size of each registered and provided buffer
+        *
+        * \param buffers Number of buffers shared by all the instances for sending, and number of provided buffers
+        * for receiving from sockets
+        *
+        * \throw comm::IOException
+        */
+        explicit Uring ( unsigned entries=256, size_t buffer_size=4096, size_t buffers=256 );
+        // Destructor, registered instances are deregistered and switched back to blocking mode
+        ~Uring ( );
+
+        // SUPPORTED : True if io_uring can be used by this process, probed once
+        static bool supported ( );
+        // IS URING : True if the engine runs on io_uring, false if it fell back to epoll
+        bool isUring ( ) const;
+        // IS MULTISHOT : True if sockets are received with a multishot recv
+        bool isMultishot ( ) const;
+        // IS REGISTERED : True if the buffers are registered with the kernel
+        bool isRegistered ( ) const;
+        // ENTERS : Number of io_uring_enter (or epoll_wait) calls made so far
+        size_t enters ( ) const;
+
+        /*!
+        * Registers an open comm::Comm, switches it to non blocking mode and starts receiving
+        *
+        * \param comm The instance to drive, it must outlive its registration and keep the same file descriptor
+        *
+        * \param callback Called from poll after data was appended to the read buffer of the instance
+        *
+        * \throw comm::IOException
+        */
+        void add ( Comm& comm, const ReadCallback& callback );
+        // REMOVE : Stop receiving and deregister a comm::Comm, pending sends and undispatched data are dropped
+        void remove ( Comm& comm );
+
+        /*!
+        * Queues data to be sent to a registered comm::Comm, sends to the same instance are written in order
+        *
+        * \return False if there are not enough free buffers to copy the data, nothing is queued in that case
+        */
+        bool send ( Comm& comm, const uint8_t *data, size_t size, const SendCallback& callback=SendCallback() );
+        bool send ( Comm& comm, const string& data, const SendCallback& callback=SendCallback() );
+
+        // POLL : Submit, wait for completions up to timeout seconds (negative to wait forever), dispatch them
+        size_t poll ( double timeout=-1 );
+        // RUN : Poll and dispatch until stop is called
+        void run ( );
+        // STOP : Make run return and wake up a pending poll, can be called from any thread
+        void stop ( );
+
+    private:
+        // Disable copy constructors
+        Uring(const Uring&);
+        Uring& operator=(const Uring&);
+
+        // Chunk of data queued for sending, stored in a buffer of the pool
+        struct Chunk {
+            size_t buffer, size, sent;
+            SendCallback callback;  // set on the last chunk of a send call
+            size_t total;  // size of the send call, reported to the callback
+        };
+        // Registered instance
+        struct Entry {
+            uint64_t id;
+            Comm* comm;
+            int fd;
+            bool socket;  // received with recv, otherwise with read
+            bool receiving;  // a receive operation is armed
+            bool writing;  // the front chunk is being written
+            size_t buffer;  // buffer used to read from non socket descriptors
+            ReadCallback callback;
+            std::deque<Chunk> chunks;
+        };
+        typedef std::map<uint64_t, boost::shared_ptr<Entry> > Entries;
+
+        // RING : io_uring helpers, defined only when io_uring is available
+        void setup_ ( unsigned entries );
+        void teardown_ ( );
+        void* sqe_ ( );
+        int enter_ ( unsigned submit, unsigned wait, double timeout );
+        size_t reap_ ( );
+        void complete_ ( uint64_t user_data, int result, uint32_t flags );
+        void provide_ ( size_t buffer );
+        void arm_ ( Entry& entry );
+        void write_ ( Entry& entry );
+        // FALLBACK : Send the queued chunks with the existing send path
+        void flush_ ( Entry& entry );
+        // Buffer address
+        uint8_t* bufferAt_ ( size_t index ) { return &this->buffers_[index * this->buffer_size_]; }
+        uint8_t* providedAt_ ( size_t index ) { return &this->provided_[index * this->buffer_size_]; }
+        // Entry lookup
+        boost::shared_ptr<Entry> find_ ( Comm& comm );
+
+        // ring file descriptor, -1 if running on the epoll fallback
+        int ring_fd_;
+        // ring memory, mapped from the kernel
+        void *sq_ring_, *cq_ring_, *sqes_;
+        size_t sq_ring_size_, cq_ring_size_, sqes_size_;
+        // ring pointers
+        unsigned *sq_head_, *sq_tail_, *sq_mask_, *sq_array_, *cq_head_, *cq_tail_, *cq_mask_;
+        void *cqes_;
+        unsigned sq_entries_, to_submit_, features_;
+        // kernel capabilities
+        bool multishot_, registered_, provide_buffers_;
+        // event file descriptor, read by the ring (or watched by the reactor) to wake up a pending poll
+        int event_fd_;
+        uint64_t event_counter_;
+        // fallback reactor, used when io_uring is not available
+        boost::scoped_ptr<Reactor> reactor_;
+        // buffer pools, registered buffers for sends and serial reads, provided buffers for socket receives
+        size_t buffer_size_;
+        vector<uint8_t> buffers_, provided_;
+        vector<size_t> free_buffers_;
+        // entries, registered instances by id and by instance
+        Entries entries_;
+        std::map<Comm*, uint64_t> ids_;
+        uint64_t next_id_;
+        // statistics / stopped, set by stop to make run return
+        size_t enters_;
+        std::atomic<bool> stopped_;
+    };
+
+} // namespace comm
+
+#endif  // URING_H
@@ -54,6 +54,8 @@
 #include <sys/param.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+#include <poll.h>
 // BOOST
 #include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
@@ -93,6 +95,10 @@ namespace comm {
     typedef enum { ONE = 1, TWO = 2, HALFONE = 3 } StopBits;
     // Enumeration defines the possible flowcontrol types for the serial port.
     typedef enum { NOFLOW = 0, SOFTWARE = 1, HARDWARE = 2 } FlowControl;
+    // Enumeration defines the latency profiles of the serial port driver: DEFAULT_LATENCY leaves the driver as it is,
+    // LOW_LATENCY asks it to hand over every received byte at once (ASYNC_LOW_LATENCY, a 1 ms latency timer on the USB
+    // adapters that support it) at the cost of more wakeups
+    typedef enum { DEFAULT_LATENCY = 0, LOW_LATENCY = 1 } LatencyProfile;
 
     timeval to_timeval ( double data );
 
@@ -119,12 +125,34 @@ namespace comm {
         struct timespec now, timeout;
 
         explicit TimeCheck ( timeval timeout, timeval byte, size_t size ) { clock_gettime( CLOCK_MONOTONIC, & ( this->now ) );
-            this->timeout.tv_sec = timeout.tv_sec + byte.tv_sec * size * 2 + this->now.tv_sec;
-            this->timeout.tv_nsec = ( timeout.tv_usec + byte.tv_usec * size * 2 ) * 1000 + this->now.tv_nsec; }
+            // Carry the nanoseconds over into the seconds, the deadline is compared as a whole
+            long long nsec = ( timeout.tv_usec + byte.tv_usec * size * 2 ) * 1000LL + this->now.tv_nsec;
+            this->timeout.tv_sec = timeout.tv_sec + byte.tv_sec * size * 2 + this->now.tv_sec + nsec / 1000000000LL;
+            this->timeout.tv_nsec = nsec % 1000000000LL; }
         bool expired ( ) { clock_gettime( CLOCK_MONOTONIC, & ( this->now ) );
-            return ( this->timeout.tv_sec < this->now.tv_sec || this->timeout.tv_nsec < this->now.tv_nsec ); }
+            return ( this->timeout.tv_sec < this->now.tv_sec ||
+                     ( this->timeout.tv_sec == this->now.tv_sec && this->timeout.tv_nsec <= this->now.tv_nsec ) ); }
+        // Time left to the deadline as of the last check (construction or expired), zero once past it
+        timespec left ( ) const { timespec left = { 0, 0 };
+            if ( this->timeout.tv_sec < this->now.tv_sec ||
+                 ( this->timeout.tv_sec == this->now.tv_sec && this->timeout.tv_nsec <= this->now.tv_nsec ) ) return left;
+            left.tv_sec = this->timeout.tv_sec - this->now.tv_sec;
+            left.tv_nsec = this->timeout.tv_nsec - this->now.tv_nsec;
+            if ( left.tv_nsec < 0 ) { left.tv_nsec += 1000000000L; --left.tv_sec; }
+            return left; }
     };
 
+    // WAIT FOR (fd,events,deadline) -> result : Wait for a descriptor to be ready until an absolute deadline with ppoll,
+    // any descriptor number works and the configured timeouts are left untouched. 1 if ready, 0 on timeout, -1 with errno
+    inline int wait_for ( int fd, short events, const TimeCheck& deadline ) {
+        struct pollfd ready = { fd, events, 0 };
+        timespec left = deadline.left();
+        int result = ::ppoll ( &ready, 1, &left, NULL );
+        // A closed descriptor is reported as ready, select failed on it instead
+        if ( result > 0 && ( ready.revents & POLLNVAL ) ) { errno = EBADF; return -1; }
+        return result;
+    }
+
     /*!
      * Contains a description for serial communication
      *
@@ -139,6 +167,12 @@ namespace comm {
      *
      * \param flowcontrol Type of flowcontrol used, default is NONE,
      * possible values are: NONE, SOFTWARE, HARDWARE
+     *
+     * \param latency Latency profile of the driver, default is DEFAULT_LATENCY,
+     * possible values are: DEFAULT_LATENCY, LOW_LATENCY
+     *
+     * \param frame_size Expected size of the incoming frames (VMIN), a waiting reader is woken up once this many bytes
+     * are buffered instead of at every byte, default is 0 (every byte). Frames shorter than this wait for the timeout
      */
     struct Settings {
 
@@ -146,10 +180,14 @@ namespace comm {
         Parity parity;
         StopBits stopbits;
         FlowControl flowcontrol;
+        LatencyProfile latency;
+        uint8_t frame_size;
 
         explicit Settings ( ByteSize bytesize=EIGHT, Parity parity=NOPAR,
-                            StopBits stopbits=ONE, FlowControl flowcontrol=NOFLOW ) :
-                bytesize(bytesize), parity(parity), stopbits(stopbits), flowcontrol(flowcontrol) { 
+                            StopBits stopbits=ONE, FlowControl flowcontrol=NOFLOW,
+                            LatencyProfile latency=DEFAULT_LATENCY, uint8_t frame_size=0 ) :
+                bytesize(bytesize), parity(parity), stopbits(stopbits), flowcontrol(flowcontrol), latency(latency),
+                frame_size(frame_size) {
         }
     };
 
@@ -163,7 +201,7 @@ namespace comm {
     public:
         InterfaceException ( const string& description_ ) { this->e_what_ = description_; }
         InterfaceException ( const string& description_, int errno_ ) {
-            this->e_what_ = format ( "%d : %s : %s", errno_, description_, strerror(errno_) );
+            this->e_what_ = format ( "%d : %s : %s", errno_, description_.c_str(), strerror(errno_) );
         }
         InterfaceException (const InterfaceException& other) : e_what_(other.e_what_) {}
         virtual ~InterfaceException() throw() {}
@@ -179,7 +217,7 @@ namespace comm {
     public:
         IOException ( const string& description_ ) { this->e_what_ = description_; }
         IOException ( const string& description_, int errno_ ) {
-            this->e_what_ = format ( "%d : %s : %s", errno_, description_, strerror(errno_) );
+            this->e_what_ = format ( "%d : %s : %s", errno_, description_.c_str(), strerror(errno_) );
         }
         IOException (const IOException& other) : e_what_(other.e_what_) {}
         virtual ~IOException() throw() {}
@@ -195,7 +233,7 @@ namespace comm {
     public:
         ConnectionException ( const string& description_ ) { this->e_what_ = description_; }
         ConnectionException ( const string& description_, int errno_ ) {
-            this->e_what_ = format ( "%d : %s : %s", errno_, description_, strerror(errno_) );
+            this->e_what_ = format ( "%d : %s : %s", errno_, description_.c_str(), strerror(errno_) );
         }
         ConnectionException (const ConnectionException& other) : e_what_(other.e_what_) {}
         virtual ~ConnectionException() throw() {}
@@ -206,8 +244,15 @@ namespace comm {
 
     double get_bytetime ( uint32_t baudrate, const Settings& settings );
 
+    // Bxxxx constant of a baudrate, 0 if there is none
     speed_t get_baudrate (uint32_t baudrate);
 
+    // Set any baudrate through termios2 (BOTHER), false with errno if the driver refuses it or there is no termios2
+    bool set_custom_baudrate ( int fd, uint32_t baudrate );
+
+    // Output baudrate applied by the driver, 0 if it cannot be read
+    uint32_t get_actual_baudrate ( int fd );
+
     void init_options ( termios * option );
 
     void set_options ( termios * option, const Settings& settings );
@@ -221,6 +266,9 @@ namespace comm {
     // Set socket address and port
     void set_address ( const string * address, uint32_t port, sockaddr_in * sockaddr );
 
+    // Skip size bytes of an iovec array, move iov to the first entry left and return the number of entries left
+    size_t advance_iovec ( struct iovec *& iov, size_t count, size_t size );
+
 } // namespace comm
 
 #endif  // SERIAL_UTILS_H
@@ -0,0 +1,413 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file async.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/async.h>
+// SYS
+#include <sys/eventfd.h>
+// STD
+#include <cmath>
+
+namespace comm {
+
+    // Absolute CLOCK_MONOTONIC time, seconds from now
+    static timespec deadline_after ( double seconds ) {
+        timespec deadline;
+        clock_gettime ( CLOCK_MONOTONIC, &deadline );
+        deadline.tv_sec += static_cast<time_t> ( seconds );
+        deadline.tv_nsec += static_cast<long> ( ( seconds - static_cast<time_t> ( seconds ) ) * 1e9 );
+        if ( deadline.tv_nsec >= 1000000000L ) { deadline.tv_sec += 1; deadline.tv_nsec -= 1000000000L; }
+        return deadline;
+    }
+    // Seconds before an expired operation is tried again, while its instance is held by another thread
+    static const double RETRY = 1e-3;
+    // Seconds left to an absolute CLOCK_MONOTONIC time, negative if it passed
+    static double seconds_until ( const timespec& deadline, const timespec& now ) {
+        return ( deadline.tv_sec - now.tv_sec ) + ( deadline.tv_nsec - now.tv_nsec ) * 1e-9;
+    }
+
+    // Clears a blocking flag of an instance for the duration of a single attempt, the flag's mutex must be held
+    class NoWait {
+    public:
+        explicit NoWait ( bool& flag ) : flag_(flag), saved_(flag) { flag = false; }
+        ~NoWait ( ) { this->flag_ = this->saved_; }
+    private:
+        bool& flag_;
+        bool saved_;
+    };
+
+    AsyncService::AsyncService ( ) : polling_(false), stopped_(false) {
+        if ( ( this->epoll_fd_ = ::epoll_create1 ( EPOLL_CLOEXEC ) ) < 0 )
+            throw new IOException ( "AsyncService::AsyncService : epoll_create1", errno );
+        if ( ( this->event_fd_ = ::eventfd ( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) < 0 ) {
+            int error = errno;
+            ::close ( this->epoll_fd_ );
+            throw new IOException ( "AsyncService::AsyncService : eventfd", error );
+        }
+        // The event file descriptor is the only one registered without an instance
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        if ( ::epoll_ctl ( this->epoll_fd_, EPOLL_CTL_ADD, this->event_fd_, &event ) < 0 ) {
+            int error = errno;
+            ::close ( this->event_fd_ );
+            ::close ( this->epoll_fd_ );
+            throw new IOException ( "AsyncService::AsyncService : epoll_ctl", error );
+        }
+        this->thread_ = boost::thread ( &AsyncService::run_, this );
+    }
+
+    AsyncService::~AsyncService ( ) {
+        this->stopped_ = true;
+        uint64_t counter = 1;
+        ssize_t written = ::write ( this->event_fd_, &counter, sizeof ( counter ) );
+        (void) written;
+        this->thread_.join ( );
+        ::close ( this->event_fd_ );
+        ::close ( this->epoll_fd_ );
+    }
+
+    // INSTANCE : Service shared by every comm::Comm, started on first use
+    AsyncService& AsyncService::instance ( ) {
+        static AsyncService service;
+        return service;
+    }
+
+    // READ : Queue a read of size bytes, the handler gets the data read when the deadline expires or the peer closes
+    void AsyncService::read ( Comm& comm, size_t size, const Comm::ReadHandler& handler, double deadline ) {
+        boost::shared_ptr<Operation> operation = boost::make_shared<Operation>();
+        operation->kind = READ;
+        operation->size = size;
+        operation->data.reserve ( size );
+        operation->read_handler = handler;
+        this->post_ ( comm, operation, deadline );
+    }
+
+    // READLINE : Queue a read of a line (until eol or size is reached)
+    void AsyncService::readline ( Comm& comm, size_t size, const Comm::ReadHandler& handler, double deadline ) {
+        boost::shared_ptr<Operation> operation = boost::make_shared<Operation>();
+        operation->kind = READLINE;
+        operation->size = size;
+        operation->read_handler = handler;
+        this->post_ ( comm, operation, deadline );
+    }
+
+    // SEND : Queue a send, the handler gets the bytes sent when the deadline expires
+    void AsyncService::send ( Comm& comm, const string& data, const Comm::SendHandler& handler, double deadline ) {
+        boost::shared_ptr<Operation> operation = boost::make_shared<Operation>();
+        operation->kind = SEND;
+        operation->size = data.size();
+        operation->data = data;
+        operation->send_handler = handler;
+        this->post_ ( comm, operation, deadline );
+    }
+
+    // CANCEL : Complete the pending operations of an instance with a comm::ConnectionException, return their number
+    size_t AsyncService::cancel ( Comm& comm ) {
+        return this->fail_ ( comm, std::make_exception_ptr ( new ConnectionException ( "Comm::cancel : cancelled" ) ) );
+    }
+
+    // PENDING : Number of pending operations of an instance
+    size_t AsyncService::pending ( Comm& comm ) {
+        boost::lock_guard<boost::recursive_mutex> lock(this->mtx_pending);
+        std::map<Comm*, Pending>::iterator found = this->pending_.find ( &comm );
+        return found == this->pending_.end() ? 0 : found->second.reads.size() + found->second.sends.size();
+    }
+
+    /*=====================================================================================================================
+     * TRY : Complete an operation at once from the calling thread, without waiting
+     *===================================================================================================================*/
+    // TRY READ : Read size bytes if they are available, nothing is consumed otherwise
+    bool AsyncService::tryRead ( Comm& comm, size_t size, string& data ) {
+        {
+            boost::lock_guard<boost::recursive_mutex> lock(this->mtx_pending);
+            std::map<Comm*, Pending>::iterator found = this->pending_.find ( &comm );
+            if ( found != this->pending_.end() && ! found->second.reads.empty() ) return false;
+        }
+        boost::lock_guard<boost::mutex> lock(comm.mtx_read);
+        NoWait no_wait ( comm.read_blocking_ );
+        if ( comm.rx_.size() < size ) comm.fill_ ( size - comm.rx_.size() );
+        comm.takeReadError_().raise();
+        if ( comm.rx_.size() < size ) return false;
+        data.assign ( reinterpret_cast<const char*> ( comm.rx_.data() ), size );
+        comm.rx_.consume ( size );
+        return true;
+    }
+    // TRY READLINE : Read a complete line (until eol or size is reached) if available, nothing is consumed otherwise
+    bool AsyncService::tryReadline ( Comm& comm, size_t size, string& data ) {
+        {
+            boost::lock_guard<boost::recursive_mutex> lock(this->mtx_pending);
+            std::map<Comm*, Pending>::iterator found = this->pending_.find ( &comm );
+            if ( found != this->pending_.end() && ! found->second.reads.empty() ) return false;
+        }
+        boost::lock_guard<boost::mutex> lock(comm.mtx_read);
+        NoWait no_wait ( comm.read_blocking_ );
+        size_t length = comm.scanLine_ ( size );
+        comm.takeReadError_().raise();
+        if ( length == 0 ) return false;
+        data.assign ( reinterpret_cast<const char*> ( comm.rx_.data() ), length );
+        comm.rx_.consume ( length );
+        return true;
+    }
+    // TRY SEND : Send as much as the instance accepts without waiting, return the number of sent char
+    size_t AsyncService::trySend ( Comm& comm, const string& data ) {
+        {
+            boost::lock_guard<boost::recursive_mutex> lock(this->mtx_pending);
+            std::map<Comm*, Pending>::iterator found = this->pending_.find ( &comm );
+            if ( found != this->pending_.end() && ! found->second.sends.empty() ) return 0;
+        }
+        boost::lock_guard<boost::mutex> lock(comm.mtx_send);
+        NoWait no_wait ( comm.send_blocking_ );
+        size_t sent = comm.send_ ( reinterpret_cast<const uint8_t*> ( data.data() ), data.size() );
+        comm.takeSendError_().raise();
+        return sent;
+    }
+
+    // Queue an operation and wake up the service thread
+    void AsyncService::post_ ( Comm& comm, const boost::shared_ptr<Operation>& operation, double deadline ) {
+        operation->sent = 0;
+        operation->has_deadline = deadline >= 0;
+        if ( operation->has_deadline ) operation->deadline = deadline_after ( deadline );
+        {
+            boost::lock_guard<boost::recursive_mutex> lock(this->mtx_pending);
+            Pending& pending = this->pending_[&comm];
+            ( operation->kind == SEND ? pending.sends : pending.reads ).push_back ( operation );
+            this->posted_.push_back ( &comm );
+        }
+        // The service thread checks the posted instances before waiting, it needs a wake up only while it may be waiting
+        if ( this->polling_ ) {
+            uint64_t counter = 1;
+            ssize_t written = ::write ( this->event_fd_, &counter, sizeof ( counter ) );
+            (void) written;
+        }
+    }
+
+    // Service thread : wait for readiness or for the next deadline
+    void AsyncService::run_ ( ) {
+        while ( ! this->stopped_ ) {
+            double timeout;
+            {
+                boost::lock_guard<boost::recursive_mutex> lock(this->mtx_pending);
+                // New operations may complete at once with buffered data
+                std::vector<Comm*> posted;
+                posted.swap ( this->posted_ );
+                for ( size_t i = 0; i < posted.size(); ++i )
+                    if ( this->pending_.count ( posted[i] ) ) this->progress_ ( *posted[i], 0 );
+                timeout = this->expire_ ( );
+                // Operations posted from now on write the event file descriptor, those posted meanwhile are not waited for
+                this->polling_ = true;
+                if ( ! this->posted_.empty() ) timeout = 0;
+            }
+            int ready = ::epoll_wait ( this->epoll_fd_, this->events_, sizeof ( this->events_ ) / sizeof ( this->events_[0] ),
+                                       timeout < 0 ? -1 : static_cast<int> ( std::ceil ( timeout * 1000 ) ) );
+            this->polling_ = false;
+            boost::lock_guard<boost::recursive_mutex> lock(this->mtx_pending);
+            for ( int i = 0; i < ready; ++i ) {
+                Comm* comm = static_cast<Comm*> ( this->events_[i].data.ptr );
+                if ( comm == NULL ) {
+                    uint64_t counter;
+                    while ( ::read ( this->event_fd_, &counter, sizeof ( counter ) ) > 0 );
+                    continue;
+                }
+                // The instance may have been cancelled or destroyed since the wait returned
+                if ( this->pending_.count ( comm ) ) this->progress_ ( *comm, this->events_[i].events );
+            }
+        }
+    }
+
+    // Make progress on the operations of an instance, events are those reported by epoll (0 if none)
+    void AsyncService::progress_ ( Comm& comm, uint32_t events ) {
+        for ( uint32_t direction = EPOLLIN; direction != 0;
+              direction = direction == EPOLLIN ? static_cast<uint32_t> ( EPOLLOUT ) : 0u ) {
+            bool ready = events & ( direction | EPOLLERR | EPOLLHUP );
+            while ( true ) {
+                // Handlers may cancel or start operations, look the instance up again every time
+                std::map<Comm*, Pending>::iterator found = this->pending_.find ( &comm );
+                if ( found == this->pending_.end() ) return;
+                std::deque<boost::shared_ptr<Operation> >& queue =
+                        direction == EPOLLIN ? found->second.reads : found->second.sends;
+                if ( queue.empty() ) break;
+                boost::shared_ptr<Operation> operation = queue.front();
+                std::exception_ptr error;
+                try { if ( ! this->attempt_ ( comm, *operation, ready ) ) break; }
+                catch ( ... ) { error = std::current_exception(); }
+                queue.pop_front ( );
+                complete_ ( *operation, error );
+                // The readiness was used by this operation, the next ones start without it
+                ready = false;
+            }
+        }
+        // Events of a direction with nothing pending are no longer needed
+        try { this->watch_ ( comm, events != 0 ); }
+        catch ( ... ) { this->fail_ ( comm, std::current_exception() ); }
+    }
+
+    // Attempt an operation without waiting, return true if it completed
+    bool AsyncService::attempt_ ( Comm& comm, Operation& operation, bool ready ) {
+        // The service thread never waits on an instance, a blocking call of another thread holding it is let through
+        if ( operation.kind == SEND ) {
+            boost::unique_lock<boost::mutex> lock(comm.mtx_send, boost::try_to_lock);
+            if ( ! lock.owns_lock() ) return false;
+            NoWait no_wait ( comm.send_blocking_ );
+            operation.sent += comm.send_ ( reinterpret_cast<const uint8_t*> ( operation.data.data() ) + operation.sent,
+                                           operation.size - operation.sent );
+            comm.takeSendError_().raise();
+            return operation.sent == operation.size;
+        }
+        boost::unique_lock<boost::mutex> lock(comm.mtx_read, boost::try_to_lock);
+        if ( ! lock.owns_lock() ) return false;
+        NoWait no_wait ( comm.read_blocking_ );
+        if ( operation.kind == READLINE ) {
+            size_t buffered = comm.rx_.size();
+            size_t length = comm.scanLine_ ( operation.size );
+            // The peer closing completes the operation, it is no failure
+            Error error = comm.takeReadError_();
+            bool closed = error.code == ERROR_DISCONNECTED;
+            if ( ! closed ) error.raise();
+            if ( length == 0 ) {
+                // Readable but nothing came in, the peer closed: complete with the partial line, as on timeout
+                if ( ! closed && ( ! ready || comm.rx_.size() != buffered ) ) return false;
+                length = std::min ( operation.size, comm.rx_.size() );
+            }
+            operation.data.assign ( reinterpret_cast<const char*> ( comm.rx_.data() ), length );
+            comm.rx_.consume ( length );
+            return true;
+        }
+        // Serve the buffered data first, then whatever the descriptor has
+        size_t taken = std::min ( operation.size - operation.data.size(), comm.rx_.size() );
+        operation.data.append ( reinterpret_cast<const char*> ( comm.rx_.data() ), taken );
+        comm.rx_.consume ( taken );
+        if ( operation.data.size() == operation.size ) return true;
+        size_t bytes_read = comm.fill_ ( operation.size - operation.data.size() );
+        Error error = comm.takeReadError_();
+        bool closed = error.code == ERROR_DISCONNECTED;
+        if ( ! closed ) error.raise();
+        taken = std::min ( operation.size - operation.data.size(), comm.rx_.size() );
+        operation.data.append ( reinterpret_cast<const char*> ( comm.rx_.data() ), taken );
+        comm.rx_.consume ( taken );
+        // Readable but nothing came in, the peer closed
+        return operation.data.size() == operation.size || closed || ( ready && bytes_read == 0 );
+    }
+
+    // Complete the operations whose deadline expired, return the seconds to the next deadline (negative if none)
+    double AsyncService::expire_ ( ) {
+        timespec now;
+        clock_gettime ( CLOCK_MONOTONIC, &now );
+        double next = -1;
+        std::vector<Comm*> comms;
+        for ( std::map<Comm*, Pending>::iterator it = this->pending_.begin(); it != this->pending_.end(); ++it )
+            comms.push_back ( it->first );
+        for ( size_t c = 0; c < comms.size(); ++c ) {
+            bool expired = true;
+            // Handlers may cancel or start operations, scan again after each completion
+            while ( expired ) {
+                expired = false;
+                std::map<Comm*, Pending>::iterator found = this->pending_.find ( comms[c] );
+                if ( found == this->pending_.end() ) break;
+                for ( int direction = 0; direction < 2 && ! expired; ++direction ) {
+                    std::deque<boost::shared_ptr<Operation> >& queue =
+                            direction == 0 ? found->second.reads : found->second.sends;
+                    for ( size_t i = 0; i < queue.size(); ++i ) {
+                        boost::shared_ptr<Operation> operation = queue[i];
+                        if ( ! operation->has_deadline ) continue;
+                        double left = seconds_until ( operation->deadline, now );
+                        if ( left > 0 ) { next = next < 0 ? left : std::min ( next, left ); continue; }
+                        // A line being read completes with the partial line, as on timeout
+                        if ( i == 0 && operation->kind == READLINE ) {
+                            // The service thread never waits on an instance, a busy one is tried again shortly
+                            boost::unique_lock<boost::mutex> lock(comms[c]->mtx_read, boost::try_to_lock);
+                            if ( ! lock.owns_lock() ) { next = next < 0 ? RETRY : std::min ( next, RETRY ); continue; }
+                            size_t length = std::min ( operation->size, comms[c]->rx_.size() );
+                            operation->data.assign ( reinterpret_cast<const char*> ( comms[c]->rx_.data() ), length );
+                            comms[c]->rx_.consume ( length );
+                        }
+                        queue.erase ( queue.begin() + i );
+                        complete_ ( *operation, std::exception_ptr() );
+                        expired = true;
+                        break;
+                    }
+                }
+            }
+            if ( ! this->pending_.count ( comms[c] ) ) continue;
+            try { this->watch_ ( *comms[c], false ); }
+            catch ( ... ) { this->fail_ ( *comms[c], std::current_exception() ); }
+        }
+        return next;
+    }
+
+    // Watch an instance for the events of its pending operations, dropping the events no longer needed if shrink
+    void AsyncService::watch_ ( Comm& comm, bool shrink ) {
+        std::map<Comm*, Pending>::iterator found = this->pending_.find ( &comm );
+        if ( found == this->pending_.end() ) return;
+        Pending& pending = found->second;
+        uint32_t events = ( pending.reads.empty() ? 0u : static_cast<uint32_t> ( EPOLLIN ) ) |
+                          ( pending.sends.empty() ? 0u : static_cast<uint32_t> ( EPOLLOUT ) );
+        int fd = comm.getFileDescriptor();
+        // Reopened (or closed), the old descriptor left epoll when it was closed
+        if ( fd != pending.fd ) { pending.fd = -1; pending.events = 0; }
+        // The registration is kept while idle, the events are dropped only when they show up unwanted
+        if ( ! shrink ) events |= pending.events;
+        if ( events == pending.events && pending.fd >= 0 ) return;
+        if ( events == 0 ) {
+            // Nothing wanted, leave epoll: errors and hang ups would be reported anyway
+            struct epoll_event event;
+            if ( pending.fd >= 0 ) ::epoll_ctl ( this->epoll_fd_, EPOLL_CTL_DEL, pending.fd, &event );
+            pending.fd = -1;
+            pending.events = 0;
+            return;
+        }
+        if ( fd < 0 ) throw new ConnectionException ( "AsyncService::watch : not open" );
+        struct epoll_event event;
+        event.events = events;
+        event.data.ptr = &comm;
+        int operation = pending.fd < 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+        if ( ::epoll_ctl ( this->epoll_fd_, operation, fd, &event ) < 0 ) {
+            // The descriptor was closed and reopened with the same number, or it is still registered from before
+            if ( errno != EEXIST && errno != ENOENT ) throw new IOException ( "AsyncService::watch : epoll_ctl", errno );
+            operation = operation == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+            if ( ::epoll_ctl ( this->epoll_fd_, operation, fd, &event ) < 0 )
+                throw new IOException ( "AsyncService::watch : epoll_ctl", errno );
+        }
+        pending.fd = fd;
+        pending.events = events;
+    }
+
+    // Complete every pending operation of an instance with an error and deregister it, return their number
+    size_t AsyncService::fail_ ( Comm& comm, std::exception_ptr error ) {
+        boost::lock_guard<boost::recursive_mutex> lock(this->mtx_pending);
+        std::map<Comm*, Pending>::iterator found = this->pending_.find ( &comm );
+        if ( found == this->pending_.end() ) return 0;
+        Pending pending = found->second;
+        this->pending_.erase ( found );
+        this->posted_.erase ( std::remove ( this->posted_.begin(), this->posted_.end(), &comm ), this->posted_.end() );
+        if ( pending.fd >= 0 && pending.fd == comm.getFileDescriptor() ) {
+            struct epoll_event event;
+            ::epoll_ctl ( this->epoll_fd_, EPOLL_CTL_DEL, pending.fd, &event );
+        }
+        for ( size_t i = 0; i < pending.reads.size(); ++i ) complete_ ( *pending.reads[i], error );
+        for ( size_t i = 0; i < pending.sends.size(); ++i ) complete_ ( *pending.sends[i], error );
+        return pending.reads.size() + pending.sends.size();
+    }
+
+    // Call the handler of an operation, exceptions thrown by the handler are ignored
+    void AsyncService::complete_ ( Operation& operation, std::exception_ptr error ) {
+        try {
+            if ( operation.kind == SEND ) { if ( operation.send_handler ) operation.send_handler ( operation.sent, error ); }
+            else if ( operation.read_handler ) operation.read_handler ( operation.data, error );
+        } catch ( ... ) { }
+    }
+
+}
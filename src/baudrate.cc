@@ -0,0 +1,62 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file baudrate.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Baudrates with no Bxxxx constant, through the termios2 structure of the kernel. Its header defines a termios of its
+ *  own that clashes with the one of the C library, so it is kept apart from utils.cc and from every comm header.
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+// STD
+#include <stdint.h>
+#include <errno.h>
+// SYS
+#include <sys/ioctl.h>
+#if defined(__linux__)
+#include <asm/termbits.h>
+#endif
+
+namespace comm {
+
+#if defined(__linux__) && defined(TCGETS2) && defined(BOTHER)
+
+    // SET CUSTOM BAUDRATE (fd,baudrate) -> bool : Set any input and output rate with BOTHER, false with errno if the
+    // driver refuses it. The other options are left as they are
+    bool set_custom_baudrate ( int fd, uint32_t baudrate ) {
+        struct termios2 options;
+        if ( ::ioctl ( fd, TCGETS2, &options ) < 0 ) return false;
+        options.c_cflag &= ~( CBAUD | ( CBAUD << IBSHIFT ) );
+        options.c_cflag |= BOTHER | ( BOTHER << IBSHIFT );
+        options.c_ispeed = baudrate;
+        options.c_ospeed = baudrate;
+        return ::ioctl ( fd, TCSETS2, &options ) == 0;
+    }
+
+    // GET ACTUAL BAUDRATE (fd) -> baudrate : Output rate applied by the driver, which may round the one asked for, 0 if
+    // it cannot be read
+    uint32_t get_actual_baudrate ( int fd ) {
+        struct termios2 options;
+        if ( ::ioctl ( fd, TCGETS2, &options ) < 0 ) return 0;
+        return options.c_ospeed;
+    }
+
+#else
+
+    bool set_custom_baudrate ( int, uint32_t ) { errno = ENOTSUP; return false; }
+
+    uint32_t get_actual_baudrate ( int ) { return 0; }
+
+#endif
+
+} // namespace comm
@@ -0,0 +1,106 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file buffer.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/buffer.h>
+
+namespace comm {
+
+    RxBuffer::RxBuffer ( size_t capacity ) : storage_(capacity > 0 ? capacity : 1), head_(0), tail_(0) { }
+
+    // PREPARE : Make room for at least size bytes after the tail, moving unread data to the front if needed
+    void RxBuffer::prepare ( size_t size ) {
+        // Nothing left to read, start over from the beginning of the storage
+        if ( this->empty() ) this->clear();
+        // Move unread data to the front when the tail is too short, or when more room is wasted before the head
+        else if ( this->space() < size || this->head_ > this->space() ) {
+            std::memmove ( &this->storage_[0], &this->storage_[0] + this->head_, this->size() );
+            this->tail_ -= this->head_;
+            this->head_ = 0;
+        }
+        // Grow only if the data would not fit even after moving it
+        if ( this->space() < size ) this->storage_.resize ( this->tail_ + size );
+    }
+
+    // CONSUME : Discard size bytes from the head
+    void RxBuffer::consume ( size_t size ) {
+        this->head_ += std::min ( size, this->size() );
+        if ( this->empty() ) this->clear();
+    }
+
+    // TAKE : Copy up to size bytes from the head into data and consume them, return the number of bytes copied
+    size_t RxBuffer::take ( uint8_t *data, size_t size ) {
+        size = std::min ( size, this->size() );
+        if ( size == 0 ) return 0;
+        std::memcpy ( data, this->data(), size );
+        this->consume ( size );
+        return size;
+    }
+
+    // RESERVE : Grow the storage to at least capacity bytes, unread data is preserved
+    void RxBuffer::reserve ( size_t capacity ) {
+        if ( capacity > this->storage_.size() ) this->storage_.resize ( capacity );
+    }
+
+
+    TxRing::TxRing ( size_t capacity ) : head_(0), tail_(0) {
+        size_t size = 1;
+        while ( size < capacity ) size <<= 1;
+        this->storage_.resize ( size );
+        this->mask_ = size - 1;
+    }
+
+    // PUSH : Producer, copy count buffers in as a whole, return false and copy nothing if they do not fit
+    bool TxRing::push ( const View *data, size_t count ) {
+        size_t total = 0;
+        for ( size_t i = 0; i < count; ++i ) total += data[i].size;
+        size_t tail = this->tail_.load ( std::memory_order_relaxed );
+        if ( total > this->capacity() - ( tail - this->head_.load ( std::memory_order_acquire ) ) ) return false;
+        for ( size_t i = 0; i < count; ++i ) {
+            // Copy up to the end of the storage, then wrap around to the start
+            size_t offset = tail & this->mask_;
+            size_t first = std::min ( data[i].size, this->capacity() - offset );
+            if ( first > 0 ) std::memcpy ( &this->storage_[offset], data[i].data, first );
+            if ( first < data[i].size ) std::memcpy ( &this->storage_[0], data[i].data + first, data[i].size - first );
+            tail += data[i].size;
+        }
+        // Publish the bytes to the consumer
+        this->tail_.store ( tail, std::memory_order_release );
+        return true;
+    }
+
+    // PEEK : Consumer, point regions at the queued bytes in order, return the number of regions (0, 1 or 2)
+    size_t TxRing::peek ( View *regions ) const {
+        size_t head = this->head_.load ( std::memory_order_relaxed );
+        size_t size = this->tail_.load ( std::memory_order_acquire ) - head;
+        if ( size == 0 ) return 0;
+        size_t offset = head & this->mask_;
+        size_t first = std::min ( size, this->capacity() - offset );
+        regions[0] = View ( &this->storage_[offset], first );
+        if ( first == size ) return 1;
+        regions[1] = View ( &this->storage_[0], size - first );
+        return 2;
+    }
+
+    // CONSUME : Consumer, release size bytes from the head
+    void TxRing::consume ( size_t size ) {
+        // Hand the space back to the producer, never more than what is queued
+        size_t head = this->head_.load ( std::memory_order_relaxed );
+        size = std::min ( size, this->tail_.load ( std::memory_order_acquire ) - head );
+        this->head_.store ( head + size, std::memory_order_release );
+    }
+
+}
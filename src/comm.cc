@@ -16,26 +16,101 @@
  * HEADER
  *===========================================================================================================================*/
 #include <comm/comm.h>
+#include <comm/async.h>
+// SYS
+#include <poll.h>
+#include <sys/eventfd.h>
 
 namespace comm {
 
+    // CLOCK NS : CLOCK_MONOTONIC time in nanoseconds
+    static inline uint64_t clock_ns ( ) {
+        timespec now;
+        clock_gettime ( CLOCK_MONOTONIC, &now );
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+    // TIMED IO (timing,io,function) -> size : Call read_ or send_ through function, adding its duration to io if timing
+    template <typename Function>
+    static inline size_t timed_io ( const std::atomic<bool>& timing, uint64_t& io, Function function ) {
+        if ( ! timing.load ( std::memory_order_relaxed ) ) return function ( );
+        uint64_t start = clock_ns();
+        size_t result = function ( );
+        io += clock_ns() - start;
+        return result;
+    }
+
+    /*! Lock guard of a public read or send call. While latency tracking is on it times the wait for the mutex, clears
+    * the waited and io counters of the direction for the call, and records the phases of the call on release. */
+    class Comm::Timed {
+    public:
+        Timed ( Comm& comm, boost::mutex& mtx, Call call, uint64_t& waited, uint64_t& io ) :
+                comm_(comm), mtx_(mtx), call_(call), waited_(waited), io_(io), start_(0), locked_(0) {
+            if ( comm.timing_.load ( std::memory_order_acquire ) ) this->start_ = clock_ns();
+            this->mtx_.lock();
+            if ( this->start_ == 0 ) return;
+            this->locked_ = clock_ns();
+            this->waited_ = this->io_ = 0;
+        }
+        ~Timed ( ) {
+            if ( this->start_ != 0 ) {
+                Histogram* phases = &this->comm_.latency_[this->call_ * PHASES];
+                phases[PHASE_LOCK].record ( this->locked_ - this->start_ );
+                phases[PHASE_WAIT].record ( this->waited_ );
+                // The waits happen inside read_ and send_, the rest of their time went in the syscalls
+                phases[PHASE_IO].record ( this->io_ > this->waited_ ? this->io_ - this->waited_ : 0 );
+                phases[PHASE_TOTAL].record ( clock_ns() - this->start_ );
+            }
+            this->mtx_.unlock();
+        }
+    private:
+        Comm& comm_;
+        boost::mutex& mtx_;
+        Call call_;
+        uint64_t &waited_, &io_;
+        uint64_t start_, locked_;
+    };
+
     /*! Constructor */
     Comm::Comm ( const string &address, const string& eol, Timeout timeout, Settings settings ) :
-            address_(address), eol_(eol), eol_len_(eol.length()), timeout_(timeout), settings_(settings) { }
+            address_(address), eol_(eol), eol_len_(eol.length()), timeout_(timeout), settings_(settings) {
+        StatsRegistry::instance().add ( *this );
+    }
     /*! Destructor */
     Comm::~Comm () {
+        StatsRegistry::instance().remove ( *this );
+        this->shutdown_ ( );
         boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
         boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
         this->close_();
     }
 
+    // SHUTDOWN : Cancel the asynchronous operations, stop the writer thread, draining it while the transport is still
+    // there, and the reader thread
+    void Comm::shutdown_ ( ) {
+        if ( this->is_async_ ) AsyncService::instance().cancel ( *this );
+        this->stopWriter ( );
+        this->stopReader ( );
+    }
+
     /*! Opens the comm port. */
     void Comm::open () {
         //std::cout << "OPEN 1" << std::endl;
         boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
         boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
+        bool connected = this->is_connected_;
         this->open_();
         this->connect_();
+        // A connection established after the first one is a reconnect
+        if ( ! connected && this->is_connected_ ) {
+            if ( this->was_connected_ ) this->read_counters_.add ( Counters::RECONNECTS );
+            this->was_connected_ = true;
+            // The reader thread waits for the new descriptor
+            if ( this->reader_event_ >= 0 ) {
+                uint64_t counter = 1;
+                ssize_t written = ::write ( this->reader_event_, &counter, sizeof ( counter ) );
+                (void) written;
+            }
+        }
         //std::cout << "OPEN 2" << std::endl;
     }
     /*! Closes the comm port. */
@@ -59,6 +134,9 @@ namespace comm {
         //std::cout << "FLUSH IN 1" << std::endl;
         boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
         boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
+        this->rx_.clear();
+        this->packet_.clear();
+        if ( this->framer_ ) this->framer_->reset();
         this->flushInput_();
         //std::cout << "FLUSH IN 2" << std::endl;
     }
@@ -77,17 +155,39 @@ namespace comm {
     bool Comm::isOpen () const { return this->is_open_; }
     bool Comm::isConnected () const { return this->is_connected_; }
 
-    /*! Block until there is comm data to read or read_constant
-    * number of milliseconds have elapsed. The return value is true when
-    * the function exits with the port in a readable state, false otherwise
-    * (due to timeout or select interruption). */
+    /*! Sets the blocking mode of the comm port, blocking by default. */
+    void Comm::setBlocking ( bool blocking ) {
+        boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
+        boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
+        this->is_blocking_ = this->read_blocking_ = this->send_blocking_ = blocking;
+    }
+    bool Comm::isBlocking () const { return this->is_blocking_; }
+
+    /*! Gets the file descriptor of the comm port, -1 if the port is closed. */
+    int Comm::getFileDescriptor () const { return this->is_open_ ? this->fd_ : -1; }
+
+    /*! Block until there is comm data to read or the connection timeout
+    * has elapsed. The return value is true when the function exits with
+    * the port in a readable state, false otherwise (due to timeout or
+    * interruption). */
     bool Comm::waitRead () {
         boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
-        return this->waitRead_() > 0;
+        if ( ! this->rx_.empty() ) return true;
+        int result = this->waitRead_ ( TimeCheck ( this->timeout_.conn, timeval(), 0 ) );
+        this->takeReadError_().raise();
+        return result > 0;
     }
     bool Comm::waitSend () {
         boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
-        return this->waitSend_() > 0;
+        int result = this->waitSend_ ( TimeCheck ( this->timeout_.conn, timeval(), 0 ) );
+        this->takeSendError_().raise();
+        return result > 0;
+    }
+
+    /*! Gets the number of bytes already received and buffered, that can be read without waiting. */
+    size_t Comm::available () {
+        boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
+        return this->rx_.size();
     }
 
     /*=====================================================================================================================
@@ -97,36 +197,15 @@ namespace comm {
      *-------------------------------------------------------------------------------------------------------------------*/
     // READ (char*,size) -> size : Threadsafely read a fixed size of char in a char array
     size_t Comm::read (uint8_t *buffer, size_t size) {
-        //std::cout << "READ UINT 1" << std::endl;
-        boost::lock_guard<boost::mutex> lock(this->mtx_read);
-        //std::cout << "READ UINT 2" << std::endl;
-        return this->read_ (buffer, size);
+        return this->read (buffer, size, std::nothrow).valueOrThrow();
     }
     // READ (vector<char>,size) -> size : Threadsafely read a fixed size of char in a char vector
     size_t Comm::read (vector<uint8_t> &buffer, size_t size) {
-        //std::cout << "READ VEC 1" << std::endl;
-        boost::lock_guard<boost::mutex> lock(this->mtx_read);
-        uint8_t *buffer_ = new uint8_t[size];
-        size_t bytes_read = 0;
-        try { bytes_read = this->read_ (buffer_, size); }
-        catch (const std::exception &e) { delete[] buffer_; throw; }
-        buffer.insert (buffer.end (), buffer_, buffer_+bytes_read);
-        delete[] buffer_;
-        //std::cout << "READ VEC 2" << std::endl;
-        return bytes_read;
+        return this->read (buffer, size, std::nothrow).valueOrThrow();
     }
     // READ (string,size) -> size : Threadsafely read a fixed size of char in a string
     size_t Comm::read (string &buffer, size_t size) {
-        //std::cout << "READ STR 1" << std::endl;
-        boost::lock_guard<boost::mutex> lock(this->mtx_read);
-        uint8_t *buffer_ = new uint8_t[size];
-        size_t bytes_read = 0;
-        try { bytes_read = this->read_ (buffer_, size); }
-        catch (const std::exception &e) { delete[] buffer_; throw; }
-        buffer.append (reinterpret_cast<const char*>(buffer_), bytes_read);
-        delete[] buffer_;
-        //std::cout << "READ STR 2" << std::endl;
-        return bytes_read;
+        return this->read (buffer, size, std::nothrow).valueOrThrow();
     }
     // READ (size) -> string : Threadsafely read a fixed size of char in a string
     string Comm::read (size_t size) {
@@ -134,26 +213,44 @@ namespace comm {
         this->read (buffer, size);
         return buffer;
     }
+    // READ (char*,size,nothrow) -> Result<size> : Read a fixed size of char in a char array, without throwing
+    Result<size_t> Comm::read (uint8_t *buffer, size_t size, const std::nothrow_t&) {
+        //std::cout << "READ UINT 1" << std::endl;
+        Timed lock ( *this, this->mtx_read, CALL_READ, this->read_waited_, this->read_io_ );
+        //std::cout << "READ UINT 2" << std::endl;
+        size_t bytes_read = this->take_ (buffer, size);
+        return Result<size_t> ( bytes_read, this->takeReadError_() );
+    }
+    // READ (vector<char>,size,nothrow) -> Result<size> : Read a fixed size of char in a char vector, without throwing
+    Result<size_t> Comm::read (vector<uint8_t> &buffer, size_t size, const std::nothrow_t&) {
+        //std::cout << "READ VEC 1" << std::endl;
+        Timed lock ( *this, this->mtx_read, CALL_READ, this->read_waited_, this->read_io_ );
+        // Read straight into the vector, it allocates only if its capacity is too small
+        size_t offset = buffer.size();
+        buffer.resize ( offset + size );
+        size_t bytes_read = this->take_ (size > 0 ? &buffer[offset] : NULL, size);
+        buffer.resize ( offset + bytes_read );
+        //std::cout << "READ VEC 2" << std::endl;
+        return Result<size_t> ( bytes_read, this->takeReadError_() );
+    }
+    // READ (string,size,nothrow) -> Result<size> : Read a fixed size of char in a string, without throwing
+    Result<size_t> Comm::read (string &buffer, size_t size, const std::nothrow_t&) {
+        //std::cout << "READ STR 1" << std::endl;
+        Timed lock ( *this, this->mtx_read, CALL_READ, this->read_waited_, this->read_io_ );
+        // Read straight into the string, it allocates only if its capacity is too small
+        size_t offset = buffer.size();
+        buffer.resize ( offset + size );
+        size_t bytes_read = this->take_ (size > 0 ? reinterpret_cast<uint8_t*>(&buffer[offset]) : NULL, size);
+        buffer.resize ( offset + bytes_read );
+        //std::cout << "READ STR 2" << std::endl;
+        return Result<size_t> ( bytes_read, this->takeReadError_() );
+    }
     /*---------------------------------------------------------------------------------------------------------------------
      * READLINE : Read a fixed size of char and parse them into a char array, char vector or string, returns size or string
      *-------------------------------------------------------------------------------------------------------------------*/
     // READLINE (string,size) -> size : Read a line (until eol or size is reached) into string, return the string size
     size_t Comm::readline (string& buffer, size_t size) {
-        //std::cout << "READ LINE 1" << std::endl;
-        boost::lock_guard<boost::mutex> lock(this->mtx_read);
-        uint8_t *buffer_ = static_cast<uint8_t*> (alloca (size * sizeof (uint8_t)));
-        size_t read_so_far = 0;
-        while ( read_so_far < size ) {
-            size_t bytes_read = this->read_ (buffer_ + read_so_far, 1);
-            read_so_far += bytes_read;
-            if (bytes_read == 0) break;  // Timeout occured on reading 1 byte
-            if(read_so_far < this->eol_len_) continue;
-            if (string (reinterpret_cast<const char*>(buffer_+read_so_far-this->eol_len_),this->eol_len_) == this->eol_)
-                break; // EOL found
-        }
-        buffer.append(reinterpret_cast<const char*> (buffer_), read_so_far);
-        //std::cout << "READ LINE 2" << std::endl;
-        return read_so_far;
+        return this->readline (buffer, size, std::nothrow).valueOrThrow();
     }
     // READLINE (size) -> string : Read a line (until eol or size is reached) into a string, return the string
     string Comm::readline ( size_t size ) {
@@ -161,34 +258,181 @@ namespace comm {
         this->readline (buffer, size);
         return buffer;
     }
+    // READLINE (string,size,nothrow) -> Result<size> : Read a line (until eol or size is reached) into string, without
+    // throwing
+    Result<size_t> Comm::readline (string& buffer, size_t size, const std::nothrow_t&) {
+        //std::cout << "READ LINE 1" << std::endl;
+        Timed lock ( *this, this->mtx_read, CALL_READLINE, this->read_waited_, this->read_io_ );
+        size_t read_so_far = this->scanLine_ (size);
+        buffer.append(reinterpret_cast<const char*> (this->rx_.data()), read_so_far);
+        this->rx_.consume (read_so_far);
+        //std::cout << "READ LINE 2" << std::endl;
+        return Result<size_t> ( read_so_far, this->takeReadError_() );
+    }
     /*---------------------------------------------------------------------------------------------------------------------
      * READLINES : Read multiple lines at once, emplace them in a vector of strings
      *-------------------------------------------------------------------------------------------------------------------*/
     // READLINES (size) -> vector<string> : Read a vector of strings (to eol) until a fixed size is reached, return the string
     vector<string> Comm::readlines ( size_t size ) {
+        Result<vector<string> > result = this->readlines ( size, std::nothrow );
+        return std::move ( result.valueOrThrow() );
+    }
+    // READLINES (size,nothrow) -> Result<vector<string>> : Read a vector of strings (to eol), without throwing
+    Result<vector<string> > Comm::readlines ( size_t size, const std::nothrow_t& ) {
         //std::cout << "READ LINES 1" << std::endl;
-        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        Timed lock ( *this, this->mtx_read, CALL_READLINES, this->read_waited_, this->read_io_ );
+        // The views are staged in a vector kept between calls
+        size_t read_so_far = this->splitLines_ ( this->lines_, size );
         vector<string> lines;
-        uint8_t* buffer_ = static_cast<uint8_t*> (alloca (size * sizeof (uint8_t)));
-        size_t read_so_far = 0;
-        size_t start_of_line = 0;
-        while (read_so_far < size) {
-            size_t bytes_read = this->read_ (buffer_+read_so_far, 1);
-            if ( bytes_read == 0 ) break; // Timeout occured on reading 1 byte
-            read_so_far += bytes_read;
-            if ( read_so_far < this->eol_len_ + start_of_line ) continue;
-            if ( strncmp ( reinterpret_cast<const char*>(buffer_+read_so_far-this->eol_len_),
-                        this->eol_.c_str(), this->eol_len_ ) ) {  // EOL found
-                lines.emplace_back(reinterpret_cast<const char*>(buffer_+start_of_line), read_so_far-start_of_line);
-                start_of_line = read_so_far;
+        lines.reserve ( this->lines_.size() );
+        for ( size_t i = 0; i < this->lines_.size(); ++i )
+            lines.emplace_back ( reinterpret_cast<const char*>(this->lines_[i].data), this->lines_[i].size );
+        // Anything past size is left in the buffer for the next call
+        this->rx_.consume ( read_so_far );
+        //std::cout << "READ LINES 2" << std::endl;
+        return Result<vector<string> > ( std::move ( lines ), this->takeReadError_() );
+    }
+    /*---------------------------------------------------------------------------------------------------------------------
+     * READFRAME : Read a packet framed by the framer instead of a line
+     *-------------------------------------------------------------------------------------------------------------------*/
+    // READFRAME (string,size) -> bool : Read the next packet (up to size bytes) into string, replacing its content
+    bool Comm::readFrame ( string& packet, size_t size ) {
+        return this->readFrame ( packet, size, std::nothrow ).valueOrThrow();
+    }
+    // READFRAME (string,size,nothrow) -> Result<bool> : Read the next packet into string, without throwing
+    Result<bool> Comm::readFrame ( string& packet, size_t size, const std::nothrow_t& ) {
+        Timed lock ( *this, this->mtx_read, CALL_READLINE, this->read_waited_, this->read_io_ );
+        if ( ! this->framer_ ) throw new invalid_argument ( "Comm::readFrame : no framer set" );
+        // A frame delimited in place is copied once, straight out of the buffer
+        size_t length = this->delimitFrame_ ( size );
+        if ( length != string::npos ) {
+            if ( length > 0 ) {
+                packet.assign ( reinterpret_cast<const char*> ( this->rx_.data() ), length );
+                this->rx_.consume ( length );
             }
-            if ( read_so_far == size ) break; // Reached the maximum read length
+            return Result<bool> ( length > 0, this->takeReadError_() );
         }
-        if (start_of_line != read_so_far)
-            lines.emplace_back(reinterpret_cast<const char*>(buffer_+start_of_line), read_so_far-start_of_line);
-        //std::cout << "READ LINES 2" << std::endl;
-        return lines;
+        bool complete = this->scanFrame_ ( size );
+        // The packet is handed over, its storage is reused by the next frame
+        if ( complete ) {
+            packet.swap ( this->packet_ );
+            this->packet_.clear();
+        }
+        return Result<bool> ( complete, this->takeReadError_() );
+    }
+    // PEEKFRAME (size) -> View : Buffer the next frame (up to size bytes), return a view on it, empty on timeout
+    View Comm::peekFrame ( size_t size ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        if ( ! this->framer_ ) throw new invalid_argument ( "Comm::peekFrame : no framer set" );
+        size_t length = this->delimitFrame_ ( size );
+        if ( length == string::npos )
+            throw new invalid_argument ( "Comm::peekFrame : the framer does not delimit frames in place" );
+        this->takeReadError_().raise();
+        return View ( this->rx_.data(), length );
+    }
+    /*---------------------------------------------------------------------------------------------------------------------
+     * PEEK, PEEKLINE and PEEKLINES : Zero-copy reads, return views on the read-ahead buffer without consuming the data
+     *-------------------------------------------------------------------------------------------------------------------*/
+    // PEEK (size) -> View : Buffer a fixed size of char, return a view on it
+    View Comm::peek ( size_t size ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        size_t read_so_far = this->fillUpTo_ ( size );
+        this->takeReadError_().raise();
+        return View ( this->rx_.data(), read_so_far );
+    }
+    // PEEKLINE (size) -> View : Buffer a line (until eol or size is reached), return a view on it
+    View Comm::peekline ( size_t size ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        size_t read_so_far = this->scanLine_ ( size );
+        this->takeReadError_().raise();
+        return View ( this->rx_.data(), read_so_far );
+    }
+    // PEEKLINES (vector<View>,size) -> size : Buffer up to size bytes, replace lines with a view per line, return the size
+    size_t Comm::peeklines ( vector<View>& lines, size_t size ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        size_t read_so_far = this->splitLines_ ( lines, size );
+        this->takeReadError_().raise();
+        return read_so_far;
+    }
+    // RELEASE (View) : Consume the buffered data up to the end of the view, invalidating every view
+    void Comm::release ( const View& view ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        if ( view.end() < this->rx_.data() || view.end() > this->rx_.data() + this->rx_.size() )
+            throw new invalid_argument ( "Comm::release : the view does not point into the read buffer" );
+        this->rx_.consume ( view.end() - this->rx_.data() );
+    }
+    // ADVANCE (size) : Consume size bytes of buffered data, invalidating every view
+    void Comm::advance ( size_t size ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        this->rx_.consume ( size );
+    }
+    /*---------------------------------------------------------------------------------------------------------------------
+     * READER : Opt-in background reader, the frames are queued with their receive time and popped without the fd
+     *-------------------------------------------------------------------------------------------------------------------*/
+    // START READER (frames,size) : Start the reader thread with a queue of frames, frames longer than size are split
+    void Comm::startReader ( size_t frames, size_t size ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_reader);
+        if ( this->reader_.joinable() ) return;
+        if ( ( this->reader_event_ = ::eventfd ( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) < 0 )
+            throw new IOException ( "Comm::startReader : eventfd", errno );
+        boost::atomic_store ( &this->frames_, boost::make_shared<SpscQueue<Frame> > ( frames ) );
+        this->reader_stop_ = false;
+        this->has_reader_ = true;
+        this->reader_ = boost::thread ( &Comm::receive_, this, std::max<size_t> ( size, 1 ) );
+    }
+    // STOP READER : Stop the reader thread, the queued frames can still be popped
+    void Comm::stopReader ( ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_reader);
+        if ( ! this->reader_.joinable() ) return;
+        this->reader_stop_ = true;
+        uint64_t counter = 1;
+        ssize_t written = ::write ( this->reader_event_, &counter, sizeof ( counter ) );
+        (void) written;
+        this->reader_.join();
+        // close_ writes the event under mtx_read
+        boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
+        ::close ( this->reader_event_ );
+        this->reader_event_ = -1;
+    }
+    // HAS READER : True while the reader thread runs
+    bool Comm::hasReader ( ) const { return this->has_reader_; }
+    // POP FRAME (frame) -> bool : Take the oldest queued frame, false if there is none, the frame's storage is recycled
+    bool Comm::popFrame ( Frame& frame ) {
+        // A copy of the queue, startReader may replace it meanwhile
+        boost::shared_ptr<SpscQueue<Frame> > frames = boost::atomic_load ( &this->frames_ );
+        Frame* front = frames ? frames->front() : NULL;
+        if ( front == NULL ) return false;
+        // The caller's string goes back to the slot, steady state pops allocate nothing
+        frame.data.swap ( front->data );
+        frame.stamp = front->stamp;
+        frames->pop();
+        return true;
+    }
+    // POP FRAME (frame,timeout) -> bool : Take the oldest queued frame, waiting up to timeout seconds (negative for as
+    // long as the reader thread runs)
+    bool Comm::popFrame ( Frame& frame, double timeout ) {
+        if ( this->popFrame ( frame ) ) return true;
+        boost::system_time deadline = boost::get_system_time() +
+                boost::posix_time::microseconds ( static_cast<int64_t> ( std::max ( timeout, 0.0 ) * 1e6 ) );
+        boost::unique_lock<boost::mutex> lock(this->mtx_frames);
+        ++this->frames_waiting_;
+        // Pairs with the fence of the reader thread: either this sees the new frame, or the reader sees it waiting
+        std::atomic_thread_fence ( std::memory_order_seq_cst );
+        bool popped;
+        while ( ! ( popped = this->popFrame ( frame ) ) && this->has_reader_ ) {
+            if ( timeout < 0 ) this->cnd_frames.wait ( lock );
+            else if ( ! this->cnd_frames.timed_wait ( lock, deadline ) ) { popped = this->popFrame ( frame ); break; }
+        }
+        --this->frames_waiting_;
+        return popped;
     }
+    // GET FRAME DEPTH : Number of queued frames
+    size_t Comm::getFrameDepth ( ) const {
+        boost::shared_ptr<SpscQueue<Frame> > frames = boost::atomic_load ( &this->frames_ );
+        return frames ? frames->size() : 0;
+    }
+    // GET FRAME DROPS : Number of frames dropped because the queue was full
+    size_t Comm::getFrameDrops ( ) const { return this->frame_drops_; }
 
 
     /*=====================================================================================================================
@@ -198,24 +442,245 @@ namespace comm {
      *-------------------------------------------------------------------------------------------------------------------*/
     // SEND (string) -> size : Send a string, returns the number of sent char
     size_t Comm::send (const string& data) {
-        //std::cout << "SEND STR 1" << std::endl;
-        boost::lock_guard<boost::mutex> lock(this->mtx_send);
-        //std::cout << "SEND STR 2" << std::endl;
-        return this->send_ (reinterpret_cast<const uint8_t*>(data.c_str()), data.length());
+        return this->send (data, std::nothrow).valueOrThrow();
     }
     // SEND (vector<char>) -> size : Send a char vector, returns the number of sent char
     size_t Comm::send (const std::vector<uint8_t> &data) {
-        //std::cout << "SEND VEC 1" << std::endl;
-        boost::lock_guard<boost::mutex> lock(this->mtx_send);
-        //std::cout << "SEND VEC 2" << std::endl;
-        return this->send_ (&data[0], data.size());
+        return this->send (data, std::nothrow).valueOrThrow();
     }
     // SEND (char*,size) -> size : Send a char array, returns the number of sent char
     size_t Comm::send (const uint8_t *data, size_t size) {
+        return this->send (data, size, std::nothrow).valueOrThrow();
+    }
+    // SEND (string,nothrow) -> Result<size> : Send a string, without throwing
+    Result<size_t> Comm::send (const string& data, const std::nothrow_t&) {
+        return this->send (reinterpret_cast<const uint8_t*>(data.data()), data.length(), std::nothrow);
+    }
+    // SEND (vector<char>,nothrow) -> Result<size> : Send a char vector, without throwing
+    Result<size_t> Comm::send (const std::vector<uint8_t> &data, const std::nothrow_t&) {
+        return this->send (data.empty() ? NULL : &data[0], data.size(), std::nothrow);
+    }
+    // SEND (char*,size,nothrow) -> Result<size> : Send a char array, without throwing
+    Result<size_t> Comm::send (const uint8_t *data, size_t size, const std::nothrow_t&) {
         //std::cout << "SEND UINT 1" << std::endl;
-        boost::lock_guard<boost::mutex> lock(this->mtx_send);
+        View frame = View ( data, size );
+        size_t queued;
+        if ( this->queue_ ( &frame, 1, queued ) ) return Result<size_t> ( queued );
+        Timed lock ( *this, this->mtx_send, CALL_SEND, this->send_waited_, this->send_io_ );
         //std::cout << "SEND UINT 2" << std::endl;
-        return this->send_ (data, size);
+        size_t bytes_sent = timed_io ( this->timing_, this->send_io_, [&] { return this->send_ (data, size); } );
+        return Result<size_t> ( bytes_sent, this->takeSendError_() );
+    }
+    /*---------------------------------------------------------------------------------------------------------------------
+     * SENDV : Send a frame made of several buffers (e.g. header, payload and trailer) with a single vectored write
+     *-------------------------------------------------------------------------------------------------------------------*/
+    // SENDV (vector<View>) -> size : Send a list of buffers in order, returns the number of sent char
+    size_t Comm::sendv (const vector<View> &data) {
+        return this->sendv (data.empty() ? NULL : &data[0], data.size(), std::nothrow).valueOrThrow();
+    }
+    // SENDV (View*,count) -> size : Send an array of buffers in order, returns the number of sent char
+    size_t Comm::sendv (const View *data, size_t count) {
+        return this->sendv (data, count, std::nothrow).valueOrThrow();
+    }
+    // SENDV (vector<View>,nothrow) -> Result<size> : Send a list of buffers in order, without throwing
+    Result<size_t> Comm::sendv (const vector<View> &data, const std::nothrow_t&) {
+        return this->sendv (data.empty() ? NULL : &data[0], data.size(), std::nothrow);
+    }
+    // SENDV (View*,count,nothrow) -> Result<size> : Send an array of buffers in order, without throwing
+    Result<size_t> Comm::sendv (const View *data, size_t count, const std::nothrow_t&) {
+        size_t queued;
+        if ( this->queue_ ( data, count, queued ) ) return Result<size_t> ( queued );
+        Timed lock ( *this, this->mtx_send, CALL_SEND, this->send_waited_, this->send_io_ );
+        // The kernel takes at most IOV_MAX buffers per call, send them in batches
+        struct iovec *iov = static_cast<struct iovec*> (alloca (std::min<size_t> (count, IOV_MAX) * sizeof (struct iovec)));
+        size_t bytes_sent = 0;
+        for ( size_t first = 0; first < count; first += IOV_MAX ) {
+            size_t batch = std::min<size_t> ( count - first, IOV_MAX ), batch_size = 0;
+            for ( size_t i = 0; i < batch; ++i ) {
+                iov[i].iov_base = const_cast<uint8_t*> (data[first + i].data);
+                iov[i].iov_len = data[first + i].size;
+                batch_size += data[first + i].size;
+            }
+            size_t batch_sent = timed_io ( this->timing_, this->send_io_, [&] {
+                return this->sendv_ (iov, batch); } );
+            bytes_sent += batch_sent;
+            if ( batch_sent < batch_size || this->send_error_ ) break; // Timeout occured, or the resource failed
+        }
+        return Result<size_t> ( bytes_sent, this->takeSendError_() );
+    }
+    /*---------------------------------------------------------------------------------------------------------------------
+     * SENDFRAME : Encode a packet with the framer and send the frame
+     *-------------------------------------------------------------------------------------------------------------------*/
+    // SENDFRAME (string) -> size : Send a packet, returns the number of sent char of the frame
+    size_t Comm::sendFrame ( const string& packet ) {
+        return this->sendFrame ( packet, std::nothrow ).valueOrThrow();
+    }
+    // SENDFRAME (char*,size) -> size : Send a packet, returns the number of sent char of the frame
+    size_t Comm::sendFrame ( const uint8_t *data, size_t size ) {
+        return this->sendFrame ( data, size, std::nothrow ).valueOrThrow();
+    }
+    // SENDFRAME (vector<View>) -> size : Send a packet made of a list of buffers, returns the number of sent char
+    size_t Comm::sendFrame ( const vector<View>& packet ) {
+        return this->sendFrame ( packet.empty() ? NULL : &packet[0], packet.size(), std::nothrow ).valueOrThrow();
+    }
+    // SENDFRAME (string,nothrow) -> Result<size> : Send a packet, without throwing
+    Result<size_t> Comm::sendFrame ( const string& packet, const std::nothrow_t& ) {
+        return this->sendFrame ( reinterpret_cast<const uint8_t*> ( packet.data() ), packet.size(), std::nothrow );
+    }
+    // SENDFRAME (char*,size,nothrow) -> Result<size> : Send a packet, without throwing
+    Result<size_t> Comm::sendFrame ( const uint8_t *data, size_t size, const std::nothrow_t& ) {
+        View packet ( data, size );
+        return this->sendFrame ( &packet, 1, std::nothrow );
+    }
+    // SENDFRAME (View*,count,nothrow) -> Result<size> : Send a packet made of an array of buffers, without throwing
+    Result<size_t> Comm::sendFrame ( const View *data, size_t count, const std::nothrow_t& ) {
+        boost::shared_ptr<Framer> framer;
+        {
+            boost::lock_guard<boost::mutex> lock(this->mtx_send);
+            framer = this->framer_;
+        }
+        if ( ! framer ) throw new invalid_argument ( "Comm::sendFrame : no framer set" );
+        // Encoded into a buffer kept by the calling thread, the writer ring copies it if the frame is queued
+        static thread_local string frame;
+        frame.clear();
+        framer->encode ( data, count, frame );
+        return this->send ( reinterpret_cast<const uint8_t*> ( frame.data() ), frame.size(), std::nothrow );
+    }
+
+
+    /*---------------------------------------------------------------------------------------------------------------------
+     * WRITER : Opt-in background writer, send and sendv queue the frame and return at once
+     *-------------------------------------------------------------------------------------------------------------------*/
+    // START WRITER (capacity) : Start the writer thread with a ring of capacity bytes (rounded up to a power of two)
+    void Comm::startWriter ( size_t capacity ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_queue);
+        if ( this->has_writer_ ) return;
+        boost::atomic_store ( &this->tx_, boost::make_shared<TxRing> ( capacity ) );
+        this->writer_stop_ = false;
+        this->writer_ = boost::thread ( &Comm::drain_, this );
+        this->has_writer_ = true;
+    }
+    // STOP WRITER (drain) : Stop the writer thread, sending the queued data first (until a send times out) if drain
+    void Comm::stopWriter ( bool drain ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_queue);
+        if ( ! this->has_writer_ ) return;
+        this->has_writer_ = false;
+        {
+            boost::lock_guard<boost::mutex> lock_writer(this->mtx_writer);
+            this->writer_drain_ = drain;
+            this->writer_stop_ = true;
+        }
+        this->cnd_writer.notify_one();
+        this->writer_.join();
+        boost::atomic_store ( &this->tx_, boost::shared_ptr<TxRing>() );
+    }
+    // HAS WRITER : True while send calls are queued to the writer thread
+    bool Comm::hasWriter ( ) const { return this->has_writer_; }
+    // GET QUEUE DEPTH : Number of queued bytes not sent yet
+    size_t Comm::getQueueDepth ( ) const {
+        // A copy of the ring, stopWriter may release it meanwhile
+        boost::shared_ptr<TxRing> tx = boost::atomic_load ( &this->tx_ );
+        return tx ? tx->size() : 0;
+    }
+    // GET QUEUE DROPS : Number of frames dropped because the ring was full
+    size_t Comm::getQueueDrops ( ) const { return this->queue_drops_; }
+    // GET QUEUE DISCARDED : Number of queued bytes discarded because a send failed or the writer stopped
+    size_t Comm::getQueueDiscarded ( ) const { return this->queue_discarded_; }
+
+    /*=====================================================================================================================
+     * LATENCY : Opt-in latency histograms of the public read and send calls, recorded without locks
+     *===================================================================================================================*/
+    // SET LATENCY TRACKING (enable) : Start or stop recording, the histograms are allocated on the first start
+    void Comm::setLatencyTracking ( bool enable ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_latency);
+        // Published by the store below, never replaced afterwards
+        if ( enable && ! this->latency_ ) this->latency_.reset ( new Histogram[CALLS * PHASES] );
+        this->timing_.store ( enable, std::memory_order_release );
+    }
+    // IS LATENCY TRACKING : True while the calls are timed
+    bool Comm::isLatencyTracking ( ) const { return this->timing_; }
+    // GET LATENCY (reset) -> Latency : Snapshot of the histograms, cleared as they are copied if reset
+    Latency Comm::getLatency ( bool reset ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_latency);
+        Latency latency;
+        if ( this->latency_ )
+            for ( size_t call = 0; call < CALLS; ++call )
+                for ( size_t phase = 0; phase < PHASES; ++phase )
+                    latency.phases[call][phase] = this->latency_[call * PHASES + phase].snapshot ( reset );
+        return latency;
+    }
+    // RESET LATENCY : Clear the histograms
+    void Comm::resetLatency ( ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_latency);
+        if ( this->latency_ ) for ( size_t i = 0; i < CALLS * PHASES; ++i ) this->latency_[i].reset();
+    }
+
+
+    /*=====================================================================================================================
+     * STATS : I/O counters updated by the read and send paths
+     *===================================================================================================================*/
+    // STATS -> Stats : Snapshot of the counters, consistent within each direction
+    Stats Comm::stats ( ) const {
+        uint64_t values[Counters::COUNT] = { 0 };
+        this->read_counters_.load ( values );
+        this->send_counters_.load ( values );
+        Stats stats;
+        stats.bytes_in = values[Counters::BYTES_IN];
+        stats.bytes_out = values[Counters::BYTES_OUT];
+        stats.syscalls = values[Counters::SYSCALLS];
+        stats.eagain = values[Counters::EAGAINS];
+        stats.eintr = values[Counters::EINTRS];
+        stats.wait_timeouts = values[Counters::WAIT_TIMEOUTS];
+        stats.partial_reads = values[Counters::PARTIAL_READS];
+        stats.partial_sends = values[Counters::PARTIAL_SENDS];
+        stats.reconnects = values[Counters::RECONNECTS];
+        stats.errors = values[Counters::ERRORS];
+        return stats;
+    }
+
+
+    /*=====================================================================================================================
+     * ASYNC : Start a read or a send and return at once, the operation is completed later by comm::AsyncService
+     *===================================================================================================================*/
+    // ASYNC READ (size,handler,deadline) : Read a fixed size of char, then call the handler
+    void Comm::asyncRead ( size_t size, const ReadHandler& handler, double deadline ) {
+        this->is_async_ = true;
+        AsyncService::instance().read ( *this, size, handler, deadline );
+    }
+    // ASYNC READ (size,deadline) -> future<string> : Read a fixed size of char into the future
+    std::future<string> Comm::asyncRead ( size_t size, double deadline ) {
+        boost::shared_ptr<std::promise<string> > promise = boost::make_shared<std::promise<string> >();
+        this->asyncRead ( size, [promise] ( const string& data, std::exception_ptr error ) {
+            if ( error ) promise->set_exception ( error ); else promise->set_value ( data ); }, deadline );
+        return promise->get_future();
+    }
+    // ASYNC READLINE (size,handler,deadline) : Read a line (until eol or size is reached), then call the handler
+    void Comm::asyncReadline ( size_t size, const ReadHandler& handler, double deadline ) {
+        this->is_async_ = true;
+        AsyncService::instance().readline ( *this, size, handler, deadline );
+    }
+    // ASYNC READLINE (size,deadline) -> future<string> : Read a line (until eol or size is reached) into the future
+    std::future<string> Comm::asyncReadline ( size_t size, double deadline ) {
+        boost::shared_ptr<std::promise<string> > promise = boost::make_shared<std::promise<string> >();
+        this->asyncReadline ( size, [promise] ( const string& data, std::exception_ptr error ) {
+            if ( error ) promise->set_exception ( error ); else promise->set_value ( data ); }, deadline );
+        return promise->get_future();
+    }
+    // ASYNC SEND (string,handler,deadline) : Send a string (copied by the call), then call the handler
+    void Comm::asyncSend ( const string& data, const SendHandler& handler, double deadline ) {
+        this->is_async_ = true;
+        AsyncService::instance().send ( *this, data, handler, deadline );
+    }
+    // ASYNC SEND (string,deadline) -> future<size_t> : Send a string (copied by the call), the future gets the sent size
+    std::future<size_t> Comm::asyncSend ( const string& data, double deadline ) {
+        boost::shared_ptr<std::promise<size_t> > promise = boost::make_shared<std::promise<size_t> >();
+        this->asyncSend ( data, [promise] ( size_t sent, std::exception_ptr error ) {
+            if ( error ) promise->set_exception ( error ); else promise->set_value ( sent ); }, deadline );
+        return promise->get_future();
+    }
+    // CANCEL : Complete the pending operations with a comm::ConnectionException, return their number
+    size_t Comm::cancel ( ) {
+        return this->is_async_ ? AsyncService::instance().cancel ( *this ) : 0;
     }
 
     /*=====================================================================================================================
@@ -224,7 +689,10 @@ namespace comm {
     // SET ADDRESS
     void Comm::setAddress (const std::string &address) {
         if ( this->address_.compare(address) == 0 ) return;
-        this->address_ = address;
+        {
+            boost::lock_guard<boost::mutex> lock(this->mtx_stats);
+            this->address_ = address;
+        }
         boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
         boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
         if ( this->is_connected_ ) { this->close_(); this->open_(); }
@@ -235,7 +703,10 @@ namespace comm {
     // SET PORT
     void Comm::setPort ( uint16_t port ) {
         if ( this->port_ == port ) return;
-        this->port_ = port;
+        {
+            boost::lock_guard<boost::mutex> lock(this->mtx_stats);
+            this->port_ = port;
+        }
         boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
         boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
         if ( this->is_connected_ ) { this->close_(); this->open_(); }
@@ -261,6 +732,17 @@ namespace comm {
     // GET EOL : Get end of the line char for payloads (frames) to be read
     const string& Comm::getEOL ( ) const { return this->eol_; }
     //---------------------------------------------------------------------------------------------------------------------
+    // SET FRAMER : Set the codec of readFrame, sendFrame and the reader thread, the frame being decoded is dropped
+    void Comm::setFramer ( const boost::shared_ptr<Framer>& framer ) {
+        boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
+        boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
+        this->framer_ = framer;
+        this->packet_.clear();
+        if ( framer ) framer->reset();
+    }
+    // GET FRAMER
+    boost::shared_ptr<Framer> Comm::getFramer ( ) const { return this->framer_; }
+    //---------------------------------------------------------------------------------------------------------------------
     // SET TIMEOUT : Set timeout for read and send operations and connection (passing a timeout struct)
     void Comm::setTimeout (const Timeout& timeout) {
         boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
@@ -288,19 +770,38 @@ namespace comm {
     void Comm::setSettings ( ByteSize bytesize, Parity parity, StopBits stopbits, FlowControl flowcontrol ) {
         boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
         boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
-        this->settings_ = Settings(bytesize, parity, stopbits, flowcontrol);
+        this->settings_ = Settings(bytesize, parity, stopbits, flowcontrol, this->settings_.latency,
+                                   this->settings_.frame_size);
         this->setOptions_();
     }
     // GET SETTINGS
     const Settings& Comm::getSettings ( ) const { return this->settings_; }
+    //---------------------------------------------------------------------------------------------------------------------
+    // SET BUFFER SIZE : Set the capacity of the read-ahead buffer, buffered data is preserved
+    void Comm::setBufferSize ( size_t size ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        this->rx_.reserve ( size );
+    }
+    // GET BUFFER SIZE : Get the capacity of the read-ahead buffer
+    size_t Comm::getBufferSize ( ) const { return this->rx_.capacity(); }
 
     /*=====================================================================================================================
      * VIRTUAL : Virtual private methods to be extended
      *===================================================================================================================*/
-    // Read common function ( VIRTUAL )
-    size_t Comm::read_ (uint8_t *data, size_t size) { return -1; }
+    // Read common function ( VIRTUAL ) : read at least least bytes (or until timeout), up to size bytes
+    size_t Comm::read_ (uint8_t *data, size_t size, size_t) { return -1; }
     // Send common function ( VIRTUAL )
     size_t Comm::send_ (const uint8_t *data, size_t size) { return -1; }
+    // Send vectored common function ( VIRTUAL ) : one send_ per buffer, for transports without a vectored write
+    size_t Comm::sendv_ (struct iovec *iov, size_t count) {
+        size_t bytes_sent = 0;
+        for ( size_t i = 0; i < count; ++i ) {
+            size_t bytes_sent_now = this->send_ (static_cast<const uint8_t*>(iov[i].iov_base), iov[i].iov_len);
+            bytes_sent += bytes_sent_now;
+            if ( bytes_sent_now < iov[i].iov_len || this->send_error_ ) break;
+        }
+        return bytes_sent;
+    }
     // Open file descriptor
     void Comm::open_ ( ) { throw new IOException ( "Comm::open : to be extended" ); }
     // Close connection and file descriptor ( COMMON )
@@ -314,7 +815,16 @@ namespace comm {
             }
             this->is_connected_ = false;
             this->is_open_ = false;
+            // A descriptor closed under poll does not wake it up, the reader thread is told to look at it again
+            if ( this->reader_event_ >= 0 ) {
+                uint64_t counter = 1;
+                ssize_t written = ::write ( this->reader_event_, &counter, sizeof ( counter ) );
+                (void) written;
+            }
         }
+        this->rx_.clear();
+        this->packet_.clear();
+        if ( this->framer_ ) this->framer_->reset();
     }
     // Connect ( SERIAL )
     void Comm::connect_ ( ) { throw new IOException ( "Comm::connect : to be extended" ); }
@@ -322,51 +832,38 @@ namespace comm {
     void Comm::setOptions_ ( ) { throw new InterfaceException ( "Comm::setOptions : to be extended" ); }
 
 
-    /*! Block until there is comm data to read or read_constant
-    * number of milliseconds have elapsed. The return value is true when
-    * the function exits with the port in a readable state, false otherwise
-    * (due to timeout or select interruption). */
-    int Comm::waitRead_ () {
-        // Setup a select call to block for comm data or a timeout
-        fd_set fd_set_;
-        FD_ZERO ( &fd_set_ );
-        FD_SET ( this->fd_, &fd_set_ );
-        int result = select (fd_ + 1, &fd_set_, NULL, NULL, &(this->timeout_.conn));
-        //std::cout << "WAIT READ 1 : " << result << std::endl;
+    /*! Block until there is comm data to read or the deadline of the call
+    * is reached. The return value is 1 when the function exits with the
+    * port in a readable state, 0 on timeout or interruption, -1 when the
+    * wait failed, the failure is recorded. */
+    int Comm::waitRead_ ( const TimeCheck& deadline ) {
+        uint64_t start = this->timing_.load ( std::memory_order_relaxed ) ? clock_ns() : 0;
+        int result = wait_for ( this->fd_, POLLIN, deadline );
+        if ( start != 0 ) this->read_waited_ += clock_ns() - start;
+        this->read_counters_.add ( Counters::SYSCALLS, 1, result == 0 ? Counters::WAIT_TIMEOUTS : Counters::EINTRS,
+                                   result == 0 || ( result < 0 && errno == EINTR ) ? 1 : 0 );
         if (result < 0) {
-            //std::cout << "WAIT READ 2 : " << errno << std::endl;
-            // Select was interrupted
+            // The wait was interrupted, the caller checks the deadline and waits again
             if (errno == EINTR) return 0;
             // Otherwise there was some error
-            throw new IOException ( "waitRead", errno );
+            this->readError_ ( ERROR_WAIT, "waitRead", errno );
+            return -1;
         }
-        // This shouldn't happen, if r > 0 our fd has to be in the list!
-        if (result > 0 && ! FD_ISSET ( fd_, &fd_set_ ) )
-            throw new IOException (
-                    "Comm::waitRead : select reports ready to read, but our fd isn't in the list, this shouldn't happen!");
-        // Data available to read.
-        //std::cout << "WAIT READ 3" << std::endl;
         return result;
     }
-    int Comm::waitSend_ () {
-        //std::cout << "WAIT SEND 1" << std::endl;
-        // Setup a select call to block for comm data or a timeout
-        fd_set fd_set_;
-        FD_ZERO ( &fd_set_ );
-        FD_SET ( this->fd_, &fd_set_ );
-        int result = select (fd_ + 1, NULL, &fd_set_, NULL, &(this->timeout_.conn));
+    int Comm::waitSend_ ( const TimeCheck& deadline ) {
+        uint64_t start = this->timing_.load ( std::memory_order_relaxed ) ? clock_ns() : 0;
+        int result = wait_for ( this->fd_, POLLOUT, deadline );
+        if ( start != 0 ) this->send_waited_ += clock_ns() - start;
+        this->send_counters_.add ( Counters::SYSCALLS, 1, result == 0 ? Counters::WAIT_TIMEOUTS : Counters::EINTRS,
+                                   result == 0 || ( result < 0 && errno == EINTR ) ? 1 : 0 );
         if (result < 0) {
-            // Select was interrupted
+            // The wait was interrupted, the caller checks the deadline and waits again
             if (errno == EINTR) return 0;
             // Otherwise there was some error
-            throw new IOException ( "waitSend", errno );
+            this->sendError_ ( ERROR_WAIT, "waitSend", errno );
+            return -1;
         }
-        // This shouldn't happen, if r > 0 our fd has to be in the list!
-        if (result > 0 && ! FD_ISSET ( fd_, &fd_set_ ) )
-            throw new IOException (
-                    "Comm::waitSend : select reports ready to send, but our fd isn't in the list, this shouldn't happen!");
-        // Data available to read.
-        //std::cout << "WAIT SEND 2" << std::endl;
         return result;
     }
 
@@ -375,4 +872,310 @@ namespace comm {
     void Comm::flushInput_ ( ) { }
     void Comm::flushOutput_ ( ) { }
 
+    /*=====================================================================================================================
+     * STATS : Counters helpers, the read ones to be called with mtx_read locked, the send ones with mtx_send locked
+     *===================================================================================================================*/
+    // Count a read syscall (read, recv) by its result: the bytes received, or the failure and its errno
+    void Comm::countRead_ ( ssize_t result ) {
+        if ( result > 0 ) this->read_counters_.add ( Counters::SYSCALLS, 1, Counters::BYTES_IN, result );
+        else if ( result < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            this->read_counters_.add ( Counters::SYSCALLS, 1, Counters::EAGAINS, 1 );
+        else if ( result < 0 && errno == EINTR ) this->read_counters_.add ( Counters::SYSCALLS, 1, Counters::EINTRS, 1 );
+        else this->read_counters_.add ( Counters::SYSCALLS );
+    }
+    // Count a send syscall (write, send, sendmsg) by its result: the bytes sent, or the failure and its errno
+    void Comm::countSend_ ( ssize_t result ) {
+        if ( result > 0 ) this->send_counters_.add ( Counters::SYSCALLS, 1, Counters::BYTES_OUT, result );
+        else if ( result < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) )
+            this->send_counters_.add ( Counters::SYSCALLS, 1, Counters::EAGAINS, 1 );
+        else if ( result < 0 && errno == EINTR ) this->send_counters_.add ( Counters::SYSCALLS, 1, Counters::EINTRS, 1 );
+        else this->send_counters_.add ( Counters::SYSCALLS );
+    }
+
+    /*=====================================================================================================================
+     * WRITER : Background writer helpers
+     *===================================================================================================================*/
+    // Queue a frame to the writer thread, return false if there is no writer, queued gets the size or 0 if dropped
+    bool Comm::queue_ ( const View *data, size_t count, size_t& queued ) {
+        if ( ! this->has_writer_ ) return false;
+        {
+            boost::lock_guard<boost::mutex> lock(this->mtx_queue);
+            // Stopped meanwhile, send directly
+            if ( ! this->has_writer_ ) return false;
+            queued = 0;
+            for ( size_t i = 0; i < count; ++i ) queued += data[i].size;
+            if ( ! this->tx_->push ( data, count ) ) {
+                ++this->queue_drops_;
+                queued = 0;
+                return true;
+            }
+        }
+        // Pairs with the fence of the writer thread: either it sees the new data, or this sees it idle and wakes it up
+        std::atomic_thread_fence ( std::memory_order_seq_cst );
+        if ( this->writer_idle_ ) {
+            boost::lock_guard<boost::mutex> lock(this->mtx_writer);
+            this->cnd_writer.notify_one();
+        }
+        return true;
+    }
+    // Writer thread : drain the ring to the resource until stopped
+    void Comm::drain_ ( ) {
+        TxRing& tx = *this->tx_;
+        // Drop every queued byte, return their number
+        auto discard = [&tx] ( ) { size_t size = tx.size(); tx.consume ( size ); return size; };
+        while ( true ) {
+            View regions[2];
+            size_t count = tx.peek ( regions );
+            if ( count == 0 ) {
+                boost::unique_lock<boost::mutex> lock(this->mtx_writer);
+                this->writer_idle_ = true;
+                std::atomic_thread_fence ( std::memory_order_seq_cst );
+                while ( tx.empty() && ! this->writer_stop_ ) this->cnd_writer.wait ( lock );
+                this->writer_idle_ = false;
+                if ( tx.empty() ) return;
+                continue;
+            }
+            // Stopping without draining, the rest is discarded
+            bool stopping = this->writer_stop_;
+            if ( stopping && ! this->writer_drain_ ) { this->queue_discarded_ += discard ( ); return; }
+            struct iovec iov[2];
+            size_t size = 0, sent;
+            for ( size_t i = 0; i < count; ++i ) {
+                iov[i].iov_base = const_cast<uint8_t*> ( regions[i].data );
+                iov[i].iov_len = regions[i].size;
+                size += regions[i].size;
+            }
+            bool failed;
+            {
+                boost::lock_guard<boost::mutex> lock(this->mtx_send);
+                sent = this->sendv_ ( iov, count );
+                failed = this->takeSendError_().code != ERROR_NONE;
+            }
+            tx.consume ( sent );
+            // Nobody is there to report it to, what was queued for the failed resource is discarded
+            if ( failed ) { this->queue_discarded_ += discard ( ); continue; }
+            // A send timed out while draining, the rest is discarded
+            if ( stopping && sent < size ) { this->queue_discarded_ += discard ( ); return; }
+        }
+    }
+
+    /*=====================================================================================================================
+     * READER : Background reader helpers
+     *===================================================================================================================*/
+    // Reader thread : read and queue the frames until stopped, or until the resource closes or fails
+    void Comm::receive_ ( size_t size ) {
+        struct pollfd fds[2];
+        {
+            boost::lock_guard<boost::mutex> lock(this->mtx_read);
+            // Room for a partial frame plus a large read
+            this->rx_.reserve ( size * 2 );
+        }
+        fds[0].events = POLLIN;
+        fds[1].fd = this->reader_event_;
+        fds[1].events = POLLIN;
+        // The thread waits here, not in read_, so that stopReader wakes it up at once
+        while ( true ) {
+            // The descriptor changes when the instance reconnects, until it is connected only the event is waited for
+            {
+                boost::lock_guard<boost::mutex> lock(this->mtx_read);
+                if ( ! this->is_open_ ) break;
+                fds[0].fd = this->is_connected_ ? this->fd_ : -1;
+            }
+            fds[0].revents = 0;
+            if ( ::poll ( fds, 2, -1 ) < 0 ) { if ( errno == EINTR ) continue; break; }
+            if ( fds[1].revents != 0 ) {
+                if ( this->reader_stop_ ) break;
+                // Closed or reconnected, the event is cleared and the descriptor looked up again
+                uint64_t counter;
+                ssize_t cleared = ::read ( this->reader_event_, &counter, sizeof ( counter ) );
+                (void) cleared;
+                continue;
+            }
+            size_t bytes_read, queued;
+            bool failed;
+            {
+                boost::lock_guard<boost::mutex> lock(this->mtx_read);
+                // Reconnected while waiting, the readiness was that of the old descriptor
+                if ( ! this->is_connected_ || this->fd_ != fds[0].fd ) continue;
+                // A single attempt, the device is ready
+                bool blocking = this->read_blocking_;
+                this->read_blocking_ = false;
+                bytes_read = this->fill_ ( 1 );
+                failed = this->takeReadError_().code != ERROR_NONE;
+                this->read_blocking_ = blocking;
+                timespec stamp;
+                clock_gettime ( CLOCK_MONOTONIC, &stamp );
+                queued = this->splitFrames_ ( size, stamp );
+            }
+            // Pairs with the fence of popFrame: either the consumer sees the new frame, or this sees it waiting
+            std::atomic_thread_fence ( std::memory_order_seq_cst );
+            if ( queued > 0 && this->frames_waiting_ > 0 ) {
+                boost::lock_guard<boost::mutex> lock(this->mtx_frames);
+                this->cnd_frames.notify_all();
+            }
+            // Ready but nothing came in, the resource closed or failed
+            if ( bytes_read == 0 || failed ) break;
+        }
+        boost::lock_guard<boost::mutex> lock(this->mtx_frames);
+        this->has_reader_ = false;
+        this->cnd_frames.notify_all();
+    }
+    // Queue the complete frames of the read-ahead buffer (and those longer than size), return their number
+    size_t Comm::splitFrames_ ( size_t size, const timespec& stamp ) {
+        SpscQueue<Frame>& frames = *this->frames_;
+        const uint8_t* eol_ = reinterpret_cast<const uint8_t*>(this->eol_.data());
+        size_t queued = 0;
+        // Framed packets are decoded frame by frame, their storage is swapped with the slot's
+        while ( this->framer_ && ! this->rx_.empty() ) {
+            bool complete;
+            size_t skipped, length = this->framer_->delimit ( this->rx_.data(), this->rx_.size(), size, skipped );
+            // A frame delimited in place is copied once, out of the buffer, the others are decoded
+            if ( length != string::npos ) {
+                this->rx_.consume ( skipped );
+                if ( length == 0 || length > this->rx_.size() ) { if ( skipped > 0 ) continue; break; }
+                this->packet_.assign ( reinterpret_cast<const char*> ( this->rx_.data() ), length );
+                this->rx_.consume ( length );
+            } else {
+                this->rx_.consume ( this->framer_->decode ( this->rx_.data(), this->rx_.size(), this->packet_, size,
+                                                            complete ) );
+                if ( ! complete ) break;
+            }
+            Frame* frame = frames.slot();
+            if ( frame == NULL ) ++this->frame_drops_;
+            else {
+                frame->data.swap ( this->packet_ );
+                frame->stamp = stamp;
+                frames.push();
+                ++queued;
+            }
+            this->packet_.clear();
+        }
+        while ( ! this->framer_ && ! this->rx_.empty() ) {
+            size_t available = std::min ( size, this->rx_.size() ), length = available;
+            if ( this->eol_len_ > 0 ) {
+                size_t end_of_line = find_eol ( this->rx_.data(), available, eol_, this->eol_len_ );
+                if ( end_of_line != available ) length = end_of_line + this->eol_len_;
+                // A partial frame waits for the rest
+                else if ( available < size ) break;
+            }
+            Frame* frame = frames.slot();
+            if ( frame == NULL ) ++this->frame_drops_;
+            else {
+                frame->data.assign ( reinterpret_cast<const char*> ( this->rx_.data() ), length );
+                frame->stamp = stamp;
+                frames.push();
+                ++queued;
+            }
+            this->rx_.consume ( length );
+        }
+        return queued;
+    }
+
+    /*=====================================================================================================================
+     * BUFFER : Read-ahead buffer helpers, to be called with mtx_read locked
+     *===================================================================================================================*/
+    // Fill the read-ahead buffer with at least least bytes (or until timeout), return the number of bytes read
+    size_t Comm::fill_ ( size_t least ) {
+        // Data is received by an external engine, there is nothing to read here
+        if ( this->is_driven_ ) return 0;
+        this->rx_.prepare ( least );
+        // Ask for the whole free space, whatever is already available comes in with the same call
+        size_t bytes_read = timed_io ( this->timing_, this->read_io_, [&] {
+            return this->read_ ( this->rx_.tail(), this->rx_.space(), least ); } );
+        this->rx_.commit ( bytes_read );
+        return bytes_read;
+    }
+    // Append data received by an external engine (comm::Uring) to the read-ahead buffer
+    void Comm::feed_ ( const uint8_t *data, size_t size ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        this->rx_.prepare ( size );
+        std::memcpy ( this->rx_.tail(), data, size );
+        this->rx_.commit ( size );
+    }
+    // Read a fixed size of char, serving buffered data first, return the number of bytes read
+    size_t Comm::take_ ( uint8_t *data, size_t size ) {
+        size_t bytes_read = this->rx_.take ( data, size );
+        if ( bytes_read == size ) return bytes_read;
+        size_t missing = size - bytes_read;
+        // Large reads go straight to the destination, small ones are served through the buffer to read ahead
+        if ( missing >= this->rx_.capacity() && ! this->is_driven_ )
+            return bytes_read + timed_io ( this->timing_, this->read_io_, [&] {
+                return this->read_ ( data + bytes_read, missing, missing ); } );
+        this->fill_ ( missing );
+        return bytes_read + this->rx_.take ( data + bytes_read, missing );
+    }
+    // Buffer up to size bytes, stop when a read times out, return the number of bytes buffered, up to size
+    size_t Comm::fillUpTo_ ( size_t size ) {
+        this->rx_.reserve ( size );
+        while ( this->rx_.size() < size )
+            if ( this->fill_ ( size - this->rx_.size() ) == 0 || this->read_error_ ) break; // Timeout occured, or failure
+        return std::min ( size, this->rx_.size() );
+    }
+    // Buffer up to size bytes, replace lines with a view per line (the last one may lack the eol), return the size
+    size_t Comm::splitLines_ ( vector<View>& lines, size_t size ) {
+        lines.clear();
+        size_t read_so_far = this->fillUpTo_ ( size );
+        const uint8_t* buffer_ = this->rx_.data();
+        const uint8_t* eol_ = reinterpret_cast<const uint8_t*>(this->eol_.data());
+        size_t start_of_line = 0;
+        while ( start_of_line < read_so_far ) {
+            size_t end_of_line = start_of_line + find_eol ( buffer_ + start_of_line, read_so_far - start_of_line,
+                                                            eol_, this->eol_len_ );
+            // No more EOL, the rest is a partial line, in non blocking mode it is kept for the next call
+            if ( end_of_line == read_so_far && ! this->read_blocking_ && read_so_far < size ) return start_of_line;
+            end_of_line = end_of_line == read_so_far ? read_so_far : end_of_line + this->eol_len_;
+            lines.push_back ( View ( buffer_ + start_of_line, end_of_line - start_of_line ) );
+            start_of_line = end_of_line;
+        }
+        return read_so_far;
+    }
+    // Find the length of the next line in the buffer (eol included), reading more data if needed, up to size bytes
+    size_t Comm::scanLine_ ( size_t size ) {
+        this->rx_.reserve ( size );
+        const uint8_t* eol_ = reinterpret_cast<const uint8_t*>(this->eol_.data());
+        size_t scanned = 0;
+        while ( true ) {
+            size_t available = std::min ( size, this->rx_.size() );
+            // Scan only the new bytes, plus the tail of the old ones that may hold the start of the EOL
+            if ( this->eol_len_ > 0 && available >= this->eol_len_ ) {
+                size_t end_of_line = scanned + find_eol ( this->rx_.data() + scanned, available - scanned,
+                                                          eol_, this->eol_len_ );
+                if ( end_of_line != available ) // EOL found
+                    return end_of_line + this->eol_len_;
+                scanned = available - this->eol_len_ + 1;
+            }
+            // Reached the maximum line length, or a timeout occured, in non blocking mode a partial line is kept
+            if ( available == size ) return available;
+            if ( this->fill_ ( 1 ) == 0 || this->read_error_ ) return this->read_blocking_ ? available : 0;
+        }
+    }
+    // Decode the buffer into the packet, reading more data if needed, return true once a frame is complete
+    bool Comm::scanFrame_ ( size_t size ) {
+        bool complete = false;
+        while ( true ) {
+            // Decode up to the end of the next frame, the rest stays buffered, a partial frame stays in the packet
+            if ( ! this->rx_.empty() ) {
+                this->rx_.consume ( this->framer_->decode ( this->rx_.data(), this->rx_.size(), this->packet_, size,
+                                                            complete ) );
+                if ( complete ) return true;
+            }
+            // A timeout occured, or the resource failed
+            if ( this->fill_ ( 1 ) == 0 || this->read_error_ ) return false;
+        }
+    }
+    // Find the length of the next frame at the head of the buffer, reading the rest of it if needed, 0 if none came in
+    size_t Comm::delimitFrame_ ( size_t size ) {
+        while ( true ) {
+            size_t skipped, length = this->framer_->delimit ( this->rx_.data(), this->rx_.size(), size, skipped );
+            if ( length == string::npos ) return length;
+            this->rx_.consume ( skipped );
+            if ( length > 0 && length <= this->rx_.size() ) return length;
+            // Dropped frames were skipped, the next one may already be buffered after them
+            if ( skipped > 0 && ! this->rx_.empty() ) continue;
+            // Once the header tells the size of the frame, the rest of it is read at once
+            size_t missing = length > this->rx_.size() ? length - this->rx_.size() : 1;
+            if ( this->fill_ ( missing ) == 0 || this->read_error_ ) return 0; // Timeout occured, or failure
+        }
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,312 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file crc.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/crc.h>
+// STD
+#include <algorithm>
+#include <cstring>
+// SIMD
+#if defined(__x86_64__)
+#define COMM_CRC_X86
+#include <immintrin.h>
+#endif
+
+namespace comm {
+
+    /*=========================================================================================================================
+     * TABLES : Slice-by-8 tables generated at compile time, table[k][b] is the CRC of byte b followed by k zero bytes
+     *=======================================================================================================================*/
+    // Reflect the lowest width bits of value
+    static constexpr uint32_t crc_reflect ( uint32_t value, unsigned width ) {
+        return width == 0 ? 0 : ( ( value & 1 ) << ( width - 1 ) ) | crc_reflect ( value >> 1, width - 1 );
+    }
+    // Shift bits bits through the register, least significant first if reflected, most significant first otherwise
+    static constexpr uint32_t crc_bits ( uint32_t crc, uint32_t poly, bool reflected, unsigned bits ) {
+        return bits == 0 ? crc : crc_bits ( reflected ? ( crc & 1 ? ( crc >> 1 ) ^ poly : crc >> 1 )
+                                                      : ( crc & 0x80000000u ? ( crc << 1 ) ^ poly : crc << 1 ),
+                                            poly, reflected, bits - 1 );
+    }
+    // CRC of a single byte
+    static constexpr uint32_t crc_byte ( uint32_t byte, uint32_t poly, bool reflected ) {
+        return crc_bits ( reflected ? byte : byte << 24, poly, reflected, 8 );
+    }
+    // CRC of crc followed by a zero byte
+    static constexpr uint32_t crc_zero ( uint32_t crc, uint32_t poly, bool reflected ) {
+        return reflected ? ( crc >> 8 ) ^ crc_byte ( crc & 0xFF, poly, reflected )
+                         : ( crc << 8 ) ^ crc_byte ( crc >> 24, poly, reflected );
+    }
+    // Entry of the slice table
+    static constexpr uint32_t crc_entry ( unsigned slice, uint32_t byte, uint32_t poly, bool reflected ) {
+        return slice == 0 ? crc_byte ( byte, poly, reflected )
+                          : crc_zero ( crc_entry ( slice - 1, byte, poly, reflected ), poly, reflected );
+    }
+
+    // Indices 0 to N-1, to expand the entries of a slice
+    template <size_t... I> struct CrcIndices { };
+    template <size_t N, size_t... I> struct CrcMakeIndices : CrcMakeIndices<N - 1, N - 1, I...> { };
+    template <size_t... I> struct CrcMakeIndices<0, I...> { typedef CrcIndices<I...> type; };
+
+    // Slice-by-8 table
+    struct CrcSlices { uint32_t table[8][256]; };
+
+    template <size_t... I>
+    static constexpr CrcSlices crc_slices ( uint32_t poly, bool reflected, CrcIndices<I...> ) {
+        return CrcSlices { { { crc_entry ( 0, I, poly, reflected )... }, { crc_entry ( 1, I, poly, reflected )... },
+                             { crc_entry ( 2, I, poly, reflected )... }, { crc_entry ( 3, I, poly, reflected )... },
+                             { crc_entry ( 4, I, poly, reflected )... }, { crc_entry ( 5, I, poly, reflected )... },
+                             { crc_entry ( 6, I, poly, reflected )... }, { crc_entry ( 7, I, poly, reflected )... } } };
+    }
+
+    // Table of a polynomial of width bits, the register is kept right aligned if reflected, left aligned otherwise
+    template <unsigned Width, uint32_t Poly, bool Reflected>
+    struct CrcTable {
+        static constexpr uint32_t poly = Reflected ? crc_reflect ( Poly, Width ) : Poly << ( 32 - Width );
+        static constexpr CrcSlices slices = crc_slices ( poly, Reflected, typename CrcMakeIndices<256>::type() );
+    };
+    template <unsigned Width, uint32_t Poly, bool Reflected>
+    constexpr CrcSlices CrcTable<Width, Poly, Reflected>::slices;
+
+    static_assert ( CrcTable<32, 0x04C11DB7, true>::slices.table[0][1] == 0x77073096, "CRC-32 table" );
+    static_assert ( CrcTable<16, 0x1021, false>::slices.table[0][1] == 0x10210000, "CRC-16/CCITT table" );
+
+    /*=========================================================================================================================
+     * SLICE-BY-8 : Eight bytes per step, one lookup per byte in eight independent tables
+     *=======================================================================================================================*/
+    static inline uint32_t load_le32 ( const uint8_t *data ) {
+        return data[0] | data[1] << 8 | data[2] << 16 | static_cast<uint32_t> ( data[3] ) << 24;
+    }
+    static inline uint32_t load_be32 ( const uint8_t *data ) {
+        return static_cast<uint32_t> ( data[0] ) << 24 | data[1] << 16 | data[2] << 8 | data[3];
+    }
+
+    // Reflected models, the register is right aligned and the bytes enter from the bottom
+    static uint32_t update_reflected ( const uint32_t (*table)[256], uint32_t crc, const uint8_t *data, size_t size ) {
+        for ( ; size >= 8; data += 8, size -= 8 ) {
+            uint32_t one = crc ^ load_le32 ( data ), two = load_le32 ( data + 4 );
+            crc = table[7][one & 0xFF] ^ table[6][( one >> 8 ) & 0xFF] ^ table[5][( one >> 16 ) & 0xFF] ^
+                  table[4][one >> 24] ^ table[3][two & 0xFF] ^ table[2][( two >> 8 ) & 0xFF] ^
+                  table[1][( two >> 16 ) & 0xFF] ^ table[0][two >> 24];
+        }
+        for ( ; size > 0; ++data, --size ) crc = ( crc >> 8 ) ^ table[0][( crc ^ *data ) & 0xFF];
+        return crc;
+    }
+
+    // Normal models, the register is left aligned and the bytes enter from the top
+    static uint32_t update_normal ( const uint32_t (*table)[256], uint32_t crc, const uint8_t *data, size_t size ) {
+        for ( ; size >= 8; data += 8, size -= 8 ) {
+            uint32_t one = crc ^ load_be32 ( data ), two = load_be32 ( data + 4 );
+            crc = table[7][one >> 24] ^ table[6][( one >> 16 ) & 0xFF] ^ table[5][( one >> 8 ) & 0xFF] ^
+                  table[4][one & 0xFF] ^ table[3][two >> 24] ^ table[2][( two >> 16 ) & 0xFF] ^
+                  table[1][( two >> 8 ) & 0xFF] ^ table[0][two & 0xFF];
+        }
+        for ( ; size > 0; ++data, --size ) crc = ( crc << 8 ) ^ table[0][( crc >> 24 ) ^ *data];
+        return crc;
+    }
+
+    /*=========================================================================================================================
+     * SSE4.2 : The crc32 instruction computes CRC-32C, eight bytes per instruction
+     *=======================================================================================================================*/
+#ifdef COMM_CRC_X86
+    __attribute__((target("sse4.2")))
+    static uint32_t update_crc32c_sse42 ( const uint32_t (*)[256], uint32_t crc, const uint8_t *data, size_t size ) {
+        uint64_t crc64 = crc;
+        for ( ; size >= 8; data += 8, size -= 8 ) {
+            uint64_t word;
+            std::memcpy ( &word, data, 8 );
+            crc64 = _mm_crc32_u64 ( crc64, word );
+        }
+        crc = static_cast<uint32_t> ( crc64 );
+        for ( ; size > 0; ++data, --size ) crc = _mm_crc32_u8 ( crc, *data );
+        return crc;
+    }
+#endif
+
+    /*=========================================================================================================================
+     * CRC
+     *=======================================================================================================================*/
+    Crc::Crc ( CrcModel model, bool hardware ) : width_(16), reflected_(false), init_(0), xorout_(0) {
+        switch ( model ) {
+            case CRC16_CCITT_FALSE:
+                this->init_ = 0xFFFF;  // Same polynomial as XMODEM
+                /* FALLTHROUGH */
+            case CRC16_XMODEM: this->table_ = CrcTable<16, 0x1021, false>::slices.table; break;
+            case CRC16_KERMIT: this->reflected_ = true; this->table_ = CrcTable<16, 0x1021, true>::slices.table; break;
+            case CRC16_MODBUS:
+                this->reflected_ = true; this->init_ = 0xFFFF;
+                this->table_ = CrcTable<16, 0x8005, true>::slices.table; break;
+            case CRC32:
+                this->width_ = 32; this->reflected_ = true; this->init_ = this->xorout_ = 0xFFFFFFFF;
+                this->table_ = CrcTable<32, 0x04C11DB7, true>::slices.table; break;
+            case CRC32C:
+                this->width_ = 32; this->reflected_ = true; this->init_ = this->xorout_ = 0xFFFFFFFF;
+                this->table_ = CrcTable<32, 0x1EDC6F41, true>::slices.table; break;
+            default:
+                throw new invalid_argument ( "Crc::Crc : unknown model" );
+        }
+        // The register of the normal models is left aligned
+        if ( ! this->reflected_ ) this->init_ <<= 32 - this->width_;
+        this->update_ = this->reflected_ ? &update_reflected : &update_normal;
+#ifdef COMM_CRC_X86
+        if ( model == CRC32C && hardware && __builtin_cpu_supports ( "sse4.2" ) ) this->update_ = &update_crc32c_sse42;
+#endif
+    }
+
+    // HARDWARE : True if the checksum is computed by the CRC instruction of the CPU
+    bool Crc::hardware ( ) const {
+#ifdef COMM_CRC_X86
+        return this->update_ == &update_crc32c_sse42;
+#else
+        return false;
+#endif
+    }
+
+    // FINISH (state) -> crc : Checksum out of its state
+    uint32_t Crc::finish ( uint32_t state ) const {
+        return ( this->reflected_ ? state : state >> ( 32 - this->width_ ) ) ^ this->xorout_;
+    }
+
+    // STORE (crc,data) : Write the checksum in size bytes, in its order on the wire
+    void Crc::store ( uint32_t crc, uint8_t *data ) const {
+        size_t size = this->size();
+        for ( size_t i = 0; i < size; ++i )
+            data[this->reflected_ ? i : size - 1 - i] = static_cast<uint8_t> ( crc >> ( 8 * i ) );
+    }
+
+    // LOAD (data) -> crc : Read a checksum written in its order on the wire
+    uint32_t Crc::load ( const uint8_t *data ) const {
+        size_t size = this->size();
+        uint32_t crc = 0;
+        for ( size_t i = 0; i < size; ++i )
+            crc |= static_cast<uint32_t> ( data[this->reflected_ ? i : size - 1 - i] ) << ( 8 * i );
+        return crc;
+    }
+
+    /*=========================================================================================================================
+     * CHECKSUM : The checksum follows the bytes as the framer produces them
+     *=======================================================================================================================*/
+    Checksum::Checksum ( const boost::shared_ptr<Framer>& framer, CrcModel model ) :
+            framer_(framer), crc_(model), state_(crc_.begin()), checked_(0) {
+        if ( ! framer ) throw new invalid_argument ( "Checksum::Checksum : no framer" );
+    }
+
+    // ENCODE (data,count,frame) : Append to frame the frame of a packet made of count buffers, with its checksum
+    void Checksum::encode ( const View *data, size_t count, string& frame ) const {
+        size_t size = this->crc_.size();
+        // The packet is the frame: encode it, then checksum the frame and fill the room left at its end
+        if ( this->framer_->inPlace() ) {
+            size_t start = frame.size();
+            this->framer_->encode ( data, count, frame );
+            if ( frame.size() - start < size )
+                throw new invalid_argument ( "Checksum::encode : the packet leaves no room for the checksum" );
+            uint8_t *end = reinterpret_cast<uint8_t*> ( &frame[0] ) + frame.size() - size;
+            this->crc_.store ( this->crc_.compute ( end - ( frame.size() - start - size ), frame.size() - start - size ),
+                               end );
+            return;
+        }
+        // The checksum of the packet is appended to it, a buffer more for the framer
+        uint32_t state = this->crc_.begin();
+        for ( size_t i = 0; i < count; ++i ) state = this->crc_.update ( state, data[i].data, data[i].size );
+        uint8_t trailer[4];
+        this->crc_.store ( this->crc_.finish ( state ), trailer );
+        static thread_local std::vector<View> parts;
+        parts.assign ( data, data + count );
+        parts.push_back ( View ( trailer, size ) );
+        this->framer_->encode ( &parts[0], parts.size(), frame );
+    }
+
+    // DECODE (data,size,packet,limit,complete) -> size : Decode data up to the end of the next packet with a good checksum
+    size_t Checksum::decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete ) {
+        size_t trailer = this->crc_.size(), used = 0;
+        bool in_place = this->framer_->inPlace();
+        complete = false;
+        while ( used < size ) {
+            if ( ! this->started_ ) {
+                this->begin_ ( packet );
+                this->state_ = this->crc_.begin();
+                this->checked_ = this->base_;
+            }
+            size_t dropped = this->framer_->dropped();
+            bool done;
+            used += this->framer_->decode ( data + used, size - used, packet, in_place ? limit : limit + trailer, done );
+            // A packet dropped by the framer is forgotten, what follows the start of the packet belongs to the next one
+            if ( this->framer_->dropped() != dropped || packet.size() < this->checked_ ) {
+                this->state_ = this->crc_.begin();
+                this->checked_ = this->base_;
+            }
+            // The bytes are checked as they come in, all but the last ones, that may be the checksum
+            size_t end = std::max ( this->checked_, packet.size() > this->base_ + trailer ? packet.size() - trailer
+                                                                                        : this->base_ );
+            this->state_ = this->crc_.update ( this->state_, reinterpret_cast<const uint8_t*> ( packet.data() ) +
+                                               this->checked_, end - this->checked_ );
+            this->checked_ = end;
+            if ( ! done ) continue;
+            this->started_ = false;
+            if ( packet.size() >= this->base_ + trailer && this->crc_.finish ( this->state_ ) ==
+                    this->crc_.load ( reinterpret_cast<const uint8_t*> ( packet.data() ) + packet.size() - trailer ) ) {
+                if ( ! in_place ) packet.resize ( packet.size() - trailer );
+                complete = true;
+                break;
+            }
+            // Too short for a checksum, or a wrong one
+            packet.resize ( this->base_ );
+            ++this->dropped_;
+        }
+        return used;
+    }
+
+    // DELIMIT (data,size,limit,skipped) -> size : Size of the next frame with a good checksum in place
+    size_t Checksum::delimit ( const uint8_t *data, size_t size, size_t limit, size_t& skipped ) {
+        size_t trailer = this->crc_.size();
+        skipped = 0;
+        while ( true ) {
+            size_t skipped_now, length = this->framer_->delimit ( data + skipped, size - skipped, limit, skipped_now );
+            if ( length == string::npos ) return length;
+            // Bytes were skipped, the frame after them is a new one
+            if ( skipped_now > 0 ) {
+                skipped += skipped_now;
+                this->state_ = this->crc_.begin();
+                this->checked_ = 0;
+            }
+            if ( length == 0 ) return 0;
+            // The bytes are checked as they come in, the checksum excluded
+            const uint8_t *frame = data + skipped;
+            size_t end = std::min ( size - skipped, length > trailer ? length - trailer : 0 );
+            if ( end > this->checked_ ) {
+                this->state_ = this->crc_.update ( this->state_, frame + this->checked_, end - this->checked_ );
+                this->checked_ = end;
+            }
+            if ( length > size - skipped ) return length;
+            // The frame is all there, it is checked once more if delimited again
+            uint32_t crc = this->crc_.finish ( this->state_ );
+            this->state_ = this->crc_.begin();
+            this->checked_ = 0;
+            if ( length >= trailer && this->crc_.load ( frame + length - trailer ) == crc ) return length;
+            // Too short for a checksum, or a wrong one
+            ++this->dropped_;
+            skipped += length;
+        }
+    }
+
+    // RESET : Forget the packet being decoded
+    void Checksum::reset ( ) {
+        Framer::reset();
+        this->framer_->reset();
+        this->state_ = this->crc_.begin();
+        this->checked_ = 0;
+    }
+
+}
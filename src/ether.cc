@@ -16,68 +16,158 @@
  * HEADER
  *===========================================================================================================================*/
 #include <comm/ether.h>
+// SYS
+#include <poll.h>
+#include <netinet/tcp.h>
 
 namespace comm {
 
-    Ether::Ether ( const string& address, uint16_t port, const string& eol, Timeout timeout ) : Comm(address,eol,timeout) {
+    // Set an integer socket option, false if it needs privileges the process lacks, throw on any other failure
+    static bool set_socket_option ( int fd, int level, int name, int value, const char *where ) {
+        if ( ::setsockopt ( fd, level, name, &value, sizeof ( value ) ) == 0 ) return true;
+        if ( errno == EPERM || errno == EACCES ) return false;
+        throw new InterfaceException ( where, errno );
+    }
+    // Send the ACK of the data just read at once, the kernel falls back to delayed ACKs on its own so this follows every
+    // read that got data
+    static inline void quick_ack ( int fd ) {
+        int value = 1;
+        ::setsockopt ( fd, IPPROTO_TCP, TCP_QUICKACK, &value, sizeof ( value ) );
+    }
+    // Get an integer socket option, 0 if it cannot be read
+    static int get_socket_option ( int fd, int level, int name ) {
+        int value = 0;
+        socklen_t length = sizeof ( value );
+        if ( ::getsockopt ( fd, level, name, &value, &length ) < 0 ) return 0;
+        return value;
+    }
+
+    Ether::Ether ( const string& address, uint16_t port, const string& eol, Timeout timeout, SocketOptions options ) :
+            Comm(address,eol,timeout), options_(options) {
         this->port_ = port;
         this->sockaddr_in_.sin_family = AF_INET;
         this->open();
     }
 
     // Read common function
-    size_t Ether::read_ (uint8_t *data, size_t size) {
-        // If the connection is not open and connected, throw
-        if ( ! ( this->is_open_ && this->is_connected_ ) ) throw new ConnectionException ("Ether::read : not connected");
+    size_t Ether::read_ (uint8_t *data, size_t size, size_t least) {
+        // If the connection is not open and connected, fail
+        if ( ! ( this->is_open_ && this->is_connected_ ) )
+            return this->readError_ ( ERROR_NOT_CONNECTED, "Ether::read : not connected" );
         // Pre-fill buffer with available bytes
         ssize_t bytes_read_now = ::recv ( this->fd_, data, size, MSG_DONTWAIT );
+        this->countRead_ ( bytes_read_now );
+        if ( this->options_.quick_ack && bytes_read_now > 0 ) quick_ack ( this->fd_ );
+        // No data from a readable socket, the peer closed the connection
+        if ( bytes_read_now == 0 && size > 0 )
+            return this->readError_ ( ERROR_DISCONNECTED, "Ether::read : the peer closed the connection" );
         size_t bytes_read = bytes_read_now > 0 ? bytes_read_now : 0;
-        // Prepare timeout value : now + read + byte*size
-        TimeCheck timeout ( this->timeout_.read, this->timeout_.byte, size );
-        // Read until the desired size is read, there's nothing left to read or timeout expires
-        while ( bytes_read < size ) {
-            // If the timeout expired or i read no data in the last cycle break the reading loop
-            if ( timeout.expired() || bytes_read_now == 0 ) break;
-            // Wait for the device to be readable, otherwise check again on the next loop
-            if ( this->waitRead_() < 1 ) continue;
+        // Prepare timeout value : now + read + byte*least
+        TimeCheck timeout ( this->timeout_.read, this->timeout_.byte, least );
+        // Read until at least the desired size is read, there's nothing left to read or timeout expires
+        while ( bytes_read < least ) {
+            // If the timeout expired, i read no data in the last cycle or the socket is in non blocking mode break the loop
+            if ( ! this->read_blocking_ || timeout.expired() || bytes_read_now == 0 ) break;
+            // Wait for the device to be readable, until the deadline, stop if the wait failed
+            int ready = this->waitRead_ ( timeout );
+            if ( ready < 0 ) break;
+            if ( ready == 0 ) continue;
             // Read new available bytes
             bytes_read_now = ::recv (this->fd_, data + bytes_read, size - bytes_read, MSG_DONTWAIT );
+            this->countRead_ ( bytes_read_now );
+            if ( this->options_.quick_ack && bytes_read_now > 0 ) quick_ack ( this->fd_ );
             // retry if interrupted
             if ( bytes_read_now == -1 && errno == EINTR) continue;
             // At least 1 byte should always be read
             if ( bytes_read_now < 1 )
-                throw new InterfaceException (
-                        "Ether::read : device reports readiness to read but returned no data, disconnected?", errno);
+                return this->readError_ ( ERROR_DISCONNECTED,
+                        "Ether::read : device reports readiness to read but returned no data, disconnected?",
+                        errno, bytes_read );
             bytes_read += bytes_read_now;
         }
+        if ( bytes_read < least ) this->read_counters_.add ( Counters::PARTIAL_READS );
         return bytes_read;
     }
 
     // Send common function
     size_t Ether::send_ (const uint8_t *data, size_t size) {
-        // If the connection is not open and connected, throw
-        if ( ! ( this->is_open_ && this->is_connected_ ) ) throw new ConnectionException ("Ether::send : not connected");
+        // If the connection is not open and connected, fail
+        if ( ! ( this->is_open_ && this->is_connected_ ) )
+            return this->sendError_ ( ERROR_NOT_CONNECTED, "Ether::send : not connected" );
         // Prepare return variables
-        ssize_t bytes_sent_now = ::send ( this->fd_, data, size, 0 );
+        ssize_t bytes_sent_now = ::send ( this->fd_, data, size, this->send_blocking_ ? 0 : MSG_DONTWAIT );
+        this->countSend_ ( bytes_sent_now );
         size_t bytes_sent = bytes_sent_now > 0 ? bytes_sent_now : 0;
         // Prepare timeout value : now + send + byte*size
         TimeCheck timeout ( this->timeout_.send, this->timeout_.byte, size );
         // Send until the desired size is sent or timeout expires
         while ( bytes_sent < size ) {
-            // If the timeout expired break the reading loop
-            if ( timeout.expired() ) break;
-            // Wait for the device to be ready to receive, otherwise check again on the next loop
-            if ( this->waitSend_() < 1 ) continue;
+            // If the timeout expired or the socket is in non blocking mode break the reading loop
+            if ( ! this->send_blocking_ || timeout.expired() ) break;
+            // Wait for the device to be ready to receive, until the deadline, stop if the wait failed
+            int ready = this->waitSend_ ( timeout );
+            if ( ready < 0 ) break;
+            if ( ready == 0 ) continue;
             // Send more byets
             bytes_sent_now = ::send (fd_, data + bytes_sent, size - bytes_sent, MSG_MORE );
+            this->countSend_ ( bytes_sent_now );
             // retry if interrupted
             if ( bytes_sent_now == -1 && errno == EINTR) continue;
             // at least 1 byte should always be sent
             if (bytes_sent_now < 1)
-                throw new InterfaceException (
-                        "Ether::send : device reports readiness to receive but returned no data, disconnected?", errno);
+                return this->sendError_ ( ERROR_DISCONNECTED,
+                        "Ether::send : device reports readiness to receive but returned no data, disconnected?",
+                        errno, bytes_sent );
             bytes_sent += bytes_sent_now;
         }
+        if ( bytes_sent < size ) this->send_counters_.add ( Counters::PARTIAL_SENDS );
+        return bytes_sent;
+    }
+
+    // Send vectored common function
+    size_t Ether::sendv_ (struct iovec *iov, size_t count) {
+        // If the connection is not open and connected, fail
+        if ( ! ( this->is_open_ && this->is_connected_ ) )
+            return this->sendError_ ( ERROR_NOT_CONNECTED, "Ether::send : not connected" );
+        // Prepare the message header and the total size
+        struct msghdr message;
+        std::memset ( &message, 0, sizeof ( message ) );
+        size_t size = 0;
+        for ( size_t i = 0; i < count; ++i ) size += iov[i].iov_len;
+        // Prepare return variables
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t bytes_sent_now = ::sendmsg ( this->fd_, &message, this->send_blocking_ ? 0 : MSG_DONTWAIT );
+        this->countSend_ ( bytes_sent_now );
+        size_t bytes_sent = bytes_sent_now > 0 ? bytes_sent_now : 0;
+        message.msg_iovlen = advance_iovec ( iov, count, bytes_sent );
+        message.msg_iov = iov;
+        // Prepare timeout value : now + send + byte*size
+        TimeCheck timeout ( this->timeout_.send, this->timeout_.byte, size );
+        // Send until the desired size is sent or timeout expires
+        while ( bytes_sent < size ) {
+            // If the timeout expired or the socket is in non blocking mode break the reading loop
+            if ( ! this->send_blocking_ || timeout.expired() ) break;
+            // Wait for the device to be ready to receive, until the deadline, stop if the wait failed
+            int ready = this->waitSend_ ( timeout );
+            if ( ready < 0 ) break;
+            if ( ready == 0 ) continue;
+            // Send more bytes, starting from the first buffer not sent in full
+            bytes_sent_now = ::sendmsg ( this->fd_, &message, 0 );
+            this->countSend_ ( bytes_sent_now );
+            // retry if interrupted
+            if ( bytes_sent_now == -1 && errno == EINTR) continue;
+            // at least 1 byte should always be sent
+            if (bytes_sent_now < 1)
+                return this->sendError_ ( ERROR_DISCONNECTED,
+                        "Ether::send : device reports readiness to receive but returned no data, disconnected?",
+                        errno, bytes_sent );
+            // Update bytes_sent and skip the buffers already sent
+            bytes_sent += bytes_sent_now;
+            message.msg_iovlen = advance_iovec ( iov, message.msg_iovlen, bytes_sent_now );
+            message.msg_iov = iov;
+        }
+        if ( bytes_sent < size ) this->send_counters_.add ( Counters::PARTIAL_SENDS );
         return bytes_sent;
     }
 
@@ -104,16 +194,21 @@ namespace comm {
             return;
         // Set socket address
         set_address ( &(this->address_), this->port_, &(this->sockaddr_in_) );
+        // Tune the socket before the handshake, the window scale follows the receive buffer
+        this->applySocketOptions_ ( );
         // UNLOCK
         set_options ( this->fd_, get_options(this->fd_) | O_NONBLOCK );
         // Trying to connect
         if ( ::connect( this->fd_, (struct sockaddr *) & ( this->sockaddr_in_ ), sizeof ( this->sockaddr_in_ ) ) < 0 )
             switch ( errno ) {
                 case EINPROGRESS: {
-                    fd_set fd_set_;
-                    FD_ZERO ( &fd_set_ );
-                    FD_SET ( this->fd_, &fd_set_ );
-                    int result = select ( this->fd_+1, NULL, &fd_set_, NULL, & ( this->timeout_.conn ) );
+                    // Wait for the connection to be writable, for any descriptor number and on a copy of the timeout
+                    struct pollfd ready = { this->fd_, POLLOUT, 0 };
+                    TimeCheck deadline ( this->timeout_.conn, timeval(), 0 );
+                    timespec left = deadline.left();
+                    int result;
+                    while ( ( result = ::ppoll ( &ready, 1, &left, NULL ) ) < 0 && errno == EINTR && ! deadline.expired() )
+                        left = deadline.left();
                     if ( result < 1 )
                         throw new InterfaceException ( "Ether::connect : connection error", errno );
                 } break;
@@ -145,4 +240,51 @@ namespace comm {
             throw new InterfaceException ( "Ether::setOptions : select socket", result );
     }
 
-}
\ No newline at end of file
+
+    // SET SOCKET OPTIONS : Set the tuning of the socket, applied at once to an open socket
+    void Ether::setSocketOptions ( const SocketOptions& options ) {
+        boost::lock_guard<boost::mutex> lock_read(this->mtx_read);
+        boost::lock_guard<boost::mutex> lock_send(this->mtx_send);
+        this->options_ = options;
+        if ( this->is_open_ ) this->applySocketOptions_ ( );
+    }
+    // Apply the socket options and read them back, those left to their default are not set unless the socket has them
+    // from an earlier call
+    void Ether::applySocketOptions_ ( ) {
+        const SocketOptions& options = this->options_;
+        if ( options.no_delay || this->applied_.no_delay )
+            set_socket_option ( this->fd_, IPPROTO_TCP, TCP_NODELAY, options.no_delay,
+                                "Ether::setSocketOptions : TCP_NODELAY" );
+        // Clearing TCP_QUICKACK would switch a fresh socket to delayed ACKs, it is only ever set
+        if ( options.quick_ack )
+            set_socket_option ( this->fd_, IPPROTO_TCP, TCP_QUICKACK, 1, "Ether::setSocketOptions : TCP_QUICKACK" );
+#ifdef SO_BUSY_POLL
+        if ( options.busy_poll > 0 )
+            set_socket_option ( this->fd_, SOL_SOCKET, SO_BUSY_POLL, options.busy_poll,
+                                "Ether::setSocketOptions : SO_BUSY_POLL" );
+#endif
+        if ( options.receive_buffer > 0 )
+            set_socket_option ( this->fd_, SOL_SOCKET, SO_RCVBUF, options.receive_buffer,
+                                "Ether::setSocketOptions : SO_RCVBUF" );
+        if ( options.send_buffer > 0 )
+            set_socket_option ( this->fd_, SOL_SOCKET, SO_SNDBUF, options.send_buffer,
+                                "Ether::setSocketOptions : SO_SNDBUF" );
+        if ( options.priority >= 0 )
+            set_socket_option ( this->fd_, SOL_SOCKET, SO_PRIORITY, options.priority,
+                                "Ether::setSocketOptions : SO_PRIORITY" );
+        if ( options.user_timeout > 0 || this->applied_.user_timeout > 0 )
+            set_socket_option ( this->fd_, IPPROTO_TCP, TCP_USER_TIMEOUT, options.user_timeout,
+                                "Ether::setSocketOptions : TCP_USER_TIMEOUT" );
+        // READ BACK
+        this->applied_.no_delay = get_socket_option ( this->fd_, IPPROTO_TCP, TCP_NODELAY ) != 0;
+        this->applied_.quick_ack = get_socket_option ( this->fd_, IPPROTO_TCP, TCP_QUICKACK ) != 0;
+#ifdef SO_BUSY_POLL
+        this->applied_.busy_poll = get_socket_option ( this->fd_, SOL_SOCKET, SO_BUSY_POLL );
+#endif
+        this->applied_.receive_buffer = get_socket_option ( this->fd_, SOL_SOCKET, SO_RCVBUF );
+        this->applied_.send_buffer = get_socket_option ( this->fd_, SOL_SOCKET, SO_SNDBUF );
+        this->applied_.priority = get_socket_option ( this->fd_, SOL_SOCKET, SO_PRIORITY );
+        this->applied_.user_timeout = get_socket_option ( this->fd_, IPPROTO_TCP, TCP_USER_TIMEOUT );
+    }
+
+}
@@ -0,0 +1,251 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file framer.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/framer.h>
+// COMM
+#include <comm/scan.h>
+// STD
+#include <algorithm>
+
+namespace comm {
+
+    /*=========================================================================================================================
+     * COBS : The runs between zero bytes are found by the scan kernels and copied whole, a run is cut at 254 bytes
+     *=======================================================================================================================*/
+    // ENCODE (data,count,frame) : Append to frame the frame of a packet made of count buffers, in order
+    void Cobs::encode ( const View *data, size_t count, string& frame ) const {
+        size_t size = 0;
+        for ( size_t i = 0; i < count; ++i ) size += data[i].size;
+        frame.reserve ( frame.size() + size + size / 254 + 2 );
+        // The code byte of the open block is written when the block is closed
+        size_t code_at = frame.size();
+        uint8_t code = 1;
+        frame.push_back ( 0 );
+        for ( size_t i = 0; i < count; ++i ) {
+            const uint8_t *next = data[i].data, *end = next + data[i].size;
+            while ( next < end ) {
+                // A full block is closed only when more bytes follow it, it has no zero after it
+                if ( code == 0xFF ) {
+                    frame[code_at] = static_cast<char> ( code );
+                    code_at = frame.size();
+                    code = 1;
+                    frame.push_back ( 0 );
+                }
+                // Copy the run up to the next zero or up to the end of the block
+                size_t room = std::min<size_t> ( end - next, 0xFF - code );
+                size_t run = find_any ( next, room, 0, 0 );
+                frame.append ( reinterpret_cast<const char*> ( next ), run );
+                next += run;
+                code += run;
+                if ( run == room ) continue;
+                // A zero closes the block, it is implied by its code
+                ++next;
+                frame[code_at] = static_cast<char> ( code );
+                code_at = frame.size();
+                code = 1;
+                frame.push_back ( 0 );
+            }
+        }
+        frame[code_at] = static_cast<char> ( code );
+        frame.push_back ( 0 );
+    }
+
+    // DECODE (data,size,packet,limit,complete) -> size : Decode data up to the end of the next frame
+    size_t Cobs::decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete ) {
+        static const uint8_t zero = 0;
+        complete = false;
+        const uint8_t *next = data, *end = data + size;
+        while ( next < end ) {
+            // Code byte: a zero ends the frame, otherwise a new block starts
+            if ( this->left_ == 0 ) {
+                uint8_t code = *next++;
+                if ( code == 0 ) {
+                    this->code_ = 0;
+                    if ( this->end_ ( ) ) { complete = true; return next - data; }
+                    continue;
+                }
+                // The block before has a zero after it, unless it was a full one
+                if ( ! this->started_ ) this->begin_ ( packet );
+                else if ( this->code_ != 0xFF ) this->append_ ( packet, &zero, 1, limit );
+                this->code_ = code;
+                this->left_ = code - 1;
+                continue;
+            }
+            // Block bytes, none of them may be a zero
+            size_t room = std::min<size_t> ( this->left_, end - next );
+            size_t run = find_any ( next, room, 0, 0 );
+            this->append_ ( packet, next, run, limit );
+            next += run;
+            this->left_ -= run;
+            // A zero inside a block is the delimiter of a frame cut short, drop the frame and let the zero end it
+            if ( run < room ) {
+                this->drop_ ( packet );
+                this->left_ = 0;
+            }
+        }
+        return size;
+    }
+
+    /*=========================================================================================================================
+     * SLIP : The runs between special bytes are found by the scan kernels and copied whole, the special bytes one by one
+     *=======================================================================================================================*/
+    const uint8_t Slip::END, Slip::ESC, Slip::ESC_END, Slip::ESC_ESC;
+
+    // ENCODE (data,count,frame) : Append to frame the frame of a packet made of count buffers, in order
+    void Slip::encode ( const View *data, size_t count, string& frame ) const {
+        size_t size = 0;
+        for ( size_t i = 0; i < count; ++i ) size += data[i].size;
+        frame.reserve ( frame.size() + size + size / 8 + 2 );
+        if ( this->leading_end_ ) frame.push_back ( static_cast<char> ( END ) );
+        for ( size_t i = 0; i < count; ++i ) {
+            const uint8_t *next = data[i].data, *end = next + data[i].size;
+            while ( next < end ) {
+                size_t run = find_any ( next, end - next, END, ESC );
+                frame.append ( reinterpret_cast<const char*> ( next ), run );
+                next += run;
+                if ( next == end ) break;
+                frame.push_back ( static_cast<char> ( ESC ) );
+                frame.push_back ( static_cast<char> ( *next++ == END ? ESC_END : ESC_ESC ) );
+            }
+        }
+        frame.push_back ( static_cast<char> ( END ) );
+    }
+
+    // DECODE (data,size,packet,limit,complete) -> size : Decode data up to the end of the next frame
+    size_t Slip::decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete ) {
+        complete = false;
+        const uint8_t *next = data, *end = data + size;
+        while ( next < end ) {
+            // The byte after an ESC, an END there is the end of a frame cut short
+            if ( this->escaped_ ) {
+                uint8_t byte = *next++;
+                this->escaped_ = false;
+                if ( byte == END ) { this->drop_ ( packet ); this->end_ ( ); continue; }
+                // RFC 1055 keeps any other escaped byte as it is
+                byte = byte == ESC_END ? END : byte == ESC_ESC ? ESC : byte;
+                this->append_ ( packet, &byte, 1, limit );
+                continue;
+            }
+            // Skip the END bytes between frames
+            if ( ! this->started_ ) {
+                if ( *next == END ) { ++next; continue; }
+                this->begin_ ( packet );
+            }
+            size_t run = find_any ( next, end - next, END, ESC );
+            this->append_ ( packet, next, run, limit );
+            next += run;
+            if ( next == end ) break;
+            if ( *next++ == ESC ) { this->escaped_ = true; continue; }
+            if ( this->end_ ( ) ) { complete = true; return next - data; }
+        }
+        return size;
+    }
+
+
+    /*=========================================================================================================================
+     * LENGTH PREFIX : The frame is carried as it is, its header tells its size
+     *=======================================================================================================================*/
+    LengthPrefix::LengthPrefix ( size_t width, bool big_endian, size_t offset, long adjustment ) :
+            width_(width), big_endian_(big_endian), offset_(offset), adjustment_(adjustment),
+            sized_(false), left_(0), skip_(0) {
+        if ( width != 1 && width != 2 && width != 4 )
+            throw new invalid_argument ( "LengthPrefix::LengthPrefix : the length field is 1, 2 or 4 bytes wide" );
+    }
+
+    // ENCODE (data,count,frame) : Append to frame the packet made of count buffers, in order, with its length field set
+    void LengthPrefix::encode ( const View *data, size_t count, string& frame ) const {
+        size_t size = 0;
+        for ( size_t i = 0; i < count; ++i ) size += data[i].size;
+        long long value = static_cast<long long> ( size ) - static_cast<long long> ( this->headerSize() )
+                        - this->adjustment_;
+        if ( size < this->headerSize() || value < 0 || ( value >> ( 8 * this->width_ ) ) != 0 )
+            throw new invalid_argument ( "LengthPrefix::encode : the packet does not fit the header" );
+        size_t start = frame.size();
+        frame.reserve ( start + size );
+        for ( size_t i = 0; i < count; ++i ) frame.append ( reinterpret_cast<const char*> ( data[i].data ), data[i].size );
+        // Write the length field over the room the packet left for it
+        for ( size_t i = 0; i < this->width_; ++i )
+            frame[start + this->offset_ + ( this->big_endian_ ? this->width_ - 1 - i : i )] =
+                static_cast<char> ( value >> ( 8 * i ) );
+    }
+
+    // DECODE (data,size,packet,limit,complete) -> size : Copy data up to the end of the next frame
+    size_t LengthPrefix::decode ( const uint8_t *data, size_t size, string& packet, size_t limit, bool& complete ) {
+        complete = false;
+        const uint8_t *next = data, *end = data + size;
+        size_t header = this->headerSize();
+        while ( next < end ) {
+            if ( ! this->started_ ) this->begin_ ( packet );
+            // The header is gathered in the packet, the size of the frame is known once it is complete
+            if ( ! this->sized_ ) {
+                size_t have = packet.size() - this->base_;
+                size_t take = std::min<size_t> ( header - have, end - next );
+                packet.append ( reinterpret_cast<const char*> ( next ), take );
+                next += take;
+                if ( have + take < header ) break;
+                size_t length = this->frameSize_ ( reinterpret_cast<const uint8_t*> ( packet.data() ) + this->base_ );
+                this->sized_ = true;
+                // A malformed header is dropped alone, the next header is expected right after it
+                if ( length == 0 || length > limit ) this->drop_ ( packet );
+                this->left_ = length > header ? length - header : 0;
+            }
+            size_t take = std::min<size_t> ( this->left_, end - next );
+            this->append_ ( packet, next, take, limit );
+            next += take;
+            this->left_ -= take;
+            if ( this->left_ > 0 ) break;
+            this->sized_ = false;
+            if ( this->end_ ( ) ) { complete = true; break; }
+        }
+        return next - data;
+    }
+
+    // DELIMIT (data,size,limit,skipped) -> size : Size of the next frame in place, 0 if its header is not complete
+    size_t LengthPrefix::delimit ( const uint8_t *data, size_t size, size_t limit, size_t& skipped ) {
+        skipped = 0;
+        // The rest of a dropped frame comes first
+        if ( this->skip_ > 0 ) {
+            skipped = std::min ( this->skip_, size );
+            this->skip_ -= skipped;
+            if ( this->skip_ > 0 ) return 0;
+        }
+        size_t header = this->headerSize();
+        while ( size - skipped >= header ) {
+            size_t length = this->frameSize_ ( data + skipped );
+            if ( length != 0 && length <= limit ) return length;
+            // A frame too long is skipped whole, a malformed header alone
+            if ( length == 0 ) length = header;
+            ++this->dropped_;
+            size_t take = std::min ( length, size - skipped );
+            skipped += take;
+            this->skip_ = length - take;
+            if ( this->skip_ > 0 ) break;
+        }
+        return 0;
+    }
+
+    // Size of the whole frame out of its header, 0 if the length field is shorter than the adjustment takes away
+    size_t LengthPrefix::frameSize_ ( const uint8_t *header ) const {
+        const uint8_t *field = header + this->offset_;
+        long long value = 0;
+        for ( size_t i = 0; i < this->width_; ++i )
+            value = value << 8 | field[this->big_endian_ ? i : this->width_ - 1 - i];
+        value += this->adjustment_;
+        return value < 0 ? 0 : this->headerSize() + value;
+    }
+
+}
@@ -0,0 +1,73 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file histogram.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/histogram.h>
+// STD
+#include <cmath>
+#include <algorithm>
+
+namespace comm {
+
+    Histogram::Histogram ( ) { this->reset(); }
+
+    // SNAPSHOT (reset) -> Snapshot : Copy the counts, clearing them as they are copied if reset
+    Histogram::Snapshot Histogram::snapshot ( bool reset ) {
+        Snapshot snapshot;
+        snapshot.buckets.resize ( BUCKETS );
+        for ( size_t i = 0; i < BUCKETS; ++i ) {
+            snapshot.buckets[i] = reset ? this->buckets_[i].exchange ( 0, std::memory_order_relaxed )
+                                        : this->buckets_[i].load ( std::memory_order_relaxed );
+            snapshot.count += snapshot.buckets[i];
+        }
+        snapshot.sum = reset ? this->sum_.exchange ( 0, std::memory_order_relaxed )
+                             : this->sum_.load ( std::memory_order_relaxed );
+        snapshot.max = reset ? this->max_.exchange ( 0, std::memory_order_relaxed )
+                             : this->max_.load ( std::memory_order_relaxed );
+        return snapshot;
+    }
+
+    // RESET : Clear the counts
+    void Histogram::reset ( ) {
+        for ( size_t i = 0; i < BUCKETS; ++i ) this->buckets_[i].store ( 0, std::memory_order_relaxed );
+        this->sum_.store ( 0, std::memory_order_relaxed );
+        this->max_.store ( 0, std::memory_order_relaxed );
+    }
+
+    // HIGHEST : Largest value counted in a bucket
+    uint64_t Histogram::highest ( size_t index ) {
+        // The first two ranges have a bucket per value
+        if ( index < ( 2u << SUB_BITS ) ) return index;
+        unsigned exponent = ( index >> SUB_BITS ) + SUB_BITS - 1;
+        uint64_t sub_bucket = ( index & ( ( 1u << SUB_BITS ) - 1 ) ) + ( 1u << SUB_BITS );
+        return ( ( sub_bucket + 1 ) << ( exponent - SUB_BITS ) ) - 1;
+    }
+
+    // PERCENTILE (q) -> value : Smallest value not below a fraction q of the recorded ones (0 if none)
+    uint64_t Histogram::Snapshot::percentile ( double q ) const {
+        if ( this->count == 0 ) return 0;
+        double rank = std::ceil ( q * this->count );
+        uint64_t target = rank < 1 ? 1 : rank > this->count ? this->count : static_cast<uint64_t> ( rank );
+        uint64_t counted = 0;
+        for ( size_t i = 0; i < this->buckets.size(); ++i ) {
+            counted += this->buckets[i];
+            // The bucket bound may overshoot the largest value recorded
+            if ( counted >= target ) return std::min ( Histogram::highest ( i ), this->max );
+        }
+        return this->max;
+    }
+
+} // namespace comm
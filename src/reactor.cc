@@ -0,0 +1,139 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file reactor.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/reactor.h>
+// SYS
+#include <sys/eventfd.h>
+
+namespace comm {
+
+    Reactor::Reactor ( ) : stopped_(false) {
+        if ( ( this->epoll_fd_ = ::epoll_create1 ( EPOLL_CLOEXEC ) ) < 0 )
+            throw new IOException ( "Reactor::Reactor : epoll_create1", errno );
+        if ( ( this->event_fd_ = ::eventfd ( 0, EFD_NONBLOCK | EFD_CLOEXEC ) ) < 0 ) {
+            int error = errno;
+            ::close ( this->epoll_fd_ );
+            throw new IOException ( "Reactor::Reactor : eventfd", error );
+        }
+        // The event file descriptor is watched like any other, but it has no entry
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = this->event_fd_;
+        if ( ::epoll_ctl ( this->epoll_fd_, EPOLL_CTL_ADD, this->event_fd_, &event ) < 0 ) {
+            int error = errno;
+            ::close ( this->event_fd_ );
+            ::close ( this->epoll_fd_ );
+            throw new IOException ( "Reactor::Reactor : epoll_ctl", error );
+        }
+    }
+
+    Reactor::~Reactor ( ) {
+        ::close ( this->event_fd_ );
+        ::close ( this->epoll_fd_ );
+    }
+
+    // ADD : Register an open comm::Comm and switch it to non blocking mode
+    void Reactor::add ( Comm& comm, uint32_t events, const Callback& callback ) {
+        int fd = comm.getFileDescriptor();
+        if ( fd < 0 ) throw new ConnectionException ( "Reactor::add : not open" );
+        boost::shared_ptr<Entry> entry = boost::make_shared<Entry>();
+        entry->comm = &comm;
+        entry->callback = callback;
+        boost::lock_guard<boost::mutex> lock(this->mtx_entries);
+        struct epoll_event event;
+        event.events = ( events & ( READ | SEND ) ) | DISCONNECT;
+        event.data.fd = fd;
+        if ( ::epoll_ctl ( this->epoll_fd_, EPOLL_CTL_ADD, fd, &event ) < 0 )
+            throw new IOException ( "Reactor::add : epoll_ctl", errno );
+        comm.setBlocking ( false );
+        this->entries_[fd] = entry;
+    }
+
+    // MODIFY : Change the events a registered comm::Comm is watched for
+    void Reactor::modify ( Comm& comm, uint32_t events ) {
+        int fd = comm.getFileDescriptor();
+        boost::lock_guard<boost::mutex> lock(this->mtx_entries);
+        struct epoll_event event;
+        event.events = ( events & ( READ | SEND ) ) | DISCONNECT;
+        event.data.fd = fd;
+        if ( ::epoll_ctl ( this->epoll_fd_, EPOLL_CTL_MOD, fd, &event ) < 0 )
+            throw new IOException ( "Reactor::modify : epoll_ctl", errno );
+    }
+
+    // REMOVE : Deregister a comm::Comm and switch it back to blocking mode
+    void Reactor::remove ( Comm& comm ) {
+        int fd = comm.getFileDescriptor();
+        boost::lock_guard<boost::mutex> lock(this->mtx_entries);
+        std::map<int, boost::shared_ptr<Entry> >::iterator entry = this->entries_.find ( fd );
+        if ( entry == this->entries_.end() || entry->second->comm != &comm ) return;
+        ::epoll_ctl ( this->epoll_fd_, EPOLL_CTL_DEL, fd, NULL );
+        this->entries_.erase ( entry );
+        comm.setBlocking ( true );
+    }
+
+    // SIZE : Number of registered instances
+    size_t Reactor::size ( ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_entries);
+        return this->entries_.size();
+    }
+
+    // POLL : Wait for events up to timeout seconds (negative to wait forever), dispatch them, return their number
+    size_t Reactor::poll ( double timeout ) {
+        int timeout_ms = timeout < 0 ? -1 : static_cast<int> ( std::ceil ( timeout * 1000 ) );
+        int ready = ::epoll_wait ( this->epoll_fd_, this->events_, 64, timeout_ms );
+        if ( ready < 0 ) {
+            if ( errno == EINTR ) return 0;
+            throw new IOException ( "Reactor::poll : epoll_wait", errno );
+        }
+        size_t dispatched = 0;
+        for ( int i = 0; i < ready; ++i ) {
+            int fd = this->events_[i].data.fd;
+            // Wake up request, drain the counter
+            if ( fd == this->event_fd_ ) {
+                uint64_t counter;
+                while ( ::read ( this->event_fd_, &counter, sizeof ( counter ) ) > 0 );
+                continue;
+            }
+            // The entry may have been removed by a previous callback, keep it alive while its own callback runs
+            boost::shared_ptr<Entry> entry;
+            {
+                boost::lock_guard<boost::mutex> lock(this->mtx_entries);
+                std::map<int, boost::shared_ptr<Entry> >::iterator found = this->entries_.find ( fd );
+                if ( found == this->entries_.end() ) continue;
+                entry = found->second;
+            }
+            entry->callback ( *entry->comm, this->events_[i].events );
+            ++dispatched;
+        }
+        return dispatched;
+    }
+
+    // RUN : Poll and dispatch until stop is called
+    void Reactor::run ( ) {
+        while ( ! this->stopped_ ) this->poll ( );
+        this->stopped_ = false;
+    }
+
+    // STOP : Make run return and wake up a pending poll, can be called from any thread
+    void Reactor::stop ( ) {
+        this->stopped_ = true;
+        uint64_t counter = 1;
+        if ( ::write ( this->event_fd_, &counter, sizeof ( counter ) ) < 0 && errno != EAGAIN )
+            throw new IOException ( "Reactor::stop : eventfd", errno );
+    }
+
+}
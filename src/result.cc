@@ -0,0 +1,45 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file result.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/result.h>
+#include <comm/utils.h>
+
+namespace comm {
+
+    // MESSAGE -> string : Description of the failure, the what of the matching exception
+    string Error::message ( ) const {
+        if ( this->number == 0 || this->code == ERROR_NOT_CONNECTED ) return this->where;
+        return format ( "%d : %s : %s", this->number, this->where, strerror ( this->number ) );
+    }
+
+    // RAISE : Throw the exception of the throwing calls, the formatting and the allocation happen only here
+    void Error::raise ( ) const {
+        switch ( this->code ) {
+            case ERROR_NONE:
+                return;
+            case ERROR_NOT_CONNECTED:
+                throw new ConnectionException ( this->where );
+            case ERROR_WAIT:
+                if ( this->number == 0 ) throw new IOException ( this->where );
+                throw new IOException ( this->where, this->number );
+            default:
+                if ( this->number == 0 ) throw new InterfaceException ( this->where );
+                throw new InterfaceException ( this->where, this->number );
+        }
+    }
+
+} // namespace comm
@@ -0,0 +1,191 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file scan.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/scan.h>
+// STD
+#include <cstring>
+// SIMD
+#if defined(__x86_64__) || defined(__i386__)
+#define COMM_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace comm {
+
+    /*=========================================================================================================================
+     * SCALAR : Portable kernel, memchr on the first byte of the delimiter then compare the rest
+     *=======================================================================================================================*/
+    static size_t find_eol_scalar ( const uint8_t *data, size_t size, const uint8_t *eol, size_t eol_len ) {
+        if ( eol_len == 0 || size < eol_len ) return size;
+        const uint8_t *next = data, *end = data + size - eol_len + 1;
+        while ( next < end ) {
+            next = static_cast<const uint8_t*> ( std::memchr ( next, eol[0], end - next ) );
+            if ( next == NULL ) break;
+            if ( std::memcmp ( next + 1, eol + 1, eol_len - 1 ) == 0 ) return next - data;
+            ++next;
+        }
+        return size;
+    }
+
+    // Portable byte search, memchr when both values are the same
+    static size_t find_any_scalar ( const uint8_t *data, size_t size, uint8_t first, uint8_t second ) {
+        if ( first == second ) {
+            const void *found = std::memchr ( data, first, size );
+            return found ? static_cast<const uint8_t*> ( found ) - data : size;
+        }
+        for ( size_t offset = 0; offset < size; ++offset )
+            if ( data[offset] == first || data[offset] == second ) return offset;
+        return size;
+    }
+
+#ifdef COMM_SCAN_X86
+    /*=========================================================================================================================
+     * SSE2 / AVX2 : Compare a block against the first and the last byte of the delimiter at once, the positions where both
+     * match are candidates, and only those are compared in full. A single byte delimiter needs no further comparison.
+     *=======================================================================================================================*/
+    // Check the candidates in mask, starting at data + offset, return the offset of the delimiter or size
+    static inline size_t check_candidates ( const uint8_t *data, size_t offset, uint32_t mask,
+                                            const uint8_t *eol, size_t eol_len, size_t size ) {
+        while ( mask ) {
+            size_t candidate = offset + __builtin_ctz ( mask );
+            if ( eol_len < 3 || std::memcmp ( data + candidate + 1, eol + 1, eol_len - 2 ) == 0 ) return candidate;
+            mask &= mask - 1;
+        }
+        return size;
+    }
+
+    __attribute__((target("sse2")))
+    static size_t find_eol_sse2 ( const uint8_t *data, size_t size, const uint8_t *eol, size_t eol_len ) {
+        if ( eol_len == 0 || size < eol_len ) return size;
+        const __m128i first = _mm_set1_epi8 ( static_cast<char> ( eol[0] ) );
+        const __m128i last = _mm_set1_epi8 ( static_cast<char> ( eol[eol_len - 1] ) );
+        // Last offset where a delimiter can start, plus one
+        size_t end = size - eol_len + 1, offset = 0;
+        for ( ; offset + 16 <= end; offset += 16 ) {
+            __m128i head = _mm_loadu_si128 ( reinterpret_cast<const __m128i*> ( data + offset ) );
+            __m128i tail = _mm_loadu_si128 ( reinterpret_cast<const __m128i*> ( data + offset + eol_len - 1 ) );
+            uint32_t mask = _mm_movemask_epi8 ( _mm_and_si128 ( _mm_cmpeq_epi8 ( head, first ),
+                                                                _mm_cmpeq_epi8 ( tail, last ) ) );
+            if ( mask == 0 ) continue;
+            size_t found = check_candidates ( data, offset, mask, eol, eol_len, size );
+            if ( found != size ) return found;
+        }
+        return offset + find_eol_scalar ( data + offset, size - offset, eol, eol_len );
+    }
+
+    __attribute__((target("avx2")))
+    static size_t find_eol_avx2 ( const uint8_t *data, size_t size, const uint8_t *eol, size_t eol_len ) {
+        if ( eol_len == 0 || size < eol_len ) return size;
+        const __m256i first = _mm256_set1_epi8 ( static_cast<char> ( eol[0] ) );
+        const __m256i last = _mm256_set1_epi8 ( static_cast<char> ( eol[eol_len - 1] ) );
+        // Last offset where a delimiter can start, plus one
+        size_t end = size - eol_len + 1, offset = 0;
+        for ( ; offset + 32 <= end; offset += 32 ) {
+            __m256i head = _mm256_loadu_si256 ( reinterpret_cast<const __m256i*> ( data + offset ) );
+            __m256i tail = _mm256_loadu_si256 ( reinterpret_cast<const __m256i*> ( data + offset + eol_len - 1 ) );
+            uint32_t mask = _mm256_movemask_epi8 ( _mm256_and_si256 ( _mm256_cmpeq_epi8 ( head, first ),
+                                                                      _mm256_cmpeq_epi8 ( tail, last ) ) );
+            if ( mask == 0 ) continue;
+            size_t found = check_candidates ( data, offset, mask, eol, eol_len, size );
+            if ( found != size ) return found;
+        }
+        return offset + find_eol_sse2 ( data + offset, size - offset, eol, eol_len );
+    }
+
+    /*=========================================================================================================================
+     * SSE2 / AVX2 : Compare a block against both values at once, the first set bit of the mask is the match
+     *=======================================================================================================================*/
+    __attribute__((target("sse2")))
+    static size_t find_any_sse2 ( const uint8_t *data, size_t size, uint8_t first, uint8_t second ) {
+        const __m128i first_ = _mm_set1_epi8 ( static_cast<char> ( first ) );
+        const __m128i second_ = _mm_set1_epi8 ( static_cast<char> ( second ) );
+        size_t offset = 0;
+        for ( ; offset + 16 <= size; offset += 16 ) {
+            __m128i block = _mm_loadu_si128 ( reinterpret_cast<const __m128i*> ( data + offset ) );
+            uint32_t mask = _mm_movemask_epi8 ( _mm_or_si128 ( _mm_cmpeq_epi8 ( block, first_ ),
+                                                               _mm_cmpeq_epi8 ( block, second_ ) ) );
+            if ( mask != 0 ) return offset + __builtin_ctz ( mask );
+        }
+        return offset + find_any_scalar ( data + offset, size - offset, first, second );
+    }
+
+    __attribute__((target("avx2")))
+    static size_t find_any_avx2 ( const uint8_t *data, size_t size, uint8_t first, uint8_t second ) {
+        const __m256i first_ = _mm256_set1_epi8 ( static_cast<char> ( first ) );
+        const __m256i second_ = _mm256_set1_epi8 ( static_cast<char> ( second ) );
+        size_t offset = 0;
+        for ( ; offset + 32 <= size; offset += 32 ) {
+            __m256i block = _mm256_loadu_si256 ( reinterpret_cast<const __m256i*> ( data + offset ) );
+            uint32_t mask = _mm256_movemask_epi8 ( _mm256_or_si256 ( _mm256_cmpeq_epi8 ( block, first_ ),
+                                                                     _mm256_cmpeq_epi8 ( block, second_ ) ) );
+            if ( mask != 0 ) return offset + __builtin_ctz ( mask );
+        }
+        return offset + find_any_sse2 ( data + offset, size - offset, first, second );
+    }
+#endif
+
+    /*=========================================================================================================================
+     * DISPATCH : Pick the kernel once, at the first call
+     *=======================================================================================================================*/
+    // Best kernel supported by the running CPU, detected once at runtime
+    ScanKernel scan_kernel ( ) {
+#ifdef COMM_SCAN_X86
+        static const ScanKernel kernel = __builtin_cpu_supports ( "avx2" ) ? AVX2 :
+                                         __builtin_cpu_supports ( "sse2" ) ? SSE2 : SCALAR;
+        return kernel;
+#else
+        return SCALAR;
+#endif
+    }
+
+    // Implementation of a specific kernel, falls back to the best supported one if the CPU lacks it
+    FindEol find_eol_kernel ( ScanKernel kernel ) {
+        if ( kernel > scan_kernel() ) kernel = scan_kernel();
+        switch ( kernel ) {
+#ifdef COMM_SCAN_X86
+            case AVX2: return &find_eol_avx2;
+            case SSE2: return &find_eol_sse2;
+#endif
+            default: return &find_eol_scalar;
+        }
+    }
+
+    // Find the first occurrence of a one or multi-byte delimiter in a chunk of data, using the best kernel available
+    size_t find_eol ( const uint8_t *data, size_t size, const uint8_t *eol, size_t eol_len ) {
+        static const FindEol kernel = find_eol_kernel ( scan_kernel() );
+        return kernel ( data, size, eol, eol_len );
+    }
+
+    // Implementation of a specific kernel, falls back to the best supported one if the CPU lacks it
+    FindAny find_any_kernel ( ScanKernel kernel ) {
+        if ( kernel > scan_kernel() ) kernel = scan_kernel();
+        switch ( kernel ) {
+#ifdef COMM_SCAN_X86
+            case AVX2: return &find_any_avx2;
+            case SSE2: return &find_any_sse2;
+#endif
+            default: return &find_any_scalar;
+        }
+    }
+
+    // Find the first byte equal to either of two values in a chunk of data, using the best kernel available
+    size_t find_any ( const uint8_t *data, size_t size, uint8_t first, uint8_t second ) {
+        static const FindAny kernel = find_any_kernel ( scan_kernel() );
+        return kernel ( data, size, first, second );
+    }
+
+}
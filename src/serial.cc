@@ -16,6 +16,10 @@
  * HEADER
  *===========================================================================================================================*/
 #include <comm/serial.h>
+// SYS
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
 
 namespace comm {
 
@@ -25,64 +29,148 @@ namespace comm {
         this->open();
     }
 
+    // SELF TEST (probe,reply,count) -> RoundTrip : Round trip times of count probes, answered with reply bytes
+    RoundTrip Serial::selfTest ( const string& probe, size_t reply, size_t count ) {
+        if ( probe.empty() ) throw new invalid_argument ( "Serial::selfTest : empty probe" );
+        if ( reply == 0 ) reply = probe.size();
+        Histogram rtt;
+        RoundTrip result;
+        string answer;
+        this->flushInput();
+        for ( size_t i = 0; i < count; ++i ) {
+            timespec start, end;
+            clock_gettime ( CLOCK_MONOTONIC, &start );
+            ++result.probes;
+            answer.clear();
+            if ( this->send ( probe ) < probe.size() || this->read ( answer, reply ) < reply ) {
+                // Lost or late, drop what came in so that the next probe starts clean
+                this->flushInput();
+                continue;
+            }
+            clock_gettime ( CLOCK_MONOTONIC, &end );
+            rtt.record ( ( end.tv_sec - start.tv_sec ) * 1000000000ULL + end.tv_nsec - start.tv_nsec );
+            ++result.answered;
+        }
+        result.low_latency = this->low_latency_;
+        result.frame_size = this->settings_.frame_size;
+        result.rtt = rtt.snapshot();
+        return result;
+    }
+
     // Read common function
-    size_t Serial::read_ (uint8_t *data, size_t size) {
-        // If the port is not open or not connected, throw
-        if ( ! ( this->is_open_ && this->is_connected_ ) ) throw new ConnectionException ("Serial::read : not connected");
+    size_t Serial::read_ (uint8_t *data, size_t size, size_t least) {
+        // If the port is not open or not connected, fail
+        if ( ! ( this->is_open_ && this->is_connected_ ) )
+            return this->readError_ ( ERROR_NOT_CONNECTED, "Serial::read : not connected" );
         // Pre-fill buffer with available bytes
         ssize_t bytes_read_now = ::read(fd_, data, size);
+        this->countRead_ ( bytes_read_now );
         size_t bytes_read = bytes_read_now > 0 ? bytes_read_now : 0;
-        // Prepare timeout value : now + read + byte*size
-        TimeCheck timeout ( this->timeout_.read, this->timeout_.byte, size );
-        // Read until the desired size is read, there's nothing left to read or timeout expires
-        while (bytes_read < size) {
-            // If the timeout expired or i read no data in the last cycle break the reading loop
-            if ( timeout.expired() || bytes_read_now == 0 ) {
+        // Prepare timeout value : now + read + byte*least
+        TimeCheck timeout ( this->timeout_.read, this->timeout_.byte, least );
+        // Read until at least the desired size is read, there's nothing left to read or timeout expires
+        while ( bytes_read < least ) {
+            // If the timeout expired or the port is in non blocking mode break the loop, with VMIN and VTIME set to 0 a
+            // read returns 0 when nothing was received yet, it is not the end of the data
+            if ( ! this->read_blocking_ || timeout.expired() ) {
                 break;
             }
-            // Wait for the device to be readable, otherwise check again on the next loop
-            if ( this->waitRead_() < 1 ) continue;
+            // Wait for the device to be readable, until the deadline, stop if the wait failed
+            int ready = this->waitRead_ ( timeout );
+            if ( ready < 0 ) break;
+            if ( ready == 0 ) continue;
             // Read new available bytes
             bytes_read_now = ::read (fd_, data + bytes_read, size - bytes_read);
+            this->countRead_ ( bytes_read_now );
             // retry if interrupted
             if ( bytes_read_now == -1 && errno == EINTR) continue;
             // At least 1 byte should always be read
             if ( bytes_read_now < 1 )
-                throw new InterfaceException (
-                        "Serial::read : device reports readiness to read but returned no data, disconnected?", errno);
+                return this->readError_ ( ERROR_DISCONNECTED,
+                        "Serial::read : device reports readiness to read but returned no data, disconnected?",
+                        errno, bytes_read );
             // Update bytes_read
             bytes_read += bytes_read_now;
         }
+        if ( bytes_read < least ) this->read_counters_.add ( Counters::PARTIAL_READS );
         return bytes_read;
     }
 
     // Send common function
     size_t Serial::send_ (const uint8_t *data, size_t size) {
-        // If the connection is not open and connected, throw
-        if ( ! ( this->is_open_ && this->is_connected_ ) ) throw new ConnectionException ("Serial::send : not connected");
-        // Prepare return variables
-        fd_set writefds;
-        size_t bytes_sent = 0, bytes_sent_now = 0;
+        // If the connection is not open and connected, fail
+        if ( ! ( this->is_open_ && this->is_connected_ ) )
+            return this->sendError_ ( ERROR_NOT_CONNECTED, "Serial::send : not connected" );
+        // Prepare return variables, the port is non blocking so try to write right away
+        ssize_t bytes_sent_now = ::write (fd_, data, size);
+        this->countSend_ ( bytes_sent_now );
+        size_t bytes_sent = bytes_sent_now > 0 ? bytes_sent_now : 0;
         // Prepare timeout value : now + send + byte*size
         TimeCheck timeout ( this->timeout_.send, this->timeout_.byte, size );
         while (bytes_sent < size) {
-            // If the timeout expired break the reading loop
-            if ( timeout.expired() ) {
+            // If the timeout expired or the port is in non blocking mode break the reading loop
+            if ( ! this->send_blocking_ || timeout.expired() ) {
                 break;
             }
-            // Wait for the device to be ready to receive, otherwise check again on the next loop
-            if ( this->waitSend_() < 1 ) continue;
+            // Wait for the device to be ready to receive, until the deadline, stop if the wait failed
+            int ready = this->waitSend_ ( timeout );
+            if ( ready < 0 ) break;
+            if ( ready == 0 ) continue;
             // This will write some
             bytes_sent_now = ::write (fd_, data + bytes_sent, size - bytes_sent);
+            this->countSend_ ( bytes_sent_now );
             // retry if interrupted
             if ( bytes_sent_now == -1 && errno == EINTR) continue;
             // at least 1 byte should always be sent
             if (bytes_sent_now < 1)
-                throw new InterfaceException(
-                        "Serial::send : device reports readiness to receive but returned data, disconnected?", errno);
+                return this->sendError_ ( ERROR_DISCONNECTED,
+                        "Serial::send : device reports readiness to receive but returned data, disconnected?",
+                        errno, bytes_sent );
             // Update bytes_sent
             bytes_sent += bytes_sent_now;
         }
+        if ( bytes_sent < size ) this->send_counters_.add ( Counters::PARTIAL_SENDS );
+        return bytes_sent;
+    }
+
+    // Send vectored common function
+    size_t Serial::sendv_ (struct iovec *iov, size_t count) {
+        // If the connection is not open and connected, fail
+        if ( ! ( this->is_open_ && this->is_connected_ ) )
+            return this->sendError_ ( ERROR_NOT_CONNECTED, "Serial::send : not connected" );
+        // Prepare return variables, the port is non blocking so try to write right away
+        size_t size = 0;
+        for ( size_t i = 0; i < count; ++i ) size += iov[i].iov_len;
+        ssize_t bytes_sent_now = ::writev (fd_, iov, count);
+        this->countSend_ ( bytes_sent_now );
+        size_t bytes_sent = bytes_sent_now > 0 ? bytes_sent_now : 0;
+        count = advance_iovec ( iov, count, bytes_sent );
+        // Prepare timeout value : now + send + byte*size
+        TimeCheck timeout ( this->timeout_.send, this->timeout_.byte, size );
+        while (bytes_sent < size) {
+            // If the timeout expired or the port is in non blocking mode break the reading loop
+            if ( ! this->send_blocking_ || timeout.expired() ) {
+                break;
+            }
+            // Wait for the device to be ready to receive, until the deadline, stop if the wait failed
+            int ready = this->waitSend_ ( timeout );
+            if ( ready < 0 ) break;
+            if ( ready == 0 ) continue;
+            // This will write some, starting from the first buffer not sent in full
+            bytes_sent_now = ::writev (fd_, iov, count);
+            this->countSend_ ( bytes_sent_now );
+            // retry if interrupted
+            if ( bytes_sent_now == -1 && errno == EINTR) continue;
+            // at least 1 byte should always be sent
+            if (bytes_sent_now < 1)
+                return this->sendError_ ( ERROR_DISCONNECTED,
+                        "Serial::send : device reports readiness to receive but returned data, disconnected?",
+                        errno, bytes_sent );
+            // Update bytes_sent and skip the buffers already sent
+            bytes_sent += bytes_sent_now;
+            count = advance_iovec ( iov, count, bytes_sent_now );
+        }
+        if ( bytes_sent < size ) this->send_counters_.add ( Counters::PARTIAL_SENDS );
         return bytes_sent;
     }
 
@@ -116,16 +204,40 @@ namespace comm {
             throw new IOException ( "Serial::setOptions : tcgetattr", errno );
         // INIT OPTION
         init_options ( &this->termios_ );
-        // SET BAUDRATE
+        // SET BAUDRATE, rates with no Bxxxx constant are set after the other options, through termios2
         speed_t baudrate_code = get_baudrate ( this->baudrate_ );
-        ::cfsetispeed( &this->termios_, baudrate_code );
-        ::cfsetospeed( &this->termios_, baudrate_code );
+        bool custom = baudrate_code == 0 && this->baudrate_ != 0;
+        if ( ! custom ) {
+            ::cfsetispeed( &this->termios_, baudrate_code );
+            ::cfsetospeed( &this->termios_, baudrate_code );
+        }
         // SET OPTION
         set_options ( &this->termios_, this->settings_ );
         // ACTIVATE OPTIONS
         ::tcsetattr ( this->fd_, TCSANOW, &this->termios_ );
+        if ( custom && ! set_custom_baudrate ( this->fd_, this->baudrate_ ) ) {
+            int error = errno;
+            throw new IOException ( format ( "Serial::setOptions : baudrate %u", this->baudrate_ ), error );
+        }
+        // The driver may round the rate, the byte time follows the one it applied
+        this->actual_baudrate_ = get_actual_baudrate ( this->fd_ );
+        if ( this->actual_baudrate_ == 0 ) this->actual_baudrate_ = this->baudrate_;
+        // SET LATENCY PROFILE, drivers without the serial ioctls (pseudo terminals, some USB adapters) keep their own
+        this->low_latency_ = false;
+#if defined(TIOCGSERIAL) && defined(ASYNC_LOW_LATENCY)
+        struct serial_struct serial;
+        if ( ::ioctl ( this->fd_, TIOCGSERIAL, &serial ) == 0 ) {
+            if ( this->settings_.latency == LOW_LATENCY && ! ( serial.flags & ASYNC_LOW_LATENCY ) ) {
+                serial.flags |= ASYNC_LOW_LATENCY;
+                // Not every driver takes it (or lets an unprivileged user set it), the flag is read back
+                if ( ::ioctl ( this->fd_, TIOCSSERIAL, &serial ) != 0 || ::ioctl ( this->fd_, TIOCGSERIAL, &serial ) != 0 )
+                    serial.flags = 0;
+            }
+            this->low_latency_ = ( serial.flags & ASYNC_LOW_LATENCY ) != 0;
+        }
+#endif
         // SET BYTE TIMEOUT
-        this->timeout_.byte = to_timeval( get_bytetime( this->baudrate_, this->settings_ ) );
+        this->timeout_.byte = to_timeval( get_bytetime( this->actual_baudrate_, this->settings_ ) );
     }
 
     // FLUSH : For the ether socket this does nothing
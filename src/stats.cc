@@ -0,0 +1,127 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file stats.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/stats.h>
+#include <comm/comm.h>
+// STD
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+
+namespace comm {
+
+    // LOAD (values) : Reader, add a consistent copy of the counters to values (COUNT elements)
+    void Counters::load ( uint64_t *values ) const {
+        uint64_t copy[COUNT], before, after;
+        do {
+            before = this->sequence_.load ( std::memory_order_acquire );
+            for ( size_t i = 0; i < COUNT; ++i ) copy[i] = this->values_[i].load ( std::memory_order_relaxed );
+            // The copy is complete before the sequence is checked again
+            std::atomic_thread_fence ( std::memory_order_acquire );
+            after = this->sequence_.load ( std::memory_order_relaxed );
+        } while ( ( before & 1 ) != 0 || before != after );
+        for ( size_t i = 0; i < COUNT; ++i ) values[i] += copy[i];
+    }
+
+    // INSTANCE : The registry, never destroyed so that instances outliving static destruction can still leave it
+    StatsRegistry& StatsRegistry::instance ( ) {
+        static StatsRegistry* registry = new StatsRegistry();
+        return *registry;
+    }
+
+    // ADD : Register an instance, it gets the next id
+    void StatsRegistry::add ( Comm& comm ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_instances);
+        this->instances_[&comm] = this->next_id_++;
+    }
+
+    // REMOVE : Deregister an instance
+    void StatsRegistry::remove ( Comm& comm ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_instances);
+        this->instances_.erase ( &comm );
+    }
+
+    // SIZE : Number of live instances
+    size_t StatsRegistry::size ( ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_instances);
+        return this->instances_.size();
+    }
+
+    // Escape a label value: backslash, double quote and line feed
+    static string escape_label ( const string& value ) {
+        string escaped;
+        for ( size_t i = 0; i < value.size(); ++i ) {
+            if ( value[i] == '\\' || value[i] == '"' ) escaped += '\\';
+            if ( value[i] == '\n' ) { escaped += "\\n"; continue; }
+            escaped += value[i];
+        }
+        return escaped;
+    }
+
+    // PROMETHEUS -> string : Counters of every live instance, labelled with their id, address and port
+    string StatsRegistry::prometheus ( ) {
+        // Metric names and help, in the order of comm::Counters
+        static const char* METRICS[Counters::COUNT][2] = {
+            { "comm_received_bytes_total", "Bytes received by the read syscalls." },
+            { "comm_sent_bytes_total", "Bytes sent by the send syscalls." },
+            { "comm_syscalls_total", "Read, send and wait syscalls issued." },
+            { "comm_eagain_total", "Syscalls that failed with EAGAIN." },
+            { "comm_eintr_total", "Syscalls interrupted by a signal." },
+            { "comm_wait_timeouts_total", "Waits for readiness that timed out." },
+            { "comm_partial_reads_total", "Reads that returned less than asked." },
+            { "comm_partial_sends_total", "Sends that returned less than asked." },
+            { "comm_reconnects_total", "Connections established after the first one." },
+            { "comm_errors_total", "Failures of the read and send paths, thrown or returned." } };
+        struct Sample {
+            uint64_t id;
+            string labels;
+            uint64_t values[Counters::COUNT];
+            bool operator< ( const Sample& other ) const { return this->id < other.id; }
+        };
+        std::vector<Sample> samples;
+        {
+            boost::lock_guard<boost::mutex> lock(this->mtx_instances);
+            samples.resize ( this->instances_.size() );
+            size_t s = 0;
+            for ( std::map<Comm*, uint64_t>::iterator it = this->instances_.begin(); it != this->instances_.end(); ++it ) {
+                Comm& comm = *it->first;
+                Sample& sample = samples[s++];
+                sample.id = it->second;
+                std::fill ( sample.values, sample.values + Counters::COUNT, 0 );
+                comm.read_counters_.load ( sample.values );
+                comm.send_counters_.load ( sample.values );
+                boost::lock_guard<boost::mutex> lock_stats(comm.mtx_stats);
+                sample.labels = "id=\"" + std::to_string ( sample.id ) + "\",address=\"" + escape_label ( comm.address_ ) +
+                                "\",port=\"" + std::to_string ( comm.port_ ) + "\"";
+            }
+        }
+        std::sort ( samples.begin(), samples.end() );
+        // Samples are grouped by metric, each one after its help and type
+        string text;
+        char value[32];
+        for ( size_t m = 0; m < Counters::COUNT; ++m ) {
+            text += string ( "# HELP " ) + METRICS[m][0] + " " + METRICS[m][1] + "\n";
+            text += string ( "# TYPE " ) + METRICS[m][0] + " counter\n";
+            for ( size_t s = 0; s < samples.size(); ++s ) {
+                std::snprintf ( value, sizeof ( value ), "%llu", static_cast<unsigned long long> ( samples[s].values[m] ) );
+                text += string ( METRICS[m][0] ) + "{" + samples[s].labels + "} " + value + "\n";
+            }
+        }
+        return text;
+    }
+
+} // namespace comm
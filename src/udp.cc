@@ -0,0 +1,255 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file udp.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/udp.h>
+
+namespace comm {
+
+    /*=========================================================================================================================
+     * DATAGRAM BATCH
+     *=======================================================================================================================*/
+    DatagramBatch::DatagramBatch ( size_t count, size_t mtu ) :
+            storage_(count * mtu), headers_(count), iov_(count), sources_(count), mtu_(mtu), size_(0) {
+        std::memset ( &this->headers_[0], 0, count * sizeof ( struct mmsghdr ) );
+        for ( size_t i = 0; i < count; ++i ) {
+            this->iov_[i].iov_base = &this->storage_[i * mtu];
+            this->iov_[i].iov_len = mtu;
+            this->headers_[i].msg_hdr.msg_iov = &this->iov_[i];
+            this->headers_[i].msg_hdr.msg_iovlen = 1;
+            this->headers_[i].msg_hdr.msg_name = &this->sources_[i];
+        }
+        this->reset_ ( );
+    }
+
+    // Reset the headers before a new receive call
+    void DatagramBatch::reset_ ( ) {
+        this->size_ = 0;
+        for ( size_t i = 0; i < this->headers_.size(); ++i ) {
+            this->headers_[i].msg_len = 0;
+            this->headers_[i].msg_hdr.msg_namelen = sizeof ( sockaddr_in );
+            this->headers_[i].msg_hdr.msg_flags = 0;
+        }
+    }
+
+    /*=========================================================================================================================
+     * UDP
+     *=======================================================================================================================*/
+    Udp::Udp ( const string& address, uint16_t port, uint16_t local_port, const string& eol, Timeout timeout ) :
+            Comm(address,eol,timeout), local_port_(local_port) {
+        this->port_ = port;
+        this->sockaddr_in_.sin_family = AF_INET;
+        this->open();
+    }
+
+    // READ BATCH (batch) -> count : Wait for datagrams (or timeout) and receive as many as the batch holds
+    size_t Udp::readBatch ( DatagramBatch& batch ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_read);
+        // If the socket is not open and connected, throw
+        if ( ! ( this->is_open_ && this->is_connected_ ) ) throw new ConnectionException ("Udp::read : not connected");
+        batch.reset_ ( );
+        // Prepare timeout value : now + read
+        TimeCheck timeout ( this->timeout_.read, this->timeout_.byte, 1 );
+        while ( true ) {
+            // Receive everything that is already queued, up to the batch capacity
+            int received = ::recvmmsg ( this->fd_, &batch.headers_[0], batch.capacity(), MSG_DONTWAIT, NULL );
+            if ( received > 0 ) return batch.size_ = received;
+            if ( received == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                throw new InterfaceException ( "Udp::read : recvmmsg", errno );
+            // Nothing queued, wait for the first datagram
+            if ( ! this->read_blocking_ || timeout.expired() ) return 0;
+            if ( this->waitRead_ ( timeout ) < 0 ) this->takeReadError_().raise();
+        }
+    }
+
+    // SEND BATCH (vector<View>) -> count : Send each view as a datagram, return the number of datagrams sent
+    size_t Udp::sendBatch ( const vector<View>& datagrams ) {
+        return this->sendBatch ( datagrams.empty() ? NULL : &datagrams[0], datagrams.size() );
+    }
+
+    // SEND BATCH (View*,count) -> count : Send each view as a datagram, return the number of datagrams sent
+    size_t Udp::sendBatch ( const View* datagrams, size_t count ) {
+        boost::lock_guard<boost::mutex> lock(this->mtx_send);
+        // If the socket is not open and connected, throw
+        if ( ! ( this->is_open_ && this->is_connected_ ) ) throw new ConnectionException ("Udp::send : not connected");
+        // Headers are kept between calls, they grow only when a larger batch is sent
+        if ( this->send_headers_.size() < count ) {
+            this->send_headers_.resize ( count );
+            this->send_iov_.resize ( count );
+        }
+        for ( size_t i = 0; i < count; ++i ) {
+            this->send_iov_[i].iov_base = const_cast<uint8_t*> ( datagrams[i].data );
+            this->send_iov_[i].iov_len = datagrams[i].size;
+            std::memset ( &this->send_headers_[i], 0, sizeof ( struct mmsghdr ) );
+            this->send_headers_[i].msg_hdr.msg_iov = &this->send_iov_[i];
+            this->send_headers_[i].msg_hdr.msg_iovlen = 1;
+        }
+        // Prepare timeout value : now + send
+        TimeCheck timeout ( this->timeout_.send, this->timeout_.byte, 1 );
+        size_t sent = 0;
+        // Send until every datagram is sent or timeout expires, at most UIO_MAXIOV datagrams per call
+        while ( sent < count ) {
+            int sent_now = ::sendmmsg ( this->fd_, &this->send_headers_[sent],
+                                        std::min<size_t> ( count - sent, UIO_MAXIOV ), MSG_DONTWAIT );
+            if ( sent_now > 0 ) { sent += sent_now; continue; }
+            if ( sent_now == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                throw new InterfaceException ( "Udp::send : sendmmsg", errno );
+            // The socket buffer is full, wait for room
+            if ( ! this->send_blocking_ || timeout.expired() ) break;
+            if ( this->waitSend_ ( timeout ) < 0 ) this->takeSendError_().raise();
+        }
+        return sent;
+    }
+
+    // GET LOCAL PORT : Port the socket is bound to, 0 if not bound yet
+    uint16_t Udp::getLocalPort ( ) const {
+        sockaddr_in local;
+        socklen_t length = sizeof ( local );
+        if ( ! this->is_open_ || ::getsockname ( this->fd_, (struct sockaddr *) &local, &length ) < 0 ) return 0;
+        return ntohs ( local.sin_port );
+    }
+
+    // Largest UDP payload, a read with this much room never truncates a datagram
+    static const size_t MAX_DATAGRAM = 65535;
+
+    // Read common function, each datagram is appended to the data
+    size_t Udp::read_ (uint8_t *data, size_t size, size_t least) {
+        // If the socket is not open and connected, fail
+        if ( ! ( this->is_open_ && this->is_connected_ ) )
+            return this->readError_ ( ERROR_NOT_CONNECTED, "Udp::read : not connected" );
+        size_t bytes_read = 0;
+        // Prepare timeout value : now + read + byte*least
+        TimeCheck timeout ( this->timeout_.read, this->timeout_.byte, least );
+        // Read datagrams until at least the desired size is read, there's no room left or timeout expires
+        while ( bytes_read < least && bytes_read < size ) {
+            // A datagram is taken whole: one longer than the room left stays queued for the next call, unless it is the
+            // first of a read into the read-ahead buffer, which grows to take it
+            if ( size - bytes_read < MAX_DATAGRAM ) {
+                ssize_t length = ::recv ( this->fd_, NULL, 0, MSG_PEEK | MSG_TRUNC | MSG_DONTWAIT );
+                if ( length > static_cast<ssize_t> ( size - bytes_read ) ) {
+                    if ( bytes_read > 0 ) break;
+                    if ( data != this->rx_.tail() )
+                        return this->readError_ ( ERROR_SYSCALL, "Udp::read : datagram longer than the buffer", EMSGSIZE );
+                    this->rx_.prepare ( length );
+                    data = this->rx_.tail();
+                    size = this->rx_.space();
+                }
+            }
+            ssize_t bytes_read_now = ::recv ( this->fd_, data + bytes_read, size - bytes_read, MSG_DONTWAIT );
+            this->countRead_ ( bytes_read_now );
+            if ( bytes_read_now >= 0 ) { bytes_read += bytes_read_now; continue; }
+            if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                return this->readError_ ( ERROR_SYSCALL, "Udp::read : recv", errno, bytes_read );
+            // Nothing queued, wait for the next datagram
+            if ( ! this->read_blocking_ || timeout.expired() || this->waitRead_ ( timeout ) < 0 ) break;
+        }
+        if ( bytes_read < least ) this->read_counters_.add ( Counters::PARTIAL_READS );
+        return bytes_read;
+    }
+
+    // Send common function, data is sent as a single datagram
+    size_t Udp::send_ (const uint8_t *data, size_t size) {
+        struct iovec iov;
+        iov.iov_base = const_cast<uint8_t*> ( data );
+        iov.iov_len = size;
+        return this->sendv_ ( &iov, 1 );
+    }
+
+    // Send vectored common function, the buffers are sent as a single datagram
+    size_t Udp::sendv_ (struct iovec *iov, size_t count) {
+        // If the socket is not open and connected, fail
+        if ( ! ( this->is_open_ && this->is_connected_ ) )
+            return this->sendError_ ( ERROR_NOT_CONNECTED, "Udp::send : not connected" );
+        struct msghdr message;
+        std::memset ( &message, 0, sizeof ( message ) );
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        // Prepare timeout value : now + send
+        TimeCheck timeout ( this->timeout_.send, this->timeout_.byte, 1 );
+        while ( true ) {
+            // A datagram is sent in full or not at all
+            ssize_t bytes_sent = ::sendmsg ( this->fd_, &message, MSG_DONTWAIT );
+            this->countSend_ ( bytes_sent );
+            if ( bytes_sent >= 0 ) return bytes_sent;
+            if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                return this->sendError_ ( ERROR_SYSCALL, "Udp::send : sendmsg", errno );
+            // The socket buffer is full, wait for room
+            if ( ! this->send_blocking_ || timeout.expired() ) {
+                this->send_counters_.add ( Counters::PARTIAL_SENDS );
+                return 0;
+            }
+            if ( this->waitSend_ ( timeout ) < 0 ) return 0;
+        }
+    }
+
+    // Open the file descriptor
+    void Udp::open_ () {
+        if ( this->is_open_ )
+            return;
+        if ( ( this->fd_ = socket(this->sockaddr_in_.sin_family, SOCK_DGRAM, IPPROTO_UDP) ) < 0 ) {
+            switch ( errno ) {
+            case EINTR: // Recurse because this is a recoverable error.
+                this->open_ ( ); return;
+            case ENFILE: case EMFILE: // Other error numbers
+                throw new IOException ( "Udp::open : Too many file handles open", errno );
+            default:
+                throw new IOException ( "Udp::open : general IO exception", errno );
+            }
+        }
+        // IS OPEN
+        this->is_open_ = true;
+    }
+
+    // Bind the local port and set the remote peer
+    void Udp::connect_ () {
+        bool has_peer = ! this->address_.empty() && this->port_ != 0;
+        if ( this->is_connected_ || ! ( has_peer || this->local_port_ != 0 ) )
+            return;
+        // Bind the local port on every interface
+        if ( this->local_port_ != 0 ) {
+            sockaddr_in local;
+            std::memset ( &local, 0, sizeof ( local ) );
+            local.sin_family = this->sockaddr_in_.sin_family;
+            local.sin_addr.s_addr = htonl ( INADDR_ANY );
+            local.sin_port = htons ( this->local_port_ );
+            if ( ::bind ( this->fd_, (struct sockaddr *) &local, sizeof ( local ) ) < 0 )
+                throw new InterfaceException ( "Udp::connect : bind", errno );
+        }
+        // Set the default destination and filter the incoming datagrams by source
+        if ( has_peer ) {
+            set_address ( &(this->address_), this->port_, &(this->sockaddr_in_) );
+            if ( ::connect ( this->fd_, (struct sockaddr *) & ( this->sockaddr_in_ ), sizeof ( this->sockaddr_in_ ) ) < 0 )
+                throw new InterfaceException ( "Udp::connect : generic error", errno );
+        }
+        // Set socket timeout
+        this->setOptions_ ( );
+        // IS CONNECTED
+        this->is_connected_ = true;
+    }
+
+    // Set socket
+    void Udp::setOptions_() {
+        if ( setsockopt ( this->fd_, SOL_SOCKET, SO_RCVTIMEO,
+                        (const char *) & ( this->timeout_.read ),
+                        sizeof ( this->timeout_.read ) ) != 0 )
+            throw new InterfaceException ( "Udp::setOptions : set read timeout", errno );
+        if ( setsockopt ( this->fd_, SOL_SOCKET, SO_SNDTIMEO,
+                        (const char *) & ( this->timeout_.send ),
+                        sizeof ( this->timeout_.send ) ) != 0 )
+            throw new InterfaceException ( "Udp::setOptions : set send timeout", errno );
+    }
+
+}
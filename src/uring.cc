@@ -0,0 +1,572 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file uring.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/uring.h>
+// SYS
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#ifdef COMM_HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <csignal>
+#ifndef IORING_RECV_MULTISHOT
+#define IORING_RECV_MULTISHOT ( 1U << 1 )
+#endif
+#endif
+
+namespace comm {
+
+#ifdef COMM_HAVE_IO_URING
+    // The raw syscalls are used, liburing is not a dependency
+    static int io_uring_setup ( unsigned entries, struct io_uring_params *params ) {
+        return static_cast<int> ( ::syscall ( __NR_io_uring_setup, entries, params ) ); }
+    static int io_uring_enter ( int fd, unsigned submit, unsigned wait, unsigned flags, void *arg, size_t size ) {
+        return static_cast<int> ( ::syscall ( __NR_io_uring_enter, fd, submit, wait, flags, arg, size ) ); }
+    static int io_uring_register ( int fd, unsigned opcode, void *arg, unsigned count ) {
+        return static_cast<int> ( ::syscall ( __NR_io_uring_register, fd, opcode, arg, count ) ); }
+
+    // Kind of operation, stored in the low bits of the user data, the entry id in the high bits
+    typedef enum { RECV = 1, WRITE = 2, PROVIDE = 3, WAKE = 4, TIMEOUT = 5, CANCEL = 6 } Operation;
+    static const unsigned OPERATION_BITS = 3;
+    static uint64_t user_data ( uint64_t id, Operation operation ) { return ( id << OPERATION_BITS ) | operation; }
+    // Group of the provided buffers
+    static const uint16_t BUFFER_GROUP = 0;
+#endif
+
+    Uring::Uring ( unsigned entries, size_t buffer_size, size_t buffers ) :
+            ring_fd_(-1), sq_ring_(NULL), cq_ring_(NULL), sqes_(NULL), sq_ring_size_(0), cq_ring_size_(0), sqes_size_(0),
+            sq_head_(NULL), sq_tail_(NULL), sq_mask_(NULL), sq_array_(NULL), cq_head_(NULL), cq_tail_(NULL),
+            cq_mask_(NULL), cqes_(NULL), sq_entries_(0), to_submit_(0), features_(0),
+            multishot_(false), registered_(false), provide_buffers_(false), event_fd_(-1), event_counter_(0),
+            buffer_size_(buffer_size), buffers_(buffer_size * buffers), free_buffers_(buffers),
+            next_id_(1), enters_(0), stopped_(false) {
+        if ( buffer_size == 0 || buffers == 0 ) throw new invalid_argument ( "Uring::Uring : empty buffer pool" );
+        // Buffers are handed out from the back, the first ones first
+        for ( size_t i = 0; i < buffers; ++i ) this->free_buffers_[i] = buffers - 1 - i;
+        this->setup_ ( entries );
+        if ( this->ring_fd_ < 0 ) this->reactor_.reset ( new Reactor() );
+    }
+
+    Uring::~Uring ( ) {
+        // Cancel the pending operations, the kernel must be done with the buffers before they are released
+        vector<Comm*> comms;
+        for ( std::map<Comm*, uint64_t>::iterator it = this->ids_.begin(); it != this->ids_.end(); ++it )
+            comms.push_back ( it->first );
+        for ( size_t i = 0; i < comms.size(); ++i ) this->remove ( *comms[i] );
+        for ( int i = 0; i < 100 && this->ring_fd_ >= 0 && ! this->entries_.empty(); ++i ) this->poll ( 0.01 );
+        this->teardown_ ( );
+    }
+
+    // SUPPORTED : True if io_uring can be used by this process, probed once
+    bool Uring::supported ( ) {
+#ifdef COMM_HAVE_IO_URING
+        static int supported = -1;
+        if ( supported < 0 ) {
+            struct io_uring_params params;
+            std::memset ( &params, 0, sizeof ( params ) );
+            int fd = io_uring_setup ( 2, &params );
+            supported = fd >= 0;
+            if ( fd >= 0 ) ::close ( fd );
+        }
+        return supported;
+#else
+        return false;
+#endif
+    }
+
+    // IS URING : True if the engine runs on io_uring, false if it fell back to epoll
+    bool Uring::isUring ( ) const { return this->ring_fd_ >= 0; }
+    // IS MULTISHOT : True if sockets are received with a multishot recv
+    bool Uring::isMultishot ( ) const { return this->ring_fd_ >= 0 && this->multishot_; }
+    // IS REGISTERED : True if the buffers are registered with the kernel
+    bool Uring::isRegistered ( ) const { return this->ring_fd_ >= 0 && this->registered_; }
+    // ENTERS : Number of io_uring_enter (or epoll_wait) calls made so far
+    size_t Uring::enters ( ) const { return this->enters_; }
+
+    // ADD : Register an open comm::Comm, switch it to non blocking mode and start receiving
+    void Uring::add ( Comm& comm, const ReadCallback& callback ) {
+        int fd = comm.getFileDescriptor();
+        if ( fd < 0 ) throw new ConnectionException ( "Uring::add : not open" );
+        if ( this->ids_.count ( &comm ) ) throw new invalid_argument ( "Uring::add : already registered" );
+        boost::shared_ptr<Entry> entry = boost::make_shared<Entry>();
+        entry->id = this->next_id_++;
+        entry->comm = &comm;
+        entry->fd = fd;
+        struct stat status;
+        entry->socket = ::fstat ( fd, &status ) == 0 && S_ISSOCK ( status.st_mode );
+        entry->receiving = false;
+        entry->writing = false;
+        entry->buffer = this->free_buffers_.size();
+        entry->callback = callback;
+        uint64_t id = entry->id;
+        if ( this->ring_fd_ < 0 ) {
+            // Fallback, read on readiness with the existing read_ path, flush the queued chunks when writable
+            this->reactor_->add ( comm, Reactor::READ, [this, id] ( Comm& comm, uint32_t events ) {
+                Entries::iterator found = this->entries_.find ( id );
+                if ( found == this->entries_.end() ) return;
+                boost::shared_ptr<Entry> entry = found->second;
+                if ( events & Reactor::SEND ) this->flush_ ( *entry );
+                if ( ! ( events & ( Reactor::READ | Reactor::ERROR | Reactor::DISCONNECT ) ) ) return;
+                int received;
+                {
+                    boost::lock_guard<boost::mutex> lock(comm.mtx_read);
+                    received = static_cast<int> ( comm.fill_ ( 1 ) );
+                    // The peer closing is reported as by the ring, with 0
+                    Error error = comm.takeReadError_();
+                    if ( error ) received = error.code == ERROR_DISCONNECTED ? 0 : -EIO;
+                }
+                if ( entry->comm ) entry->callback ( comm, received );
+            } );
+        } else {
+            // Sockets with provided buffers need no buffer of their own
+            if ( ! ( entry->socket && this->provide_buffers_ ) ) {
+                if ( this->free_buffers_.empty() ) throw new IOException ( "Uring::add : no free buffer", ENOBUFS );
+                entry->buffer = this->free_buffers_.back();
+                this->free_buffers_.pop_back();
+            }
+            comm.setBlocking ( false );
+            comm.is_driven_ = true;
+        }
+        this->entries_[id] = entry;
+        this->ids_[&comm] = id;
+#ifdef COMM_HAVE_IO_URING
+        if ( this->ring_fd_ >= 0 ) this->arm_ ( *entry );
+#endif
+    }
+
+    // REMOVE : Stop receiving and deregister a comm::Comm, pending sends are dropped
+    void Uring::remove ( Comm& comm ) {
+        boost::shared_ptr<Entry> entry = this->find_ ( comm );
+        if ( ! entry ) return;
+        this->ids_.erase ( &comm );
+        // Drop the pending sends, the chunk being written is kept until its completion
+        while ( entry->chunks.size() > ( entry->writing ? 1 : 0 ) ) {
+            this->free_buffers_.push_back ( entry->chunks.back().buffer );
+            entry->chunks.pop_back();
+        }
+        if ( entry->writing ) entry->chunks.front().callback.clear();
+        entry->comm = NULL;
+        comm.is_driven_ = false;
+        if ( this->ring_fd_ < 0 ) {
+            this->reactor_->remove ( comm );
+            this->entries_.erase ( entry->id );
+            return;
+        }
+#ifdef COMM_HAVE_IO_URING
+        // The entry is released when its last operation completes
+        for ( int operation = RECV; operation <= WRITE; ++operation ) {
+            if ( ! ( operation == RECV ? entry->receiving : entry->writing ) ) continue;
+            struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*> ( this->sqe_ ( ) );
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = user_data ( entry->id, static_cast<Operation> ( operation ) );
+            sqe->user_data = user_data ( entry->id, CANCEL );
+        }
+        // Submit now, nothing must be received for the instance once remove returns
+        if ( this->to_submit_ > 0 ) this->enter_ ( this->to_submit_, 0, 0 );
+        if ( ! entry->receiving && ! entry->writing ) {
+            if ( ! ( entry->socket && this->provide_buffers_ ) ) this->free_buffers_.push_back ( entry->buffer );
+            this->entries_.erase ( entry->id );
+        }
+#endif
+        comm.setBlocking ( true );
+    }
+
+    // SEND (uint8_t*,size) : Queue data to be sent to a registered comm::Comm, false if the pool is short of buffers
+    bool Uring::send ( Comm& comm, const uint8_t *data, size_t size, const SendCallback& callback ) {
+        boost::shared_ptr<Entry> entry = this->find_ ( comm );
+        if ( ! entry ) throw new ConnectionException ( "Uring::send : not registered" );
+        size_t chunks = ( size + this->buffer_size_ - 1 ) / this->buffer_size_;
+        if ( chunks > this->free_buffers_.size() ) return false;
+        // Data is copied, the caller can reuse it as soon as send returns
+        for ( size_t offset = 0; offset < size; offset += this->buffer_size_ ) {
+            Chunk chunk;
+            chunk.buffer = this->free_buffers_.back();
+            this->free_buffers_.pop_back();
+            chunk.size = std::min ( size - offset, this->buffer_size_ );
+            chunk.sent = 0;
+            chunk.total = size;
+            if ( offset + chunk.size == size ) chunk.callback = callback;
+            std::memcpy ( this->bufferAt_ ( chunk.buffer ), data + offset, chunk.size );
+            entry->chunks.push_back ( chunk );
+        }
+        if ( this->ring_fd_ < 0 ) this->flush_ ( *entry );
+#ifdef COMM_HAVE_IO_URING
+        else this->write_ ( *entry );
+#endif
+        return true;
+    }
+
+    // SEND (string) : Queue data to be sent to a registered comm::Comm, false if the pool is short of buffers
+    bool Uring::send ( Comm& comm, const string& data, const SendCallback& callback ) {
+        return this->send ( comm, reinterpret_cast<const uint8_t*> ( data.data() ), data.size(), callback );
+    }
+
+    // POLL : Submit, wait for completions up to timeout seconds (negative to wait forever), dispatch them
+    size_t Uring::poll ( double timeout ) {
+        if ( this->ring_fd_ < 0 ) {
+            ++this->enters_;
+            return this->reactor_->poll ( timeout );
+        }
+#ifdef COMM_HAVE_IO_URING
+        // Completions already posted are dispatched without entering the kernel, unless there is something to submit
+        size_t dispatched = this->reap_ ( );
+        if ( dispatched > 0 && this->to_submit_ == 0 ) return dispatched;
+        this->enter_ ( this->to_submit_, dispatched > 0 ? 0 : 1, timeout );
+        return dispatched + this->reap_ ( );
+#else
+        return 0;
+#endif
+    }
+
+    // RUN : Poll and dispatch until stop is called
+    void Uring::run ( ) {
+        while ( ! this->stopped_ ) this->poll ( );
+        this->stopped_ = false;
+    }
+
+    // STOP : Make run return and wake up a pending poll, can be called from any thread
+    void Uring::stop ( ) {
+        this->stopped_ = true;
+        if ( this->ring_fd_ < 0 ) { this->reactor_->stop ( ); return; }
+        uint64_t counter = 1;
+        if ( ::write ( this->event_fd_, &counter, sizeof ( counter ) ) < 0 && errno != EAGAIN )
+            throw new IOException ( "Uring::stop : eventfd", errno );
+    }
+
+    // Entry lookup
+    boost::shared_ptr<Uring::Entry> Uring::find_ ( Comm& comm ) {
+        std::map<Comm*, uint64_t>::iterator id = this->ids_.find ( &comm );
+        if ( id == this->ids_.end() ) return boost::shared_ptr<Entry>();
+        return this->entries_[id->second];
+    }
+
+    // FALLBACK : Send the queued chunks with the existing send path, wait for writability when the socket is full
+    void Uring::flush_ ( Entry& entry ) {
+        while ( entry.comm && ! entry.chunks.empty() ) {
+            Chunk& chunk = entry.chunks.front();
+            Result<size_t> sent = entry.comm->send ( this->bufferAt_ ( chunk.buffer ) + chunk.sent, chunk.size - chunk.sent,
+                                                     std::nothrow );
+            if ( ! sent ) {
+                // Report the failure to every pending send call, the instance stays registered
+                while ( ! entry.chunks.empty() ) {
+                    Chunk dropped = entry.chunks.front();
+                    entry.chunks.pop_front();
+                    this->free_buffers_.push_back ( dropped.buffer );
+                    if ( dropped.callback ) dropped.callback ( *entry.comm, -EIO );
+                }
+                break;
+            }
+            chunk.sent += sent.value();
+            if ( chunk.sent < chunk.size ) {
+                this->reactor_->modify ( *entry.comm, Reactor::READ | Reactor::SEND );
+                return;
+            }
+            Chunk done = chunk;
+            entry.chunks.pop_front();
+            this->free_buffers_.push_back ( done.buffer );
+            if ( done.callback ) done.callback ( *entry.comm, static_cast<int> ( done.total ) );
+        }
+        if ( entry.comm ) this->reactor_->modify ( *entry.comm, Reactor::READ );
+    }
+
+#ifdef COMM_HAVE_IO_URING
+    /*=========================================================================================================================
+     * RING : Setup, submission and completion
+     *=======================================================================================================================*/
+    // Map the rings, probe the opcodes, register the buffers and provide the receive buffers, ring_fd_ is -1 on failure
+    void Uring::setup_ ( unsigned entries ) {
+        struct io_uring_params params;
+        std::memset ( &params, 0, sizeof ( params ) );
+        if ( ( this->ring_fd_ = io_uring_setup ( entries, &params ) ) < 0 ) { this->ring_fd_ = -1; return; }
+        this->features_ = params.features;
+        this->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof ( unsigned );
+        this->cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof ( struct io_uring_cqe );
+        bool single_mmap = this->features_ & IORING_FEAT_SINGLE_MMAP;
+        if ( single_mmap ) this->sq_ring_size_ = this->cq_ring_size_ = std::max ( this->sq_ring_size_, this->cq_ring_size_ );
+        this->sq_ring_ = ::mmap ( NULL, this->sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  this->ring_fd_, IORING_OFF_SQ_RING );
+        if ( this->sq_ring_ == MAP_FAILED ) { this->sq_ring_ = NULL; this->teardown_ ( ); return; }
+        this->cq_ring_ = single_mmap ? this->sq_ring_ :
+                         ::mmap ( NULL, this->cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                  this->ring_fd_, IORING_OFF_CQ_RING );
+        if ( this->cq_ring_ == MAP_FAILED ) { this->cq_ring_ = NULL; this->teardown_ ( ); return; }
+        this->sqes_size_ = params.sq_entries * sizeof ( struct io_uring_sqe );
+        this->sqes_ = ::mmap ( NULL, this->sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                               this->ring_fd_, IORING_OFF_SQES );
+        if ( this->sqes_ == MAP_FAILED ) { this->sqes_ = NULL; this->teardown_ ( ); return; }
+        uint8_t *sq = static_cast<uint8_t*> ( this->sq_ring_ ), *cq = static_cast<uint8_t*> ( this->cq_ring_ );
+        this->sq_head_ = reinterpret_cast<unsigned*> ( sq + params.sq_off.head );
+        this->sq_tail_ = reinterpret_cast<unsigned*> ( sq + params.sq_off.tail );
+        this->sq_mask_ = reinterpret_cast<unsigned*> ( sq + params.sq_off.ring_mask );
+        this->sq_array_ = reinterpret_cast<unsigned*> ( sq + params.sq_off.array );
+        this->cq_head_ = reinterpret_cast<unsigned*> ( cq + params.cq_off.head );
+        this->cq_tail_ = reinterpret_cast<unsigned*> ( cq + params.cq_off.tail );
+        this->cq_mask_ = reinterpret_cast<unsigned*> ( cq + params.cq_off.ring_mask );
+        this->cqes_ = cq + params.cq_off.cqes;
+        this->sq_entries_ = params.sq_entries;
+        // Probe the opcodes, plain reads, writes, recv and cancel are required, the others are optional
+        vector<uint8_t> probe_memory ( sizeof ( struct io_uring_probe ) + 256 * sizeof ( struct io_uring_probe_op ) );
+        struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe*> ( &probe_memory[0] );
+        if ( io_uring_register ( this->ring_fd_, IORING_REGISTER_PROBE, probe, 256 ) < 0 ) { this->teardown_ ( ); return; }
+        struct Supported {
+            const struct io_uring_probe *probe;
+            bool operator() ( unsigned opcode ) const {
+                return opcode <= this->probe->last_op && ( this->probe->ops[opcode].flags & IO_URING_OP_SUPPORTED ); }
+        } supported = { probe };
+        if ( ! ( supported ( IORING_OP_READ ) && supported ( IORING_OP_WRITE ) && supported ( IORING_OP_RECV ) &&
+                 supported ( IORING_OP_ASYNC_CANCEL ) ) ) { this->teardown_ ( ); return; }
+        // Wake up requests are read from an event file descriptor
+        if ( ( this->event_fd_ = ::eventfd ( 0, EFD_CLOEXEC ) ) < 0 ) { this->teardown_ ( ); return; }
+        // Registered buffers save the page pinning of every read and write
+        struct iovec iov;
+        iov.iov_base = &this->buffers_[0];
+        iov.iov_len = this->buffers_.size();
+        this->registered_ = supported ( IORING_OP_READ_FIXED ) && supported ( IORING_OP_WRITE_FIXED ) &&
+                            io_uring_register ( this->ring_fd_, IORING_REGISTER_BUFFERS, &iov, 1 ) == 0;
+        // Provided buffers let many sockets share a single receive pool, multishot recv needs them
+        this->provide_buffers_ = supported ( IORING_OP_PROVIDE_BUFFERS );
+        this->multishot_ = this->provide_buffers_;
+        if ( this->provide_buffers_ ) {
+            size_t count = std::min<size_t> ( this->free_buffers_.size(), 65535 );
+            this->provided_.resize ( count * this->buffer_size_ );
+            struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*> ( this->sqe_ ( ) );
+            sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+            sqe->fd = static_cast<int> ( count );
+            sqe->addr = reinterpret_cast<uint64_t> ( &this->provided_[0] );
+            sqe->len = static_cast<uint32_t> ( this->buffer_size_ );
+            sqe->off = 0;
+            sqe->buf_group = BUFFER_GROUP;
+            sqe->user_data = user_data ( 0, PROVIDE );
+        }
+        // Keep a read armed on the event file descriptor
+        this->complete_ ( user_data ( 0, WAKE ), 0, 0 );
+    }
+
+    // Release the ring, the pending operations are cancelled by the kernel
+    void Uring::teardown_ ( ) {
+        if ( this->sqes_ ) ::munmap ( this->sqes_, this->sqes_size_ );
+        if ( this->cq_ring_ && this->cq_ring_ != this->sq_ring_ ) ::munmap ( this->cq_ring_, this->cq_ring_size_ );
+        if ( this->sq_ring_ ) ::munmap ( this->sq_ring_, this->sq_ring_size_ );
+        if ( this->ring_fd_ >= 0 ) ::close ( this->ring_fd_ );
+        if ( this->event_fd_ >= 0 ) ::close ( this->event_fd_ );
+        this->sqes_ = this->cq_ring_ = this->sq_ring_ = NULL;
+        this->ring_fd_ = this->event_fd_ = -1;
+    }
+
+    // Get a cleared submission entry, submitting the queued ones if the queue is full
+    void* Uring::sqe_ ( ) {
+        unsigned tail = *this->sq_tail_ + this->to_submit_;
+        if ( tail - __atomic_load_n ( this->sq_head_, __ATOMIC_ACQUIRE ) >= this->sq_entries_ ) {
+            this->enter_ ( this->to_submit_, 0, 0 );
+            tail = *this->sq_tail_ + this->to_submit_;
+            if ( tail - __atomic_load_n ( this->sq_head_, __ATOMIC_ACQUIRE ) >= this->sq_entries_ )
+                throw new IOException ( "Uring::submit : submission queue full", EBUSY );
+        }
+        unsigned index = tail & *this->sq_mask_;
+        struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*> ( this->sqes_ ) + index;
+        std::memset ( sqe, 0, sizeof ( *sqe ) );
+        this->sq_array_[index] = index;
+        ++this->to_submit_;
+        return sqe;
+    }
+
+    // Publish the queued submissions and wait for completions up to timeout seconds (negative to wait forever)
+    int Uring::enter_ ( unsigned submit, unsigned wait, double timeout ) {
+        unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+        struct __kernel_timespec ts;
+        struct io_uring_getevents_arg arg;
+        void *argument = NULL;
+        size_t argument_size = 0;
+        if ( wait > 0 && timeout >= 0 ) {
+            ts.tv_sec = static_cast<int64_t> ( timeout );
+            ts.tv_nsec = static_cast<long long> ( ( timeout - ts.tv_sec ) * 1e9 );
+            if ( this->features_ & IORING_FEAT_EXT_ARG ) {
+                std::memset ( &arg, 0, sizeof ( arg ) );
+                arg.sigmask_sz = _NSIG / 8;
+                arg.ts = reinterpret_cast<uint64_t> ( &ts );
+                flags |= IORING_ENTER_EXT_ARG;
+                argument = &arg;
+                argument_size = sizeof ( arg );
+            } else {
+                // Older kernels, a timeout operation completes after the timeout or after the first completion
+                struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*> ( this->sqe_ ( ) );
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->fd = -1;
+                sqe->addr = reinterpret_cast<uint64_t> ( &ts );
+                sqe->len = 1;
+                sqe->off = 1;
+                sqe->user_data = user_data ( 0, TIMEOUT );
+                submit = this->to_submit_;
+            }
+        }
+        __atomic_store_n ( this->sq_tail_, *this->sq_tail_ + this->to_submit_, __ATOMIC_RELEASE );
+        int result = io_uring_enter ( this->ring_fd_, submit, wait, flags, argument, argument_size );
+        int error = errno;
+        ++this->enters_;
+        // Whatever the result, the entries not consumed by the kernel are still queued
+        this->to_submit_ = *this->sq_tail_ - __atomic_load_n ( this->sq_head_, __ATOMIC_ACQUIRE );
+        if ( result >= 0 ) return result;
+        switch ( error ) {
+        case ETIME: case EINTR: case EAGAIN: case EBUSY:  // Timed out, interrupted or completion queue overflow
+            return 0;
+        default:
+            throw new IOException ( "Uring::poll : io_uring_enter", error );
+        }
+    }
+
+    // Dispatch the posted completions, return their number
+    size_t Uring::reap_ ( ) {
+        size_t dispatched = 0;
+        unsigned head = *this->cq_head_;
+        while ( head != __atomic_load_n ( this->cq_tail_, __ATOMIC_ACQUIRE ) ) {
+            struct io_uring_cqe cqe = static_cast<struct io_uring_cqe*> ( this->cqes_ ) [ head & *this->cq_mask_ ];
+            // Release the slot before dispatching, callbacks may queue new operations
+            __atomic_store_n ( this->cq_head_, ++head, __ATOMIC_RELEASE );
+            this->complete_ ( cqe.user_data, cqe.res, cqe.flags );
+            ++dispatched;
+        }
+        return dispatched;
+    }
+
+    // Handle a completion, re-arm the receives and continue the writes
+    void Uring::complete_ ( uint64_t data, int result, uint32_t flags ) {
+        Operation operation = static_cast<Operation> ( data & ( ( 1 << OPERATION_BITS ) - 1 ) );
+        uint64_t id = data >> OPERATION_BITS;
+        if ( operation == WAKE ) {
+            struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*> ( this->sqe_ ( ) );
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = this->event_fd_;
+            sqe->addr = reinterpret_cast<uint64_t> ( &this->event_counter_ );
+            sqe->len = sizeof ( this->event_counter_ );
+            sqe->user_data = user_data ( 0, WAKE );
+            return;
+        }
+        if ( operation != RECV && operation != WRITE ) return;
+        bool selected = flags & IORING_CQE_F_BUFFER;
+        size_t buffer = flags >> IORING_CQE_BUFFER_SHIFT;
+        Entries::iterator found = this->entries_.find ( id );
+        if ( found == this->entries_.end() ) { if ( selected ) this->provide_ ( buffer ); return; }
+        boost::shared_ptr<Entry> entry = found->second;
+        if ( operation == RECV ) {
+            bool more = flags & IORING_CQE_F_MORE;
+            if ( ! more ) entry->receiving = false;
+            // Counted as the synchronous path counts its syscall, the failure goes through errno
+            if ( entry->comm ) { if ( result < 0 ) errno = -result; entry->comm->countRead_ ( result ); }
+            if ( result > 0 && entry->comm )
+                entry->comm->feed_ ( selected ? this->providedAt_ ( buffer ) : this->bufferAt_ ( entry->buffer ), result );
+            if ( selected ) this->provide_ ( buffer );
+            if ( entry->comm ) {
+                // The kernel lacks multishot recv, fall back to single shot receives
+                if ( result == -EINVAL && this->multishot_ && entry->socket ) {
+                    this->multishot_ = false;
+                    this->arm_ ( *entry );
+                    return;
+                }
+                // Re-arm unless the peer closed or a real error occurred
+                if ( result > 0 || result == -ENOBUFS || result == -EAGAIN || result == -EINTR ) this->arm_ ( *entry );
+                if ( result != -ENOBUFS && result != -EAGAIN && result != -EINTR ) entry->callback ( *entry->comm, result );
+            }
+        } else {
+            entry->writing = false;
+            if ( entry->comm ) { if ( result < 0 ) errno = -result; entry->comm->countSend_ ( result ); }
+            Chunk& chunk = entry->chunks.front();
+            if ( result == -EAGAIN || result == -EINTR ) result = 0;
+            if ( result >= 0 && entry->comm ) {
+                chunk.sent += result;
+                if ( chunk.sent < chunk.size ) { this->write_ ( *entry ); return; }
+            }
+            Chunk done = chunk;
+            entry->chunks.pop_front();
+            this->free_buffers_.push_back ( done.buffer );
+            // On error the remaining chunks of the same send call are dropped too
+            if ( result < 0 ) {
+                while ( ! done.callback && ! entry->chunks.empty() ) {
+                    done = entry->chunks.front();
+                    entry->chunks.pop_front();
+                    this->free_buffers_.push_back ( done.buffer );
+                }
+            }
+            if ( done.callback && entry->comm )
+                done.callback ( *entry->comm, result < 0 ? result : static_cast<int> ( done.total ) );
+            this->write_ ( *entry );
+        }
+        // A removed entry is released when its last operation completes
+        if ( ! entry->comm && ! entry->receiving && ! entry->writing ) {
+            if ( ! ( entry->socket && this->provide_buffers_ ) ) this->free_buffers_.push_back ( entry->buffer );
+            this->entries_.erase ( entry->id );
+        }
+    }
+
+    // Give a receive buffer back to the kernel
+    void Uring::provide_ ( size_t buffer ) {
+        struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*> ( this->sqe_ ( ) );
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<uint64_t> ( this->providedAt_ ( buffer ) );
+        sqe->len = static_cast<uint32_t> ( this->buffer_size_ );
+        sqe->off = buffer;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->user_data = user_data ( 0, PROVIDE );
+    }
+
+    // Arm a receive, a multishot recv into the provided buffers for sockets, a read into the own buffer otherwise
+    void Uring::arm_ ( Entry& entry ) {
+        if ( entry.receiving || ! entry.comm ) return;
+        struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*> ( this->sqe_ ( ) );
+        sqe->fd = entry.fd;
+        if ( entry.socket && this->provide_buffers_ ) {
+            sqe->opcode = IORING_OP_RECV;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = BUFFER_GROUP;
+            // A multishot recv takes the length of each provided buffer
+            sqe->len = this->multishot_ ? 0 : static_cast<uint32_t> ( this->buffer_size_ );
+            if ( this->multishot_ ) sqe->ioprio = IORING_RECV_MULTISHOT;
+        } else {
+            sqe->opcode = entry.socket ? IORING_OP_RECV : this->registered_ ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->addr = reinterpret_cast<uint64_t> ( this->bufferAt_ ( entry.buffer ) );
+            sqe->len = static_cast<uint32_t> ( this->buffer_size_ );
+            // Serial ports are not seekable, read at the current position
+            if ( ! entry.socket ) sqe->off = static_cast<uint64_t> ( -1 );
+        }
+        sqe->user_data = user_data ( entry.id, RECV );
+        entry.receiving = true;
+    }
+
+    // Write the remainder of the front chunk, one write in flight for each instance keeps the sends in order
+    void Uring::write_ ( Entry& entry ) {
+        if ( entry.writing || entry.chunks.empty() || ! entry.comm ) return;
+        Chunk& chunk = entry.chunks.front();
+        struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe*> ( this->sqe_ ( ) );
+        sqe->opcode = this->registered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd = entry.fd;
+        sqe->addr = reinterpret_cast<uint64_t> ( this->bufferAt_ ( chunk.buffer ) + chunk.sent );
+        sqe->len = static_cast<uint32_t> ( chunk.size - chunk.sent );
+        sqe->off = static_cast<uint64_t> ( -1 );
+        sqe->user_data = user_data ( entry.id, WRITE );
+        entry.writing = true;
+    }
+#else
+    /*=========================================================================================================================
+     * RING : Built without <linux/io_uring.h>, the engine always falls back to epoll
+     *=======================================================================================================================*/
+    void Uring::setup_ ( unsigned ) { this->ring_fd_ = -1; }
+    void Uring::teardown_ ( ) { }
+#endif
+
+}
@@ -227,10 +227,10 @@ namespace comm {
         else option->c_cflag &= (unsigned long) ~(CNEW_RTSCTS);
 #endif
         // http://www.unixwiz.net/techtips/termios-vmin-vtime.html
-        // this basically sets the read call up to be a polling read,
-        // but we are using select to ensure there is data available
-        // to read before each call, so we should never needlessly poll
-        option->c_cc[VMIN] = 0;
+        // the port is non blocking, so VMIN does not make the read call wait: it only sets how many bytes must be
+        // buffered before poll reports the port readable, one wakeup per frame. VTIME stays 0, with a VTIME poll
+        // reports every single byte again
+        option->c_cc[VMIN] = settings.frame_size;
         option->c_cc[VTIME] = 0;
     }
 
@@ -260,4 +260,19 @@ namespace comm {
             throw InterfaceException ( "unable to parse ip address", errno );
     }
 
+    // Skip size bytes of an iovec array, move iov to the first entry left and return the number of entries left
+    size_t advance_iovec ( struct iovec *& iov, size_t count, size_t size ) {
+        // Drop the entries sent in full
+        while ( count > 0 && size >= iov->iov_len ) {
+            size -= iov->iov_len;
+            ++iov; --count;
+        }
+        // Trim the entry sent in part
+        if ( count > 0 ) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + size;
+            iov->iov_len -= size;
+        }
+        return count;
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,232 @@
+/*!
+ * \file pty_loopback.h
+ * \author Andrea Tamantini <tamandre89@gmail.com>
+ * \version 0.1
+ *
+ * \section LICENSE
+ *
+ * The MIT License
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * \section DESCRIPTION
+ *
+ * This provides pseudo terminal loopbacks playing serial devices, so that comm::Serial can be exercised without
+ * hardware, with the byte timing of a real line. The tests and the benchmarks share it.
+ */
+
+#ifndef COMM_TEST_PTY_LOOPBACK_H
+#define COMM_TEST_PTY_LOOPBACK_H
+
+// COMM
+#include <comm/utils.h>
+// SYS
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <termios.h>
+#include <unistd.h>
+// STD
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <stdexcept>
+#include <time.h>
+
+
+namespace comm {
+namespace test {
+
+
+    // MONOTONIC : CLOCK_MONOTONIC time in seconds
+    inline double monotonic ( ) {
+        timespec now;
+        clock_gettime ( CLOCK_MONOTONIC, &now );
+        return now.tv_sec + now.tv_nsec * 1e-9;
+    }
+
+    // SLEEP UNTIL : Sleep until an absolute CLOCK_MONOTONIC time in seconds
+    inline void sleep_until ( double time ) {
+        timespec until;
+        until.tv_sec = static_cast<time_t> ( time );
+        until.tv_nsec = static_cast<long> ( ( time - until.tv_sec ) * 1e9 );
+        while ( clock_nanosleep ( CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL ) == EINTR );
+    }
+
+    /*!
+    * Pseudo terminal pair playing a serial device: comm::Serial opens the slave path, the device side is the master.
+    *
+    * The output of the device is paced at the byte time of a baudrate (comm::get_bytetime): each queued byte takes one
+    * byte time on the line after the previous one, pump writes the bytes whose time is over. A baudrate of 0 disables
+    * the pacing, queued bytes are written at once. The master is raw and non blocking, what the port sends is read back
+    * with read.
+    */
+    class PtyLoopback {
+    public:
+        /*!
+        * Creates the pair
+        *
+        * \param baudrate Baudrate the device output is paced at, 0 for no pacing
+        *
+        * \param settings Serial settings, the bits of each byte count in the byte time
+        *
+        * \throw std::runtime_error
+        */
+        explicit PtyLoopback ( uint32_t baudrate=0, const Settings& settings=Settings() ) :
+                byte_time_(baudrate > 0 ? get_bytetime ( baudrate, settings ) : 0), head_(0), next_(0) {
+            char name[256];
+            if ( ::openpty ( &this->master_, &this->slave_, name, NULL, NULL ) < 0 )
+                throw std::runtime_error ( "PtyLoopback : openpty failed" );
+            this->path_ = name;
+            struct termios raw;
+            ::tcgetattr ( this->master_, &raw );
+            ::cfmakeraw ( &raw );
+            ::tcsetattr ( this->master_, TCSANOW, &raw );
+            ::fcntl ( this->master_, F_SETFL, ::fcntl ( this->master_, F_GETFL ) | O_NONBLOCK );
+        }
+        // Destructor, closes both sides, the port sees a hang up
+        ~PtyLoopback ( ) {
+            ::close ( this->slave_ );
+            ::close ( this->master_ );
+        }
+
+        // PATH : Slave device path, to be opened by comm::Serial
+        const std::string& path ( ) const { return this->path_; }
+        // MASTER : Master descriptor, the device side
+        int master ( ) const { return this->master_; }
+        // BYTE TIME : Seconds per byte on the line, 0 if not paced
+        double byteTime ( ) const { return this->byte_time_; }
+
+        // QUEUE (data) -> time : Queue device output, return the time its last byte is through the line
+        double queue ( const std::string& data ) {
+            std::lock_guard<std::mutex> lock(this->mtx_queue);
+            // An idle line starts over from now
+            if ( this->head_ == this->queue_.size() ) this->next_ = std::max ( this->next_, monotonic() );
+            this->queue_.append ( data );
+            return this->next_ + ( this->queue_.size() - this->head_ ) * this->byte_time_;
+        }
+        // PENDING : Number of queued bytes not written yet
+        size_t pending ( ) {
+            std::lock_guard<std::mutex> lock(this->mtx_queue);
+            return this->queue_.size() - this->head_;
+        }
+        // PUMP (now) -> time : Write the queued bytes through by now, return when the next one is (negative if none)
+        double pump ( double now ) {
+            std::lock_guard<std::mutex> lock(this->mtx_queue);
+            size_t pending = this->queue_.size() - this->head_;
+            if ( pending == 0 ) return -1;
+            // A byte is written once the line has carried all of its bits, as a UART receiver would hand it over
+            size_t due = pending;
+            if ( this->byte_time_ > 0 )
+                due = now < this->next_ + this->byte_time_ ? 0 :
+                      std::min ( pending, static_cast<size_t> ( ( now - this->next_ ) / this->byte_time_ ) );
+            ssize_t written = due > 0 ? ::write ( this->master_, this->queue_.data() + this->head_, due ) : 0;
+            if ( written > 0 ) {
+                this->head_ += written;
+                this->next_ += written * this->byte_time_;
+            }
+            // Drop the written bytes once in a while, not on every call
+            if ( this->head_ == this->queue_.size() ) { this->queue_.clear(); this->head_ = 0; return -1; }
+            if ( this->head_ > 65536 ) { this->queue_.erase ( 0, this->head_ ); this->head_ = 0; }
+            // The port is not reading, try again after a byte time
+            if ( due > 0 && written <= 0 ) return now + std::max ( this->byte_time_, 1e-4 );
+            return this->next_ + this->byte_time_;
+        }
+        // WRITE (data) : Queue data and pump until it is written, at the pace of the line
+        void write ( const std::string& data ) {
+            this->queue ( data );
+            for ( double next = this->pump ( monotonic() ); next >= 0; next = this->pump ( monotonic() ) )
+                sleep_until ( next );
+        }
+        // READ (data,size,timeout) -> size : Append up to size bytes sent by the port, waiting up to timeout seconds
+        size_t read ( std::string& data, size_t size, double timeout ) {
+            struct pollfd ready = { this->master_, POLLIN, 0 };
+            if ( ::poll ( &ready, 1, static_cast<int> ( timeout * 1000 ) ) < 1 ) return 0;
+            std::vector<char> buffer ( size );
+            ssize_t bytes_read = ::read ( this->master_, &buffer[0], size );
+            if ( bytes_read <= 0 ) return 0;
+            data.append ( &buffer[0], bytes_read );
+            return bytes_read;
+        }
+
+    private:
+        // Disable copy constructors
+        PtyLoopback(const PtyLoopback&);
+        PtyLoopback& operator=(const PtyLoopback&);
+
+        // master / slave descriptors, the slave is kept open so that the port never sees a hang up while reopened
+        int master_, slave_;
+        std::string path_;
+        // byte time, seconds per byte on the line
+        double byte_time_;
+        // queue, device output, head the first byte not written yet / next, time the next byte starts on the line
+        std::string queue_;
+        size_t head_;
+        double next_;
+        std::mutex mtx_queue;
+    };
+
+    /*!
+    * Thread pumping many comm::test::PtyLoopback at once, so that dozens of paced ports need a single thread.
+    *
+    * The thread sleeps until the next byte of any port is due, but at least tick seconds: a port receives the bytes due
+    * over a tick in one write, like a UART with a small FIFO.
+    */
+    class PtyPump {
+    public:
+        /*!
+        * Starts the thread
+        *
+        * \param ports The loopbacks to pump, they must outlive the pump
+        *
+        * \param tick Minimum sleep between two rounds, in seconds
+        */
+        explicit PtyPump ( const std::vector<PtyLoopback*>& ports, double tick=2e-4 ) :
+                ports_(ports), tick_(tick), stopped_(false) {
+            this->thread_ = std::thread ( [this] {
+                while ( ! this->stopped_ ) {
+                    double now = monotonic(), next = now + 1e-3;
+                    for ( size_t i = 0; i < this->ports_.size(); ++i ) {
+                        double due = this->ports_[i]->pump ( now );
+                        if ( due >= 0 ) next = std::min ( next, due );
+                    }
+                    sleep_until ( std::max ( next, now + this->tick_ ) );
+                }
+            } );
+        }
+        // Destructor, stops and joins the thread, bytes still queued are left unwritten
+        ~PtyPump ( ) {
+            this->stopped_ = true;
+            this->thread_.join();
+        }
+
+    private:
+        std::vector<PtyLoopback*> ports_;
+        double tick_;
+        std::atomic<bool> stopped_;
+        std::thread thread_;
+    };
+
+} // namespace test
+} // namespace comm
+
+#endif  // COMM_TEST_PTY_LOOPBACK_H
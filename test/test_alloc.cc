@@ -0,0 +1,138 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file test_alloc.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Steady state reads allocate nothing: the global operator new is replaced by one that counts its calls, read into a
+ *  vector or a string and readline are called over TCP loopback once their destinations and the receive buffer have
+ *  grown, and the count must not move.
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/ether.h>
+// SYS
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+// STD
+#include <new>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+// GTEST
+#include <gtest/gtest.h>
+
+using namespace comm;
+
+
+/*=============================================================================================================================
+ * OPERATOR NEW : Count the allocations of the whole process
+ *===========================================================================================================================*/
+static std::atomic<size_t> allocations(0);
+
+// Allocate size bytes, counting the call
+static void* allocate ( std::size_t size ) {
+    ++allocations;
+    if ( void *pointer = std::malloc ( size > 0 ? size : 1 ) ) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new ( std::size_t size ) { return allocate ( size ); }
+void operator delete ( void *pointer ) noexcept { std::free ( pointer ); }
+void operator delete ( void *pointer, std::size_t ) noexcept { std::free ( pointer ); }
+void* operator new[] ( std::size_t size ) { return allocate ( size ); }
+void operator delete[] ( void *pointer ) noexcept { std::free ( pointer ); }
+void operator delete[] ( void *pointer, std::size_t ) noexcept { std::free ( pointer ); }
+
+
+/*=============================================================================================================================
+ * FIXTURE : An Ether connected to a loopback peer, which queued the lines to read beforehand
+ *===========================================================================================================================*/
+static const size_t LINE = 64;
+static const size_t LINES = 1024;
+
+class SteadyRead : public ::testing::Test {
+protected:
+    SteadyRead ( ) : peer_(-1) { }
+
+    void SetUp ( ) {
+        int listener = ::socket ( AF_INET, SOCK_STREAM, 0 );
+        sockaddr_in address = sockaddr_in();
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+        socklen_t length = sizeof ( address );
+        ASSERT_EQ ( 0, ::bind ( listener, (struct sockaddr *) &address, length ) );
+        ASSERT_EQ ( 0, ::listen ( listener, 1 ) );
+        ASSERT_EQ ( 0, ::getsockname ( listener, (struct sockaddr *) &address, &length ) );
+        this->comm_.reset ( new Ether ( "127.0.0.1", ntohs ( address.sin_port ), "\n", Timeout ( 1, 1, 0, 1 ) ) );
+        this->peer_ = ::accept ( listener, NULL, NULL );
+        ::close ( listener );
+        ASSERT_GE ( this->peer_, 0 );
+        // Every line fits in the socket buffers, the reads never wait for the peer
+        string line ( LINE - 1, 'x' );
+        line += '\n';
+        string lines;
+        for ( size_t i = 0; i < LINES; ++i ) lines += line;
+        ASSERT_EQ ( static_cast<ssize_t> ( lines.size() ), ::send ( this->peer_, lines.data(), lines.size(), 0 ) );
+    }
+    void TearDown ( ) {
+        this->comm_.reset();
+        if ( this->peer_ >= 0 ) ::close ( this->peer_ );
+    }
+
+    std::unique_ptr<Ether> comm_;
+    int peer_;
+};
+
+
+/*=============================================================================================================================
+ * TESTS : A few calls grow the destinations, the rest must not allocate
+ *===========================================================================================================================*/
+static const size_t WARMUP = 16;
+
+TEST_F ( SteadyRead, VectorDoesNotAllocate ) {
+    std::vector<uint8_t> buffer;
+    for ( size_t i = 0; i < WARMUP; ++i ) { buffer.clear(); ASSERT_EQ ( LINE, this->comm_->read ( buffer, LINE ) ); }
+    size_t before = allocations;
+    for ( size_t i = WARMUP; i < LINES; ++i ) { buffer.clear(); this->comm_->read ( buffer, LINE ); }
+    EXPECT_EQ ( before, allocations );
+    EXPECT_EQ ( LINE, buffer.size() );
+}
+
+TEST_F ( SteadyRead, StringDoesNotAllocate ) {
+    string buffer;
+    for ( size_t i = 0; i < WARMUP; ++i ) { buffer.clear(); ASSERT_EQ ( LINE, this->comm_->read ( buffer, LINE ) ); }
+    size_t before = allocations;
+    for ( size_t i = WARMUP; i < LINES; ++i ) { buffer.clear(); this->comm_->read ( buffer, LINE ); }
+    EXPECT_EQ ( before, allocations );
+    EXPECT_EQ ( LINE, buffer.size() );
+}
+
+TEST_F ( SteadyRead, ReadlineDoesNotAllocate ) {
+    string buffer;
+    for ( size_t i = 0; i < WARMUP; ++i ) {
+        buffer.clear();
+        ASSERT_EQ ( LINE, this->comm_->readline ( buffer, LINE * 2 ) );
+    }
+    size_t before = allocations;
+    for ( size_t i = WARMUP; i < LINES; ++i ) { buffer.clear(); this->comm_->readline ( buffer, LINE * 2 ); }
+    EXPECT_EQ ( before, allocations );
+    EXPECT_EQ ( LINE, buffer.size() );
+}
+
+int main ( int argc, char **argv ) {
+    ::testing::InitGoogleTest ( &argc, argv );
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,70 @@
+// this is for emacs file handling -*- mode: c++; indent-tabs-mode: nil -*-
+
+// -- BEGIN LICENSE BLOCK -----------------------------------------------------------------------------------------------------
+
+/*!
+ *  Copyright (CC) 2023, Andrea Tamantini (Tamago)
+ *  \file test_serial.cc
+ *  \author Andrea Tamantini <tamandre89@gmail.com>
+ *  \date 2021-05-18
+ *
+ *  Serial round trip on a pseudo terminal loopback, no hardware needed: what the port sends reaches the device side,
+ *  what the device writes comes back from readline, also when paced at the byte time of the baudrate.
+ */
+
+// -- END LICENSE BLOCK -------------------------------------------------------------------------------------------------------
+
+
+/*=============================================================================================================================
+ * HEADER
+ *===========================================================================================================================*/
+#include <comm/serial.h>
+#include "pty_loopback.h"
+// STD
+#include <string>
+// GTEST
+#include <gtest/gtest.h>
+
+using namespace comm;
+using test::monotonic;
+
+
+/*=============================================================================================================================
+ * TESTS
+ *===========================================================================================================================*/
+static const string SENTENCE = "$GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47\n";
+
+TEST ( PtyLoopback, SendReachesTheDevice ) {
+    test::PtyLoopback device;
+    Serial serial ( device.path(), 115200, "\n", Timeout ( 1, 1, 0, 1 ) );
+    ASSERT_EQ ( SENTENCE.size(), serial.send ( SENTENCE ) );
+    string received;
+    while ( received.size() < SENTENCE.size() && device.read ( received, 256, 1 ) > 0 );
+    EXPECT_EQ ( SENTENCE, received );
+}
+
+TEST ( PtyLoopback, ReadlineGetsTheDeviceOutput ) {
+    test::PtyLoopback device;
+    Serial serial ( device.path(), 115200, "\n", Timeout ( 1, 1, 0, 1 ) );
+    device.write ( SENTENCE );
+    string line;
+    EXPECT_EQ ( SENTENCE.size(), serial.readline ( line, 256 ) );
+    EXPECT_EQ ( SENTENCE, line );
+}
+
+TEST ( PtyLoopback, PacedAtTheBaudrate ) {
+    test::PtyLoopback device ( 9600 );
+    Serial serial ( device.path(), 9600, "\n", Timeout ( 1, 1, 0, 1 ) );
+    double start = monotonic();
+    device.write ( SENTENCE );
+    string line;
+    EXPECT_EQ ( SENTENCE.size(), serial.readline ( line, 256 ) );
+    EXPECT_EQ ( SENTENCE, line );
+    // The last byte is handed over once the line carried all of them
+    EXPECT_GE ( monotonic() - start, SENTENCE.size() * device.byteTime() );
+}
+
+int main ( int argc, char **argv ) {
+    ::testing::InitGoogleTest ( &argc, argv );
+    return RUN_ALL_TESTS();
+}